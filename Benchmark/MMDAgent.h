@@ -0,0 +1,114 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* MMDAgent.h: minimal host of Plugin_SubProcess for benchmarks
+
+   Only the part of MMDAgent, GLFW 2 and MMDAgent utilities used by the plugin
+   is declared. Messages sent by the plugin are passed to a handler with the
+   time they were sent instead of being processed by a main loop. */
+
+/* headers */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+/* definitions */
+
+#define MMDAGENT_MAXBUFLEN             2048
+#define MMDAGENT_EVENT_PLUGINENABLE    "PLUGIN_EVENT_ENABLE"
+#define MMDAGENT_EVENT_PLUGINDISABLE   "PLUGIN_EVENT_DISABLE"
+#define MMDAGENT_COMMAND_PLUGINENABLE  "PLUGIN_ENABLE"
+#define MMDAGENT_COMMAND_PLUGINDISABLE "PLUGIN_DISABLE"
+
+#define GL_TRUE       1
+#define GL_FALSE      0
+#define GLFW_WAIT     1
+#define GLFW_NOWAIT   0
+#define GLFW_INFINITY 100000.0
+
+typedef void *GLFWmutex;
+typedef void *GLFWcond;
+typedef int GLFWthread;
+typedef void (*GLFWthreadfun)(void *);
+
+/* GLFW 2 */
+int glfwInit();
+void glfwTerminate();
+double glfwGetTime();
+void glfwSleep(double time);
+GLFWthread glfwCreateThread(GLFWthreadfun fun, void *arg);
+void glfwDestroyThread(GLFWthread id);
+int glfwWaitThread(GLFWthread id, int waitmode);
+GLFWmutex glfwCreateMutex();
+void glfwDestroyMutex(GLFWmutex mutex);
+void glfwLockMutex(GLFWmutex mutex);
+void glfwUnlockMutex(GLFWmutex mutex);
+GLFWcond glfwCreateCond();
+void glfwDestroyCond(GLFWcond cond);
+void glfwWaitCond(GLFWcond cond, GLFWmutex mutex, double timeout);
+void glfwSignalCond(GLFWcond cond);
+void glfwBroadcastCond(GLFWcond cond);
+
+/* MMDAgent utilities */
+char *MMDAgent_strdup(const char *str);
+int MMDAgent_strlen(const char *str);
+bool MMDAgent_strequal(const char *str1, const char *str2);
+int MMDAgent_str2int(const char *str);
+float MMDAgent_str2float(const char *str);
+
+/* MMDAgent_Handler: receiver of messages sent by plugin, called from threads of plugin */
+typedef void (*MMDAgent_Handler)(const char *type, const char *args, double time, void *data);
+
+/* MMDAgent: host */
+class MMDAgent
+{
+private:
+
+   MMDAgent_Handler m_handler;
+   void *m_data;
+
+public:
+
+   /* MMDAgent: host constructor */
+   MMDAgent();
+
+   /* setHandler: set receiver of messages */
+   void setHandler(MMDAgent_Handler handler, void *data);
+
+   /* sendMessage: pass message to handler */
+   void sendMessage(const char *type, const char *format, ...);
+};
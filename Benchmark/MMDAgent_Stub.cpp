@@ -0,0 +1,292 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* headers */
+
+#include "MMDAgent.h"
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+/* definitions */
+
+#define MMDAGENTSTUB_MAXTHREADS 4096
+
+/* Thread: thread of GLFW */
+typedef struct _Thread {
+   pthread_t thread;
+   GLFWthreadfun fun;
+   void *arg;
+   int done;
+   bool used;
+} Thread;
+
+static Thread threads[MMDAGENTSTUB_MAXTHREADS];
+static pthread_mutex_t threads_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* threadMain: run function of thread */
+static void *threadMain(void *param)
+{
+   Thread *t = (Thread *) param;
+
+   t->fun(t->arg);
+   __atomic_store_n(&t->done, 1, __ATOMIC_RELEASE);
+
+   return NULL;
+}
+
+/* glfwInit: initialize */
+int glfwInit()
+{
+   return GL_TRUE;
+}
+
+/* glfwTerminate: terminate */
+void glfwTerminate()
+{
+}
+
+/* glfwGetTime: get time in sec */
+double glfwGetTime()
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+/* glfwSleep: sleep */
+void glfwSleep(double time)
+{
+   usleep((useconds_t) (time * 1000000.0));
+}
+
+/* glfwCreateThread: create thread */
+GLFWthread glfwCreateThread(GLFWthreadfun fun, void *arg)
+{
+   int i;
+
+   pthread_mutex_lock(&threads_mutex);
+   for(i = 0; i < MMDAGENTSTUB_MAXTHREADS; i++)
+      if(threads[i].used == false)
+         break;
+   if(i == MMDAGENTSTUB_MAXTHREADS) {
+      pthread_mutex_unlock(&threads_mutex);
+      return -1;
+   }
+   threads[i].used = true;
+   threads[i].fun = fun;
+   threads[i].arg = arg;
+   threads[i].done = 0;
+   if(pthread_create(&threads[i].thread, NULL, threadMain, &threads[i]) != 0) {
+      threads[i].used = false;
+      i = -1;
+   }
+   pthread_mutex_unlock(&threads_mutex);
+
+   return i;
+}
+
+/* glfwDestroyThread: release thread */
+void glfwDestroyThread(GLFWthread id)
+{
+   if(id < 0 || id >= MMDAGENTSTUB_MAXTHREADS)
+      return;
+
+   pthread_mutex_lock(&threads_mutex);
+   if(threads[id].used == true && __atomic_load_n(&threads[id].done, __ATOMIC_ACQUIRE) != 2)
+      pthread_detach(threads[id].thread);
+   threads[id].used = false;
+   pthread_mutex_unlock(&threads_mutex);
+}
+
+/* glfwWaitThread: wait for thread, return GL_TRUE if it has finished */
+int glfwWaitThread(GLFWthread id, int waitmode)
+{
+   Thread *t;
+
+   if(id < 0 || id >= MMDAGENTSTUB_MAXTHREADS || threads[id].used == false)
+      return GL_TRUE;
+
+   t = &threads[id];
+   if(waitmode == GLFW_WAIT) {
+      pthread_join(t->thread, NULL);
+      /* joined thread must not be detached */
+      __atomic_store_n(&t->done, 2, __ATOMIC_RELEASE);
+      return GL_TRUE;
+   }
+
+   return (__atomic_load_n(&t->done, __ATOMIC_ACQUIRE) != 0) ? GL_TRUE : GL_FALSE;
+}
+
+/* glfwCreateMutex: create mutex */
+GLFWmutex glfwCreateMutex()
+{
+   pthread_mutex_t *mutex = (pthread_mutex_t *) malloc(sizeof(pthread_mutex_t));
+
+   pthread_mutex_init(mutex, NULL);
+   return mutex;
+}
+
+/* glfwDestroyMutex: destroy mutex */
+void glfwDestroyMutex(GLFWmutex mutex)
+{
+   pthread_mutex_destroy((pthread_mutex_t *) mutex);
+   free(mutex);
+}
+
+/* glfwLockMutex: lock mutex */
+void glfwLockMutex(GLFWmutex mutex)
+{
+   pthread_mutex_lock((pthread_mutex_t *) mutex);
+}
+
+/* glfwUnlockMutex: unlock mutex */
+void glfwUnlockMutex(GLFWmutex mutex)
+{
+   pthread_mutex_unlock((pthread_mutex_t *) mutex);
+}
+
+/* glfwCreateCond: create condition variable */
+GLFWcond glfwCreateCond()
+{
+   pthread_cond_t *cond = (pthread_cond_t *) malloc(sizeof(pthread_cond_t));
+
+   pthread_cond_init(cond, NULL);
+   return cond;
+}
+
+/* glfwDestroyCond: destroy condition variable */
+void glfwDestroyCond(GLFWcond cond)
+{
+   pthread_cond_destroy((pthread_cond_t *) cond);
+   free(cond);
+}
+
+/* glfwWaitCond: wait for condition variable */
+void glfwWaitCond(GLFWcond cond, GLFWmutex mutex, double timeout)
+{
+   long nsec;
+   struct timespec ts;
+
+   if(timeout >= GLFW_INFINITY) {
+      pthread_cond_wait((pthread_cond_t *) cond, (pthread_mutex_t *) mutex);
+      return;
+   }
+
+   clock_gettime(CLOCK_REALTIME, &ts);
+   nsec = ts.tv_nsec + (long) ((timeout - (long) timeout) * 1.0e9);
+   ts.tv_sec += (long) timeout + nsec / 1000000000;
+   ts.tv_nsec = nsec % 1000000000;
+   pthread_cond_timedwait((pthread_cond_t *) cond, (pthread_mutex_t *) mutex, &ts);
+}
+
+/* glfwSignalCond: signal condition variable */
+void glfwSignalCond(GLFWcond cond)
+{
+   pthread_cond_signal((pthread_cond_t *) cond);
+}
+
+/* glfwBroadcastCond: broadcast condition variable */
+void glfwBroadcastCond(GLFWcond cond)
+{
+   pthread_cond_broadcast((pthread_cond_t *) cond);
+}
+
+/* MMDAgent_strdup: strdup */
+char *MMDAgent_strdup(const char *str)
+{
+   return (str != NULL) ? strdup(str) : NULL;
+}
+
+/* MMDAgent_strlen: strlen */
+int MMDAgent_strlen(const char *str)
+{
+   return (str != NULL) ? (int) strlen(str) : 0;
+}
+
+/* MMDAgent_strequal: string matching */
+bool MMDAgent_strequal(const char *str1, const char *str2)
+{
+   if(str1 == NULL && str2 == NULL)
+      return true;
+   else if(str1 == NULL || str2 == NULL)
+      return false;
+
+   return (strcmp(str1, str2) == 0) ? true : false;
+}
+
+/* MMDAgent_str2int: convert string to integer */
+int MMDAgent_str2int(const char *str)
+{
+   return (str != NULL) ? atoi(str) : 0;
+}
+
+/* MMDAgent_str2float: convert string to float */
+float MMDAgent_str2float(const char *str)
+{
+   return (str != NULL) ? (float) atof(str) : 0.0f;
+}
+
+/* MMDAgent::MMDAgent: host constructor */
+MMDAgent::MMDAgent()
+{
+   m_handler = NULL;
+   m_data = NULL;
+}
+
+/* MMDAgent::setHandler: set receiver of messages */
+void MMDAgent::setHandler(MMDAgent_Handler handler, void *data)
+{
+   m_handler = handler;
+   m_data = data;
+}
+
+/* MMDAgent::sendMessage: pass message to handler */
+void MMDAgent::sendMessage(const char *type, const char *format, ...)
+{
+   char buff[MMDAGENT_MAXBUFLEN];
+   double time = glfwGetTime();
+   va_list argv;
+
+   if(m_handler == NULL)
+      return;
+
+   va_start(argv, format);
+   vsnprintf(buff, sizeof(buff), format, argv);
+   va_end(argv);
+
+   m_handler(type, buff, time, m_data);
+}
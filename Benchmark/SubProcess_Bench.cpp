@@ -0,0 +1,1024 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* SubProcess_Bench: throughput and latency benchmark of Plugin_SubProcess
+
+   usage: SubProcess_Bench [-q] [echo] [sink] [flood] [enqueue] [spawn] [fanout] [rate] [alloc] [lanes]
+     -q      : quick run with fewer messages
+     echo    : round trip through bench_echo, for I/O engines, transports, subprocesses up to 512 and sizes
+     sink    : messages to bench_sink per second
+     flood   : messages from bench_flood per second
+     enqueue : messages enqueued per second by concurrent producers, and latency of each enqueue into the ring
+               against the mutex-guarded queue of the original plugin, drained by a consumer thread,
+               with producers holding back at a backlog the lanes take without dropping
+     spawn   : SUBPROC_START until SUBPROC_EVENT_START with posix_spawn, fork and shell
+     fanout  : broadcast until last of many subprocesses answered, for 1 and 4 dispatcher threads, and latency of each answer
+               while a subprocess which never reads blocks its dispatcher thread on every message (stall)
+     rate    : lines from bench_flood paced at 100k lines/s, with latency from write to handler
+     alloc   : heap allocations per message written to bench_sink after pools are warmed up, any of them fails the run
+     lanes   : round trip of pings to bench_echo while a producer floods bench_sink, in one lane, strict or weighted lanes
+   Each result shows CPU time of this process during the run, without polling of results by the main thread.
+   Helper subprocesses are taken from directory of this program. */
+
+/* headers */
+
+#include "MMDAgent.h"
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "../SubProcess_Stats.h"
+#include "../SubProcess_Slab.h"
+#include "../SubProcess_Ring.h"
+#include "SubProcess_Queue.h"
+
+/* definitions */
+
+#define BENCH_TIMEOUT 5.0   /* sec without progress before giving up */
+#define BENCH_WINDOW  32    /* messages in flight per subprocess in echo */
+#define BENCH_WARMUP  30    /* rounds at most growing pools to peak backlog */
+#define BENCH_SETTLED 3     /* rounds in a row allocating nothing which end warm-up */
+#define BENCH_ALLOCLOG 256  /* messages alloc keeps queued, a batch of plugin */
+#define BENCH_BURST   2048  /* messages alloc writes at once first, beyond any later backlog, so that pools reach peak */
+#define BENCH_BACKLOG 4096  /* messages a flooding producer keeps queued, as the plugin does not hold producers back */
+#define BENCH_STALL   2     /* msec a dispatcher thread waits for stalled subprocess per message in fanout */
+#define BENCH_FILL    64    /* messages of 16KB filling socket and buffer of stalled subprocess */
+
+/* allocator of C library, wrapped to count allocations of this process */
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t num, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+/* plugin */
+extern "C" void extAppStart(MMDAgent *mmdagent);
+extern "C" void extProcMessage(MMDAgent *mmdagent, const char *type, const char *args);
+extern "C" void extAppEnd(MMDAgent *mmdagent);
+
+/* Bench: state shared with handler */
+typedef struct _Bench {
+   long started;     /* SUBPROC_EVENT_START */
+   long replies;     /* BENCH_PONG */
+   long done;        /* BENCH_DONE */
+   long delivered;   /* sum of counts in BENCH_DONE */
+   long flood;       /* BENCH_FLOOD */
+   long floodEnd;    /* BENCH_FLOODEND */
+   double *sendTime; /* time of BENCH_PING by sequence number */
+   long maxSeq;
+   double *samples;  /* latencies in sec */
+   long numSamples;
+   long maxSamples;
+   double cpuStart;  /* CPU time of process at start of run */
+   double cpuWait;   /* CPU time of main thread waiting for counters */
+} Bench;
+
+static MMDAgent mmdagent;
+static Bench bench;
+static char helperDir[PATH_MAX];
+static bool quick = false;
+static bool failed = false;      /* steady state allocated on heap, exit status is 1 */
+static unsigned long allocs = 0; /* calls of malloc, calloc and realloc */
+
+/* malloc: count and allocate */
+extern "C" void *malloc(size_t size)
+{
+   __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+   return __libc_malloc(size);
+}
+
+/* calloc: count and allocate */
+extern "C" void *calloc(size_t num, size_t size)
+{
+   __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+   return __libc_calloc(num, size);
+}
+
+/* realloc: count and reallocate */
+extern "C" void *realloc(void *ptr, size_t size)
+{
+   __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+   return __libc_realloc(ptr, size);
+}
+
+/* handler: count messages from plugin */
+static void handler(const char *type, const char *args, double time, void *data)
+{
+   long seq, i;
+
+   if(strcmp(type, "BENCH_PONG") == 0) {
+      seq = atol(args);
+      if(seq >= 0 && seq < bench.maxSeq) {
+         i = __atomic_fetch_add(&bench.numSamples, 1, __ATOMIC_RELAXED);
+         if(i < bench.maxSamples)
+            bench.samples[i] = time - bench.sendTime[seq];
+      }
+      __atomic_fetch_add(&bench.replies, 1, __ATOMIC_RELEASE);
+   } else if(strcmp(type, "BENCH_TICK") == 0) {
+      /* written with CLOCK_MONOTONIC as glfwGetTime of host */
+      i = __atomic_fetch_add(&bench.numSamples, 1, __ATOMIC_RELAXED);
+      if(i < bench.maxSamples)
+         bench.samples[i] = time - atof(args);
+      __atomic_fetch_add(&bench.flood, 1, __ATOMIC_RELEASE);
+   } else if(strcmp(type, "BENCH_FLOOD") == 0) {
+      __atomic_fetch_add(&bench.flood, 1, __ATOMIC_RELEASE);
+   } else if(strcmp(type, "BENCH_FLOODEND") == 0) {
+      __atomic_fetch_add(&bench.floodEnd, 1, __ATOMIC_RELEASE);
+   } else if(strcmp(type, "BENCH_DONE") == 0) {
+      __atomic_fetch_add(&bench.delivered, atol(args), __ATOMIC_RELAXED);
+      __atomic_fetch_add(&bench.done, 1, __ATOMIC_RELEASE);
+   } else if(strcmp(type, "SUBPROC_EVENT_START") == 0) {
+      __atomic_fetch_add(&bench.started, 1, __ATOMIC_RELEASE);
+   }
+}
+
+/* resetBench: reset counters and allocate samples */
+static void resetBench(long maxSeq, long maxSamples)
+{
+   free(bench.sendTime);
+   free(bench.samples);
+   memset(&bench, 0, sizeof(Bench));
+
+   bench.maxSeq = maxSeq;
+   bench.maxSamples = maxSamples;
+   if(maxSeq > 0)
+      bench.sendTime = (double *) calloc(maxSeq, sizeof(double));
+   if(maxSamples > 0)
+      bench.samples = (double *) calloc(maxSamples, sizeof(double));
+}
+
+/* cpuTime: CPU time in sec of process or thread */
+static double cpuTime(clockid_t clock)
+{
+   struct timespec ts;
+
+   clock_gettime(clock, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/* startClock: start CPU time of run and return start time */
+static double startClock()
+{
+   bench.cpuStart = cpuTime(CLOCK_PROCESS_CPUTIME_ID);
+   bench.cpuWait = 0.0;
+
+   return glfwGetTime();
+}
+
+/* waitFor: wait until counter reaches target, return false when it stops advancing */
+static bool waitFor(long *counter, long target)
+{
+   long last = -1, now;
+   double deadline = 0.0, cpu = cpuTime(CLOCK_THREAD_CPUTIME_ID);
+   bool ok = true;
+
+   while((now = __atomic_load_n(counter, __ATOMIC_ACQUIRE)) < target) {
+      if(now != last) {
+         last = now;
+         deadline = glfwGetTime() + BENCH_TIMEOUT;
+      } else if(glfwGetTime() > deadline) {
+         ok = false;
+         break;
+      }
+      sched_yield();
+   }
+
+   /* polling is not counted as CPU time of run */
+   bench.cpuWait += cpuTime(CLOCK_THREAD_CPUTIME_ID) - cpu;
+
+   return ok;
+}
+
+/* startPlugin: start plugin with I/O engine */
+static void startPlugin(const char *engine)
+{
+   setenv("SUBPROC_IOENGINE", engine, 1);
+   mmdagent.setHandler(handler, NULL);
+   extAppStart(&mmdagent);
+}
+
+/* stopPlugin: stop plugin and subprocesses */
+static void stopPlugin()
+{
+   extAppEnd(&mmdagent);
+}
+
+/* startProcs: start subprocesses "name0", "name1", ... and wait for them */
+static bool startProcs(const char *name, int num, const char *options, const char *helper)
+{
+   int i;
+   long started = __atomic_load_n(&bench.started, __ATOMIC_ACQUIRE);
+   char buff[PATH_MAX + MMDAGENT_MAXBUFLEN];
+
+   for(i = 0; i < num; i++) {
+      snprintf(buff, sizeof(buff), "%s%d%s%s|%s/%s", name, i, (options[0] != '\0') ? "," : "", options, helperDir, helper);
+      extProcMessage(&mmdagent, "SUBPROC_START", buff);
+   }
+
+   if(waitFor(&bench.started, started + num) == false)
+      return false;
+
+   /* let subprocesses reach their read loop */
+   usleep(50000);
+   return true;
+}
+
+/* compareDouble: compare for qsort */
+static int compareDouble(const void *a, const void *b)
+{
+   double x = *(const double *) a, y = *(const double *) b;
+
+   return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+/* percentile: percentile in usec of sorted samples */
+static double percentile(const double *samples, long num, double percent)
+{
+   long i;
+
+   if(num <= 0)
+      return 0.0;
+
+   i = (long) (num * percent / 100.0);
+   if(i >= num)
+      i = num - 1;
+
+   return samples[i] * 1000000.0;
+}
+
+/* printHeader: print header of results */
+static void printHeader()
+{
+   printf("%-8s %-6s %-9s %5s %6s %8s %12s %9s %9s %9s %8s %10s %9s\n", "scenario", "engine", "transport", "procs", "size", "count", "msgs/s", "p50us", "p99us", "p99.9us", "lost", "allocs/msg", "cpums");
+}
+
+/* printResult: print a result with latency percentiles of collected samples */
+static void printResult(const char *scenario, const char *engine, const char *transport, int procs, int size, long count, double rate, bool latency, long lost, bool timeout, double perMsg = -1.0)
+{
+   long num = (bench.numSamples < bench.maxSamples) ? bench.numSamples : bench.maxSamples;
+   double cpu = cpuTime(CLOCK_PROCESS_CPUTIME_ID) - bench.cpuStart - bench.cpuWait;
+
+   printf("%-8s %-6s %-9s %5d %6d %8ld %12.0f ", scenario, engine, transport, procs, size, count, rate);
+   if(latency == true && num > 0) {
+      qsort(bench.samples, num, sizeof(double), compareDouble);
+      printf("%9.1f %9.1f %9.1f ", percentile(bench.samples, num, 50.0), percentile(bench.samples, num, 99.0), percentile(bench.samples, num, 99.9));
+   } else {
+      printf("%9s %9s %9s ", "-", "-", "-");
+   }
+   if(timeout == true)
+      printf("%8s ", "timeout");
+   else
+      printf("%8ld ", lost);
+   if(perMsg >= 0.0)
+      printf("%10.3f ", perMsg);
+   else
+      printf("%10s ", "-");
+   printf("%9.1f\n", cpu * 1000.0);
+   fflush(stdout);
+}
+
+/* makePayload: make string of size bytes */
+static char *makePayload(int size)
+{
+   char *payload = (char *) malloc(size + 1);
+
+   memset(payload, 'x', size);
+   payload[size] = '\0';
+
+   return payload;
+}
+
+/* benchEcho: round trip of messages, a window of them in flight */
+static void benchEcho(const char *engine, const char *transport, int procs, int size, long count)
+{
+   long seq;
+   double start, elapsed;
+   bool ok;
+   char *payload = makePayload(size), *args = (char *) malloc(size + 32);
+   char options[MMDAGENT_MAXBUFLEN];
+
+   resetBench(count, count * procs);
+   startPlugin(engine);
+   snprintf(options, sizeof(options), "transport=%s,maxmsgs=100000,maxbytes=67108864", transport);
+   ok = startProcs("echo", procs, options, "bench_echo");
+
+   start = startClock();
+   for(seq = 0; ok == true && seq < count; seq++) {
+      /* keep window of messages in flight */
+      if(seq > BENCH_WINDOW && (ok = waitFor(&bench.replies, (seq - BENCH_WINDOW) * procs)) == false)
+         break;
+      sprintf(args, "%ld|%s", seq, payload);
+      bench.sendTime[seq] = glfwGetTime();
+      extProcMessage(&mmdagent, "BENCH_PING", args);
+   }
+   if(ok == true)
+      ok = waitFor(&bench.replies, count * procs);
+   elapsed = glfwGetTime() - start;
+
+   printResult("echo", engine, transport, procs, size, count, bench.replies / elapsed, true, count * procs - bench.replies, !ok);
+
+   stopPlugin();
+   free(payload);
+   free(args);
+}
+
+/* benchSink: messages written to subprocesses, which apply back pressure */
+static void benchSink(const char *engine, int procs, int size, long count)
+{
+   long i;
+   double start, elapsed;
+   bool ok;
+   char *payload = makePayload(size);
+
+   resetBench(0, 0);
+   startPlugin(engine);
+   ok = startProcs("sink", procs, "policy=block,deadline=1000", "bench_sink");
+
+   start = startClock();
+   for(i = 0; ok == true && i < count; i++)
+      extProcMessage(&mmdagent, "BENCH_DATA", payload);
+   extProcMessage(&mmdagent, "BENCH_END", "");
+   if(ok == true)
+      ok = waitFor(&bench.done, procs);
+   elapsed = glfwGetTime() - start;
+
+   printResult("sink", engine, "socket", procs, size, count, count / elapsed, false, count * procs - bench.delivered, !ok);
+
+   stopPlugin();
+   free(payload);
+}
+
+/* benchFlood: messages read from subprocesses writing as fast as possible */
+static void benchFlood(const char *engine, int procs, int size, long count)
+{
+   double start, elapsed;
+   bool ok;
+   char args[64];
+
+   resetBench(0, 0);
+   startPlugin(engine);
+   ok = startProcs("flood", procs, "", "bench_flood");
+
+   start = startClock();
+   sprintf(args, "%ld|%d", count, size);
+   extProcMessage(&mmdagent, "BENCH_GO", args);
+   if(ok == true)
+      ok = waitFor(&bench.floodEnd, procs);
+   elapsed = glfwGetTime() - start;
+
+   printResult("flood", engine, "socket", procs, size, count, bench.flood / elapsed, false, count * procs - bench.flood, !ok);
+
+   stopPlugin();
+}
+
+/* benchRate: lines read from a subprocess writing them one by one at a rate */
+static void benchRate(const char *engine, long rate, long count)
+{
+   double start, elapsed;
+   bool ok;
+   char args[64];
+
+   resetBench(0, count);
+   startPlugin(engine);
+   ok = startProcs("rate", 1, "", "bench_flood");
+
+   start = startClock();
+   sprintf(args, "%ld|%ld", count, rate);
+   extProcMessage(&mmdagent, "BENCH_RATE", args);
+   if(ok == true)
+      ok = waitFor(&bench.floodEnd, 1);
+   elapsed = glfwGetTime() - start;
+
+   printResult("rate", engine, "socket", 1, 16, count, bench.flood / elapsed, true, count - bench.flood, !ok);
+
+   stopPlugin();
+}
+
+/* Flood: producer flooding plugin */
+typedef struct _Flood {
+   bool stop;
+   const SubProcStats_Segment *seg; /* statistics of plugin to bound backlog, NULL means unbounded */
+} Flood;
+
+/* openStats: map statistics segment of plugin, NULL if not available */
+static const SubProcStats_Segment *openStats(const char *name)
+{
+   int fd;
+   void *p;
+
+   fd = shm_open(name, O_RDONLY, 0);
+   if(fd < 0)
+      return NULL;
+   p = mmap(NULL, sizeof(SubProcStats_Segment), PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+
+   return (p != MAP_FAILED) ? (const SubProcStats_Segment *) p : NULL;
+}
+
+/* backlogged: check if plugin keeps backlog of messages queued, as it drops messages beyond its lanes */
+static bool backlogged(const SubProcStats_Segment *seg, uint64_t backlog = BENCH_BACKLOG)
+{
+   return (seg != NULL && subprocstats_get(&seg->enqueued) - subprocstats_get(&seg->dequeued) >= backlog) ? true : false;
+}
+
+/* Producer: producer of enqueue throughput */
+typedef struct _Producer {
+   long count;
+   const SubProcStats_Segment *seg; /* statistics of plugin to bound backlog, NULL means unbounded */
+} Producer;
+
+/* producerMain: enqueue messages from a producer thread, keeping a backlog of BENCH_BACKLOG */
+static void *producerMain(void *param)
+{
+   long i;
+   Producer *producer = (Producer *) param;
+
+   for(i = 0; i < producer->count; i++) {
+      while(backlogged(producer->seg) == true)
+         sched_yield();
+      extProcMessage(&mmdagent, "BENCH_DATA", "0123456789abcdef");
+   }
+
+   return NULL;
+}
+
+/* benchEnqueue: messages enqueued by concurrent producers */
+static void benchEnqueue(int producers, long count)
+{
+   int i;
+   double start, elapsed;
+   bool ok;
+   char name[64];
+   pthread_t *threads = (pthread_t *) malloc(sizeof(pthread_t) * producers);
+   Producer producer;
+
+   /* statistics tell backlog of plugin to producers */
+   snprintf(name, sizeof(name), "/subproc-bench-%d", (int) getpid());
+   setenv("SUBPROC_STATS", name, 1);
+
+   resetBench(0, 0);
+   startPlugin("thread");
+   ok = startProcs("sink", 1, "policy=block,deadline=1000", "bench_sink");
+   producer.count = count;
+   producer.seg = openStats(name);
+
+   start = startClock();
+   for(i = 0; ok == true && i < producers; i++)
+      pthread_create(&threads[i], NULL, producerMain, &producer);
+   for(i = 0; ok == true && i < producers; i++)
+      pthread_join(threads[i], NULL);
+   elapsed = glfwGetTime() - start;
+   if(producer.seg != NULL)
+      munmap((void *) producer.seg, sizeof(SubProcStats_Segment));
+   extProcMessage(&mmdagent, "BENCH_END", "");
+   if(ok == true)
+      ok = waitFor(&bench.done, 1);
+
+   printResult("enqueue", "thread", "socket", producers, 16, count * producers, count * producers / elapsed, false, count * producers - bench.delivered, !ok);
+
+   stopPlugin();
+   setenv("SUBPROC_STATS", "off", 1);
+   free(threads);
+}
+
+/* Probe: producer of enqueue latency */
+typedef struct _Probe {
+   int index;
+   long count;
+   bool ring; /* lock-free ring of plugin, or mutex-guarded queue of original plugin */
+} Probe;
+
+static SubProcess_Slab probeSlab;
+static SubProcess_Ring probeRing;
+static SubProcess_Queue probeQueue;
+static GLFWmutex probeMutex;
+static GLFWcond probeCond;
+static bool probeStop;
+static long probeProduced;
+static long probeConsumed;
+
+/* probeMain: enqueue messages from a producer thread, timing each enqueue */
+static void *probeMain(void *param)
+{
+   long i;
+   double t;
+   Probe *probe = (Probe *) param;
+   double *samples = bench.samples + probe->index * probe->count;
+   SubProcess_Message *msg;
+
+   for(i = 0; i < probe->count; i++) {
+      /* backlog is bounded as by plugin, outside of timing */
+      while(__atomic_load_n(&probeProduced, __ATOMIC_RELAXED) - __atomic_load_n(&probeConsumed, __ATOMIC_RELAXED) >= BENCH_BACKLOG)
+         sched_yield();
+      t = glfwGetTime();
+      if(probe->ring == true) {
+         /* formatted once as by plugin */
+         msg = probeSlab.create("BENCH_DATA", "0123456789abcdef", t);
+         if(probeRing.enqueue(msg) == false)
+            SubProcess_Slab::release(msg);
+      } else {
+         /* copied under lock as by original plugin */
+         glfwLockMutex(probeMutex);
+         probeQueue.enqueue("BENCH_DATA", "0123456789abcdef");
+         glfwSignalCond(probeCond);
+         glfwUnlockMutex(probeMutex);
+      }
+      samples[i] = glfwGetTime() - t;
+      __atomic_add_fetch(&probeProduced, 1, __ATOMIC_RELAXED);
+   }
+
+   return NULL;
+}
+
+/* consumeMain: drain ring or queue until stopped */
+static void *consumeMain(void *param)
+{
+   bool ring = *(bool *) param;
+   char *type, *args;
+   SubProcess_Message *msg;
+
+   if(ring == true) {
+      while(true) {
+         while(probeRing.front(&msg) == true) {
+            probeRing.pop();
+            SubProcess_Slab::release(msg);
+            __atomic_add_fetch(&probeConsumed, 1, __ATOMIC_RELAXED);
+         }
+         if(__atomic_load_n(&probeStop, __ATOMIC_ACQUIRE) == true)
+            break;
+         probeRing.wait();
+      }
+   } else {
+      glfwLockMutex(probeMutex);
+      while(true) {
+         while(probeQueue.isEmpty() == false) {
+            probeQueue.dequeue(&type, &args);
+            glfwUnlockMutex(probeMutex);
+            free(type);
+            free(args);
+            __atomic_add_fetch(&probeConsumed, 1, __ATOMIC_RELAXED);
+            glfwLockMutex(probeMutex);
+         }
+         if(probeStop == true)
+            break;
+         glfwWaitCond(probeCond, probeMutex, GLFW_INFINITY);
+      }
+      glfwUnlockMutex(probeMutex);
+   }
+
+   return NULL;
+}
+
+/* benchProbe: latency of each enqueue by concurrent producers into ring or queue of original plugin */
+static void benchProbe(bool ring, int producers, long count)
+{
+   int i;
+   double start, elapsed;
+   pthread_t consumer, *threads = (pthread_t *) malloc(sizeof(pthread_t) * producers);
+   Probe *probes = (Probe *) malloc(sizeof(Probe) * producers);
+
+   resetBench(0, count * producers);
+   probeStop = false;
+   probeProduced = 0;
+   probeConsumed = 0;
+   if(ring == true) {
+      probeSlab.setup();
+      probeRing.setup(SUBPROCESSRING_SIZE);
+   } else {
+      probeMutex = glfwCreateMutex();
+      probeCond = glfwCreateCond();
+   }
+   pthread_create(&consumer, NULL, consumeMain, &ring);
+
+   start = startClock();
+   for(i = 0; i < producers; i++) {
+      probes[i].index = i;
+      probes[i].count = count;
+      probes[i].ring = ring;
+      pthread_create(&threads[i], NULL, probeMain, &probes[i]);
+   }
+   for(i = 0; i < producers; i++)
+      pthread_join(threads[i], NULL);
+   elapsed = glfwGetTime() - start;
+
+   /* consumer drains the rest */
+   if(ring == true) {
+      __atomic_store_n(&probeStop, true, __ATOMIC_RELEASE);
+      probeRing.close();
+   } else {
+      glfwLockMutex(probeMutex);
+      probeStop = true;
+      glfwSignalCond(probeCond);
+      glfwUnlockMutex(probeMutex);
+   }
+   pthread_join(consumer, NULL);
+   bench.numSamples = count * producers;
+
+   printResult("enqueue", (ring == true) ? "ring" : "queue", "-", producers, 16, count * producers, count * producers / elapsed, true, count * producers - probeConsumed, false);
+
+   if(ring == true) {
+      probeRing.clear();
+      probeSlab.clear();
+   } else {
+      glfwDestroyCond(probeCond);
+      glfwDestroyMutex(probeMutex);
+   }
+   free(probes);
+   free(threads);
+}
+
+/* benchSpawn: time from SUBPROC_START to SUBPROC_EVENT_START */
+static void benchSpawn(const char *mode, long count)
+{
+   long i;
+   double start, t;
+   bool ok = true;
+   char buff[PATH_MAX + MMDAGENT_MAXBUFLEN];
+
+   if(strcmp(mode, "fork") == 0)
+      setenv("SUBPROC_SPAWN", "fork", 1);
+   else
+      unsetenv("SUBPROC_SPAWN");
+
+   resetBench(0, count);
+   startPlugin("thread");
+
+   /* shell is needed for redirection */
+   snprintf(buff, sizeof(buff), "spawn|%s/bench_sink%s", helperDir, (strcmp(mode, "shell") == 0) ? " 2>/dev/null" : "");
+
+   start = startClock();
+   for(i = 0; ok == true && i < count; i++) {
+      t = glfwGetTime();
+      extProcMessage(&mmdagent, "SUBPROC_START", buff);
+      ok = waitFor(&bench.started, i + 1);
+      bench.samples[bench.numSamples++] = glfwGetTime() - t;
+      extProcMessage(&mmdagent, "SUBPROC_STOP", "spawn");
+   }
+
+   printResult("spawn", mode, "socket", 1, 0, count, count / (glfwGetTime() - start), true, 0, !ok);
+
+   stopPlugin();
+   unsetenv("SUBPROC_SPAWN");
+}
+
+/* benchFanout: latency of a broadcast to the last subprocess, one message at a time, or of each answer with a stalled subprocess */
+static void benchFanout(int dispatchers, int procs, long count, bool stall)
+{
+   int i;
+   long seq;
+   double start, t;
+   bool ok;
+   char args[64], transport[32], buff[MMDAGENT_MAXBUFLEN];
+   char *payload;
+
+   snprintf(args, sizeof(args), "%d", dispatchers);
+   setenv("SUBPROC_DISPATCHERS", args, 1);
+
+   /* handler takes a sample of each answer with sequence number, otherwise last answer is taken here */
+   resetBench(stall ? count : 0, stall ? count * procs : count);
+   startPlugin("epoll");
+   ok = true;
+   if(stall == true) {
+      /* started first, so that it shares a shard with as few others as possible */
+      snprintf(buff, sizeof(buff), "stall0,policy=block,deadline=%d,maxmsgs=1|sleep 3600", BENCH_STALL);
+      extProcMessage(&mmdagent, "SUBPROC_START", buff);
+      ok = waitFor(&bench.started, 1);
+   }
+   if(ok == true)
+      ok = startProcs("fanout", procs, "", "bench_echo");
+   if(ok == true && stall == true) {
+      /* others do not read filler, which makes every later message block on stalled one */
+      for(i = 0; i < procs; i++) {
+         snprintf(buff, sizeof(buff), "fanout%d|BENCH_PING", i);
+         extProcMessage(&mmdagent, "SUBPROC_SUBSCRIBE", buff);
+      }
+      payload = makePayload(16384);
+      for(i = 0; i < BENCH_FILL; i++)
+         extProcMessage(&mmdagent, "BENCH_FILLER", payload);
+      free(payload);
+      usleep(BENCH_FILL * BENCH_STALL * 1000);
+   }
+
+   start = startClock();
+   for(seq = 0; ok == true && seq < count; seq++) {
+      sprintf(args, "%ld|0123456789abcdef", seq);
+      t = glfwGetTime();
+      if(stall == true)
+         bench.sendTime[seq] = t;
+      extProcMessage(&mmdagent, "BENCH_PING", args);
+      ok = waitFor(&bench.replies, (seq + 1) * procs);
+      if(stall == false)
+         bench.samples[bench.numSamples++] = glfwGetTime() - t;
+   }
+
+   snprintf(transport, sizeof(transport), "%s=%d", stall ? "stall" : "disp", dispatchers);
+   printResult("fanout", "epoll", transport, procs, 16, count, bench.replies / (glfwGetTime() - start), true, count * procs - bench.replies, !ok);
+
+   stopPlugin();
+   unsetenv("SUBPROC_DISPATCHERS");
+}
+
+/* sinkRound: write messages to bench_sink subprocesses, keeping a batch of backlog in plugin unless seg is NULL, until all of them are counted */
+static bool sinkRound(const SubProcStats_Segment *seg, const char *payload, int procs, long count)
+{
+   long i;
+
+   bench.done = 0;
+   bench.delivered = 0;
+   for(i = 0; i < count; i++) {
+      while(backlogged(seg, BENCH_ALLOCLOG) == true)
+         sched_yield();
+      extProcMessage(&mmdagent, "BENCH_DATA", payload);
+   }
+   extProcMessage(&mmdagent, "BENCH_END", "");
+
+   return waitFor(&bench.done, procs);
+}
+
+/* benchAlloc: heap allocations of process while messages are written to subprocesses, after rounds warming up pools */
+static void benchAlloc(const char *engine, const char *variant, const char *options, int procs, int size, long count)
+{
+   int round, settled = 0;
+   unsigned long before, after;
+   double start, elapsed;
+   bool ok;
+   char *payload = makePayload(size), name[64];
+   const SubProcStats_Segment *seg;
+
+   /* backlog is bounded, so that pools reach their peak in warm-up */
+   snprintf(name, sizeof(name), "/subproc-bench-%d", (int) getpid());
+   setenv("SUBPROC_STATS", name, 1);
+
+   resetBench(0, 0);
+   startPlugin(engine);
+   ok = startProcs("alloc", procs, options, "bench_sink");
+   seg = openStats(name);
+
+   /* burst fills lanes beyond later backlog and buffers up to maxmsgs, then rounds in a row allocating nothing end warm-up */
+   if(ok == true)
+      ok = sinkRound(NULL, payload, procs, BENCH_BURST);
+   for(round = 0; ok == true && round < BENCH_WARMUP && settled < BENCH_SETTLED; round++) {
+      before = __atomic_load_n(&allocs, __ATOMIC_RELAXED);
+      ok = sinkRound(seg, payload, procs, count);
+      settled = (__atomic_load_n(&allocs, __ATOMIC_RELAXED) == before) ? settled + 1 : 0;
+   }
+
+   /* steady state */
+   before = __atomic_load_n(&allocs, __ATOMIC_RELAXED);
+   start = startClock();
+   if(ok == true)
+      ok = sinkRound(seg, payload, procs, count);
+   elapsed = glfwGetTime() - start;
+   after = __atomic_load_n(&allocs, __ATOMIC_RELAXED);
+   if(seg != NULL)
+      munmap((void *) seg, sizeof(SubProcStats_Segment));
+
+   printResult("alloc", engine, variant, procs, size, count, count / elapsed, false, count * procs - bench.delivered, !ok, (double) (after - before) / count);
+   if(after != before) {
+      fprintf(stderr, "alloc: %lu heap allocations after warm-up with %s %s %d bytes\n", after - before, engine, variant, size);
+      failed = true;
+   }
+
+   stopPlugin();
+   setenv("SUBPROC_STATS", "off", 1);
+   free(payload);
+}
+
+/* floodMain: enqueue messages until stopped, keeping a backlog of BENCH_BACKLOG */
+static void *floodMain(void *param)
+{
+   long n = 0;
+   Flood *flood = (Flood *) param;
+   char *payload = makePayload(1024);
+
+   while(__atomic_load_n(&flood->stop, __ATOMIC_ACQUIRE) == false) {
+      if(backlogged(flood->seg) == true) {
+         sched_yield();
+         continue;
+      }
+      extProcMessage(&mmdagent, "BENCH_DATA", payload);
+      n++;
+   }
+   free(payload);
+
+   return (void *) n;
+}
+
+/* benchLanes: latency of pings to a subprocess behind a backlog of messages to slow subprocesses */
+static void benchLanes(const char *mode, const char *lanes, const char *weights, long count)
+{
+   long seq;
+   double start, t;
+   bool ok;
+   char args[64], name[64];
+   void *flooded = NULL;
+   pthread_t thread;
+   Flood flood;
+
+   setenv("SUBPROC_LANES", lanes, 1);
+   if(weights != NULL)
+      setenv("SUBPROC_LANEWEIGHTS", weights, 1);
+   else
+      unsetenv("SUBPROC_LANEWEIGHTS");
+
+   /* statistics tell backlog of plugin to flooding producer */
+   snprintf(name, sizeof(name), "/subproc-bench-%d", (int) getpid());
+   setenv("SUBPROC_STATS", name, 1);
+
+   resetBench(count, count);
+   startPlugin("epoll");
+   ok = startProcs("sink", 4, "policy=block,deadline=1000", "bench_sink");
+   if(ok == true)
+      ok = startProcs("ping", 1, "", "bench_echo");
+   extProcMessage(&mmdagent, "SUBPROC_SUBSCRIBE", "ping0|BENCH_PING");
+
+   flood.stop = false;
+   flood.seg = openStats(name);
+   if(ok == true)
+      pthread_create(&thread, NULL, floodMain, &flood);
+   start = startClock();
+   for(seq = 0; ok == true && seq < count; seq++) {
+      glfwSleep(0.001);
+      sprintf(args, "%ld", seq);
+      t = glfwGetTime();
+      bench.sendTime[seq] = t;
+      extProcMessage(&mmdagent, "BENCH_PING", args);
+      ok = waitFor(&bench.replies, seq + 1);
+   }
+   if(seq > 0) {
+      __atomic_store_n(&flood.stop, true, __ATOMIC_RELEASE);
+      pthread_join(thread, &flooded);
+   }
+   if(flood.seg != NULL)
+      munmap((void *) flood.seg, sizeof(SubProcStats_Segment));
+   t = glfwGetTime() - start;
+   extProcMessage(&mmdagent, "BENCH_END", "");
+   if(ok == true)
+      ok = waitFor(&bench.done, 4);
+
+   printResult("lanes", "epoll", mode, 5, 1024, count, (long) flooded / t, true, count - bench.replies, !ok);
+
+   stopPlugin();
+   unsetenv("SUBPROC_LANES");
+   unsetenv("SUBPROC_LANEWEIGHTS");
+   setenv("SUBPROC_STATS", "off", 1);
+}
+
+/* selected: check if scenario is selected */
+static bool selected(int argc, char **argv, const char *scenario)
+{
+   int i;
+   bool any = false;
+
+   for(i = 1; i < argc; i++) {
+      if(argv[i][0] == '-')
+         continue;
+      any = true;
+      if(strcmp(argv[i], scenario) == 0)
+         return true;
+   }
+
+   return !any;
+}
+
+/* main: main function */
+int main(int argc, char **argv)
+{
+   int i, e, p, s;
+   long scale;
+   char *p1;
+   struct rlimit limit;
+   const char *engines[] = { "thread", "epoll" };
+   const int echoProcs[] = { 1, 4, 16, 64, 128, 512 };
+   const int sizes[] = { 16, 256, 1024 }; /* lines longer than MMDAGENT_MAXBUFLEN are split by host */
+   const int producers[] = { 1, 2, 4, 8 };
+   const char *spawnModes[] = { "spawn", "fork", "shell" };
+   const int fanoutProcs[] = { 8, 64, 256 };
+   const int dispatchers[] = { 1, 4 };
+   const char *allocVariants[][2] = { { "direct", "policy=block,deadline=1000,maxmsgs=64" },
+                                      { "flush", "policy=block,deadline=1000,maxmsgs=64,flush=2" } };
+   const int allocSizes[] = { 16, 1024, 16384 };
+
+   for(i = 1; i < argc; i++)
+      if(strcmp(argv[i], "-q") == 0)
+         quick = true;
+
+   /* a subprocess takes a few descriptors, so that 512 of them need more than the usual 1024 */
+   if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+      limit.rlim_cur = limit.rlim_max;
+      setrlimit(RLIMIT_NOFILE, &limit);
+   }
+   scale = (quick == true) ? 1 : 10;
+
+   /* helpers are next to this program */
+   if(realpath(argv[0], helperDir) == NULL)
+      strcpy(helperDir, ".");
+   p1 = strrchr(helperDir, '/');
+   if(p1 != NULL)
+      *p1 = '\0';
+
+   /* statistics segment is not needed */
+   setenv("SUBPROC_STATS", "off", 1);
+
+   printHeader();
+
+   if(selected(argc, argv, "echo") == true) {
+      for(e = 0; e < 2; e++)
+         for(p = 0; p < 6; p++)
+            for(s = 0; s < 3; s++)
+               if(quick == false || echoProcs[p] <= 16)
+                  benchEcho(engines[e], "socket", echoProcs[p], sizes[s], 2000 * scale);
+      for(e = 0; e < 2; e++)
+         for(p = 0; p < 2; p++)
+            for(s = 0; s < 3; s++)
+               benchEcho(engines[e], "shm", echoProcs[p], sizes[s], 2000 * scale);
+   }
+
+   if(selected(argc, argv, "sink") == true)
+      for(e = 0; e < 2; e++)
+         for(p = 0; p < 3; p++)
+            for(s = 0; s < 3; s += 2)
+               benchSink(engines[e], echoProcs[p], sizes[s], 20000 * scale);
+
+   if(selected(argc, argv, "flood") == true)
+      for(e = 0; e < 2; e++)
+         for(p = 0; p < 4; p++)
+            for(s = 0; s < 3; s += 2)
+               if(quick == false || echoProcs[p] <= 16)
+                  benchFlood(engines[e], echoProcs[p], sizes[s], 10000 * scale);
+
+   if(selected(argc, argv, "enqueue") == true) {
+      for(p = 0; p < 4; p++)
+         benchEnqueue(producers[p], 20000 * scale);
+      for(p = 0; p < 4; p++) {
+         benchProbe(true, producers[p], 100000 * scale);
+         benchProbe(false, producers[p], 100000 * scale);
+      }
+   }
+
+   if(selected(argc, argv, "spawn") == true)
+      for(i = 0; i < 3; i++)
+         benchSpawn(spawnModes[i], 20 * scale);
+
+   if(selected(argc, argv, "rate") == true)
+      for(e = 0; e < 2; e++)
+         benchRate(engines[e], 100000, 100000 * scale);
+
+   if(selected(argc, argv, "fanout") == true) {
+      for(p = 0; p < 3; p++)
+         for(i = 0; i < 2; i++)
+            benchFanout(dispatchers[i], fanoutProcs[p], 200 * scale, false);
+      for(p = 0; p < 2; p++)
+         for(i = 0; i < 2; i++)
+            benchFanout(dispatchers[i], fanoutProcs[p], 200 * scale, true);
+   }
+
+   if(selected(argc, argv, "lanes") == true) {
+      benchLanes("one", "", NULL, 200 * scale);
+      benchLanes("strict", "BENCH_PING", NULL, 200 * scale);
+      benchLanes("weighted", "BENCH_PING", "4,1,1", 200 * scale);
+   }
+
+   if(selected(argc, argv, "alloc") == true)
+      for(e = 0; e < 2; e++)
+         for(i = 0; i < 2; i++)
+            for(s = 0; s < 3; s++)
+               benchAlloc(engines[e], allocVariants[i][0], allocVariants[i][1], 4, allocSizes[s], 5000 * scale);
+
+   resetBench(0, 0);
+   return (failed == true) ? 1 : 0;
+}
@@ -33,7 +33,7 @@
 /* POSSIBILITY OF SUCH DAMAGE.                                       */
 /* ----------------------------------------------------------------- */
 
-/* SubProcess_Queue: message queue of events/commands */
+/* SubProcess_Queue: message queue of events/commands of original plugin, guarded by caller, kept as baseline of enqueue benchmark */
 class SubProcess_Queue
 {
 private:
@@ -0,0 +1,376 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* SubProcess_Replay: replay of traffic recorded by Plugin_SubProcess
+
+   usage: SubProcess_Replay [-f] [-e engine] [-s command] [-w sec] RECORD
+     -f         : feed messages as fast as possible instead of at recorded times
+     -e engine  : I/O engine, thread (default) or epoll
+     -s command : start command instead of recorded one for every SUBPROC_START, such as a stub
+     -w sec     : wait for subprocesses after last message until nothing is read for this period (default 1)
+     RECORD     : file written by plugin with SUBPROC_RECORD
+   Messages enqueued by main program are fed to plugin in order, including SUBPROC_START.
+   Those which echo messages forwarded from subprocesses are recorded with their alias
+   and not fed: messages forwarded in replay are fed back as main program does. With -s,
+   output of the stub is not fed back, and echoes are fed at their recorded times in
+   place of the messages read from subprocesses. Latencies are taken from statistics
+   of plugin. */
+
+/* headers */
+
+#include "MMDAgent.h"
+#include <unistd.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../SubProcess_Stats.h"
+#include "../SubProcess_Recorder.h"
+#include "SubProcess_Queue.h"
+
+/* definitions */
+
+#define REPLAY_SPIN 0.002 /* sec before recorded time when sleep turns into yield */
+#define REPLAY_ECHO 0.001 /* maximum sec of sleep before forwarded messages are fed back */
+
+/* plugin */
+extern "C" void extAppStart(MMDAgent *mmdagent);
+extern "C" void extProcMessage(MMDAgent *mmdagent, const char *type, const char *args);
+extern "C" void extAppEnd(MMDAgent *mmdagent);
+
+static MMDAgent mmdagent;
+static long received = 0; /* messages forwarded from subprocesses */
+static bool echoing = true; /* feed forwarded messages back as main program */
+static SubProcess_Queue echoes; /* forwarded messages to be fed back */
+static GLFWmutex echoMutex;
+
+/* handler: count messages from subprocesses, not events of plugin, and queue them to be fed back */
+static void handler(const char *type, const char *args, double time, void *data)
+{
+   if(strncmp(type, "SUBPROC_EVENT_", 14) == 0 || strncmp(type, "PLUGIN_EVENT_", 13) == 0)
+      return;
+
+   __atomic_fetch_add(&received, 1, __ATOMIC_RELAXED);
+   if(echoing == true) {
+      glfwLockMutex(echoMutex);
+      echoes.enqueue(type, args);
+      glfwUnlockMutex(echoMutex);
+   }
+}
+
+/* feedEchoes: feed forwarded messages back to plugin from main thread, return number of them */
+static long feedEchoes()
+{
+   long n = 0;
+   char *type, *args;
+
+   glfwLockMutex(echoMutex);
+   while(echoes.isEmpty() == false) {
+      echoes.dequeue(&type, &args);
+      glfwUnlockMutex(echoMutex);
+      extProcMessage(&mmdagent, type, args);
+      free(type);
+      free(args);
+      n++;
+      glfwLockMutex(echoMutex);
+   }
+   glfwUnlockMutex(echoMutex);
+
+   return n;
+}
+
+/* sleepEchoing: sleep for sec, feeding forwarded messages back meanwhile, return number of them */
+static long sleepEchoing(double sec)
+{
+   long n = 0;
+   double end = glfwGetTime() + sec, now;
+
+   n += feedEchoes();
+   while((now = glfwGetTime()) < end) {
+      usleep((useconds_t) (((end - now < REPLAY_ECHO) ? end - now : REPLAY_ECHO) * 1000000.0));
+      n += feedEchoes();
+   }
+
+   return n;
+}
+
+/* compareDouble: compare for qsort */
+static int compareDouble(const void *a, const void *b)
+{
+   double x = *(const double *) a, y = *(const double *) b;
+
+   return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+/* percentile: percentile in usec of sorted samples */
+static double percentile(const double *samples, long num, double percent)
+{
+   long i;
+
+   if(num <= 0)
+      return 0.0;
+
+   i = (long) (num * percent / 100.0);
+   if(i >= num)
+      i = num - 1;
+
+   return samples[i] * 1000000.0;
+}
+
+/* openRecord: map recording of size bytes read-only with length of records, NULL on error */
+static const SubProcRecord_Header *openRecord(const char *path, size_t *size, uint64_t *length)
+{
+   int fd;
+   struct stat st;
+   void *p;
+   const SubProcRecord_Header *header;
+
+   fd = open(path, O_RDONLY | O_CLOEXEC);
+   if(fd < 0 || fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(SubProcRecord_Header)) {
+      if(fd >= 0)
+         close(fd);
+      return NULL;
+   }
+   p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if(p == MAP_FAILED)
+      return NULL;
+
+   header = (const SubProcRecord_Header *) p;
+   *size = st.st_size;
+   if(header->magic != SUBPROCRECORD_MAGIC || header->version != SUBPROCRECORD_VERSION) {
+      munmap(p, st.st_size);
+      return NULL;
+   }
+
+   /* file of process which did not stop is read up to first incomplete record */
+   *length = (header->used > 0 && header->used <= (uint64_t) st.st_size) ? header->used : (uint64_t) st.st_size;
+   return header;
+}
+
+/* openStats: map statistics of plugin read-only, NULL if not available */
+static const SubProcStats_Segment *openStats(const char *name)
+{
+   int fd;
+   void *p;
+
+   fd = shm_open(name, O_RDONLY, 0);
+   if(fd < 0)
+      return NULL;
+   p = mmap(NULL, sizeof(SubProcStats_Segment), PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+
+   return (p == MAP_FAILED) ? NULL : (const SubProcStats_Segment *) p;
+}
+
+/* addHistogram: add counts of histogram to another */
+static void addHistogram(SubProcStats_Histogram *sum, const SubProcStats_Histogram *hist)
+{
+   int i;
+
+   for(i = 0; i < SUBPROCSTATS_BUCKETS; i++)
+      sum->count[i] += __atomic_load_n(&hist->count[i], __ATOMIC_RELAXED);
+   sum->sum += __atomic_load_n(&hist->sum, __ATOMIC_RELAXED);
+}
+
+/* printHistogram: print count and percentiles of histogram, upper bounds of buckets */
+static void printHistogram(const char *name, const SubProcStats_Histogram *hist)
+{
+   int i;
+   uint64_t count = 0;
+
+   for(i = 0; i < SUBPROCSTATS_BUCKETS; i++)
+      count += hist->count[i];
+   if(count == 0)
+      return;
+
+   printf("%-10s %10llu %9.1f %9llu %9llu %9llu\n", name, (unsigned long long) count, (double) hist->sum / count,
+          (unsigned long long) subprocstats_percentile(hist, 50.0), (unsigned long long) subprocstats_percentile(hist, 99.0), (unsigned long long) subprocstats_percentile(hist, 99.9));
+}
+
+/* feed: pass a recorded message to plugin, replacing command of SUBPROC_START if given */
+static void feed(const SubProcRecord_Entry *entry, const char *command)
+{
+   const char *type = subprocrecord_type(entry), *args = subprocrecord_args(entry), *p;
+   char *buff;
+
+   if(command == NULL || strcmp(type, "SUBPROC_START") != 0 || (p = strchr(args, '|')) == NULL) {
+      extProcMessage(&mmdagent, type, args);
+      return;
+   }
+
+   /* alias and options are kept */
+   buff = (char *) malloc((p - args) + 1 + strlen(command) + 1);
+   memcpy(buff, args, p - args + 1);
+   strcpy(buff + (p - args) + 1, command);
+   extProcMessage(&mmdagent, type, buff);
+   free(buff);
+}
+
+/* main: main function */
+int main(int argc, char **argv)
+{
+   int i;
+   bool fast = false, usage = false;
+   const char *engine = "thread", *command = NULL, *path = NULL;
+   double wait = 1.0, start, target, now, elapsed, last, base = -1.0;
+   long numEnqueued = 0, numEchoes = 0, numRead = 0, fed = 0, fedBack = 0, numLags = 0, n;
+   size_t size;
+   uint64_t length;
+   double *lags;
+   char name[64], lane[32];
+   const SubProcRecord_Header *header;
+   const SubProcRecord_Entry *entry;
+   const SubProcStats_Segment *seg;
+   SubProcStats_Histogram dispatch, forward;
+
+   for(i = 1; i < argc; i++) {
+      if(strcmp(argv[i], "-f") == 0)
+         fast = true;
+      else if(strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+         engine = argv[++i];
+      else if(strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+         command = argv[++i];
+      else if(strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+         wait = atof(argv[++i]);
+      else if(argv[i][0] != '-' && path == NULL)
+         path = argv[i];
+      else
+         usage = true;
+   }
+   if(path == NULL || usage == true) {
+      fprintf(stderr, "usage: %s [-f] [-e engine] [-s command] [-w sec] RECORD\n", argv[0]);
+      return 1;
+   }
+
+   header = openRecord(path, &size, &length);
+   if(header == NULL) {
+      fprintf(stderr, "%s: cannot read recording %s\n", argv[0], path);
+      return 1;
+   }
+   for(entry = subprocrecord_next(header, length, NULL); entry != NULL; entry = subprocrecord_next(header, length, entry)) {
+      if(entry->kind == SUBPROCRECORD_ENQUEUE && entry->aliaslen > 0)
+         numEchoes++;
+      else if(entry->kind == SUBPROCRECORD_ENQUEUE)
+         numEnqueued++;
+      else if(entry->kind == SUBPROCRECORD_READ)
+         numRead++;
+   }
+   printf("recording: %ld enqueued, %ld echoed, %ld read, %llu dropped\n", numEnqueued, numEchoes, numRead, (unsigned long long) header->dropped);
+   lags = (double *) malloc(sizeof(double) * (numEnqueued + numEchoes + 1));
+
+   /* replay is not recorded again, its statistics are read below */
+   unsetenv(SUBPROCRECORD_ENV);
+   snprintf(name, sizeof(name), "/subproc-replay-%d", (int) getpid());
+   setenv(SUBPROCSTATS_ENV, name, 1);
+   setenv("SUBPROC_IOENGINE", engine, 1);
+   echoing = (command == NULL);
+   echoMutex = glfwCreateMutex();
+   mmdagent.setHandler(handler, NULL);
+   extAppStart(&mmdagent);
+
+   /* messages of main program in recorded order, at recorded intervals unless fast */
+   start = glfwGetTime();
+   for(entry = subprocrecord_next(header, length, NULL); entry != NULL; entry = subprocrecord_next(header, length, entry)) {
+      if(entry->kind != SUBPROCRECORD_ENQUEUE)
+         continue;
+      /* echoes come from subprocesses in replay, except for stub */
+      if(entry->aliaslen > 0 && echoing == true)
+         continue;
+      if(fast == false) {
+         if(base < 0.0)
+            base = entry->usec / 1000000.0;
+         target = start + entry->usec / 1000000.0 - base;
+         while((now = glfwGetTime()) < target) {
+            if(target - now > REPLAY_SPIN)
+               fedBack += sleepEchoing(target - now - REPLAY_SPIN);
+            else
+               sched_yield();
+         }
+         lags[numLags++] = now - target;
+      } else {
+         fedBack += feedEchoes();
+      }
+      feed(entry, command);
+      fed++;
+   }
+   elapsed = glfwGetTime() - start;
+
+   /* until subprocesses stop answering */
+   n = -1;
+   last = glfwGetTime();
+   while(glfwGetTime() - last < wait) {
+      if(__atomic_load_n(&received, __ATOMIC_RELAXED) != n) {
+         n = __atomic_load_n(&received, __ATOMIC_RELAXED);
+         last = glfwGetTime();
+      }
+      fedBack += sleepEchoing(0.01);
+   }
+
+   printf("replay:    %ld enqueued in %.3f sec (%.0f msgs/s, %s, %s), %ld read, %ld fed back\n", fed, elapsed, (elapsed > 0.0) ? fed / elapsed : 0.0, fast ? "fast" : "recorded times", engine, n, fedBack);
+   if(numLags > 0) {
+      qsort(lags, numLags, sizeof(double), compareDouble);
+      printf("lag behind recorded times: p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n", percentile(lags, numLags, 50.0), percentile(lags, numLags, 99.0), percentile(lags, numLags, 99.9), lags[numLags - 1] * 1000000.0);
+   }
+
+   /* histograms of subprocesses are kept in their slots after they stopped */
+   seg = openStats(name);
+   if(seg != NULL) {
+      printf("%-10s %10s %9s %9s %9s %9s\n", "latency", "count", "meanus", "p50us", "p99us", "p99.9us");
+      for(i = 0; i < SUBPROCSTATS_LANES; i++) {
+         snprintf(lane, sizeof(lane), "lane%d", i);
+         printHistogram(lane, &seg->laneWait[i]);
+      }
+      memset(&dispatch, 0, sizeof(SubProcStats_Histogram));
+      memset(&forward, 0, sizeof(SubProcStats_Histogram));
+      for(i = 0; i < SUBPROCSTATS_MAXPROCS; i++) {
+         addHistogram(&dispatch, &seg->procs[i].dispatch);
+         addHistogram(&forward, &seg->procs[i].forward);
+      }
+      printHistogram("dispatch", &dispatch);
+      printHistogram("forward", &forward);
+      munmap((void *) seg, sizeof(SubProcStats_Segment));
+   }
+
+   extAppEnd(&mmdagent);
+   echoing = false;
+   echoes.clear();
+   glfwDestroyMutex(echoMutex);
+
+   free(lags);
+   munmap((void *) header, size);
+   return 0;
+}
@@ -0,0 +1,127 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* bench_echo: subprocess answering "BENCH_PING|args" with "BENCH_PONG|args"
+
+   Lines are read from stdin, or frames from shared-memory rings when started
+   with transport=shm. Replies to the messages read at once are written at once. */
+
+/* headers */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../SubProcess_Shm.h"
+
+/* definitions */
+
+#define BENCHECHO_BUFLEN 1048576
+#define BENCHECHO_PING   "BENCH_PING"
+#define BENCHECHO_PONG   "BENCH_PONG"
+
+/* echoLines: answer lines of stdin */
+static int echoLines()
+{
+   static char in[BENCHECHO_BUFLEN], out[BENCHECHO_BUFLEN * 2];
+   int len = 0, outlen, n;
+   char *p, *q;
+   ssize_t r;
+
+   while((r = read(0, in + len, sizeof(in) - len)) > 0) {
+      len += (int) r;
+      outlen = 0;
+
+      for(p = in; (q = (char *) memchr(p, '\n', in + len - p)) != NULL; p = q + 1) {
+         n = (int) (q - p);
+         if(n > (int) strlen(BENCHECHO_PING) && strncmp(p, BENCHECHO_PING "|", strlen(BENCHECHO_PING) + 1) == 0) {
+            memcpy(out + outlen, BENCHECHO_PONG, strlen(BENCHECHO_PONG));
+            outlen += strlen(BENCHECHO_PONG);
+            memcpy(out + outlen, p + strlen(BENCHECHO_PING), n - strlen(BENCHECHO_PING) + 1);
+            outlen += n - strlen(BENCHECHO_PING) + 1;
+         }
+      }
+
+      /* keep partial line, drop a line longer than buffer */
+      len -= (int) (p - in);
+      memmove(in, p, len);
+      if(len == (int) sizeof(in))
+         len = 0;
+
+      for(p = out; outlen > 0; p += r, outlen -= (int) r)
+         if((r = write(1, p, outlen)) <= 0)
+            return 1;
+   }
+
+   return 0;
+}
+
+/* echoShm: answer frames of shared-memory ring */
+static int echoShm(SubProcShm *shm)
+{
+   static char buf[BENCHECHO_BUFLEN];
+   uint32_t len, typelen;
+   int ret;
+
+   while(subprocshm_wait(shm->in, shm->infd, -1) >= 0) {
+      while((ret = subprocshm_read(shm->in, buf, sizeof(buf), &len)) > 0) {
+         memcpy(&typelen, buf + 4, 4);
+         typelen = ntohl(typelen);
+         if(typelen != strlen(BENCHECHO_PING) || memcmp(buf + SUBPROCSHM_HEADER, BENCHECHO_PING, typelen) != 0)
+            continue;
+         while(subprocshm_write(shm->out, BENCHECHO_PONG, strlen(BENCHECHO_PONG), buf + SUBPROCSHM_HEADER + typelen, len - SUBPROCSHM_HEADER - typelen) == 0) {
+            subprocshm_notify(shm->out, shm->outfd);
+            usleep(10);
+         }
+      }
+      if(ret < 0)
+         return 1;
+      subprocshm_notify(shm->out, shm->outfd);
+   }
+
+   return 0;
+}
+
+/* main: main function */
+int main()
+{
+   SubProcShm shm;
+
+   if(subprocshm_attach(&shm) == 0)
+      return echoShm(&shm);
+
+   return echoLines();
+}
@@ -0,0 +1,164 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* bench_flood: subprocess writing messages as fast as possible
+
+   "BENCH_GO|count|size" makes it write count lines of "BENCH_FLOOD|seq|payload"
+   with payload of size bytes, followed by "BENCH_FLOODEND|count".
+   "BENCH_RATE|count|rate" makes it write count lines of "BENCH_TICK|time" one by one
+   at rate lines per second, time being CLOCK_MONOTONIC in sec when written,
+   followed by "BENCH_FLOODEND|count". */
+
+/* headers */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+/* definitions */
+
+#define BENCHFLOOD_BUFLEN  1048576
+#define BENCHFLOOD_GO      "BENCH_GO|"
+#define BENCHFLOOD_RATE    "BENCH_RATE|"
+#define BENCHFLOOD_TICK    "BENCH_TICK"
+#define BENCHFLOOD_FLOOD   "BENCH_FLOOD"
+#define BENCHFLOOD_END     "BENCH_FLOODEND"
+#define BENCHFLOOD_MAXSIZE 65536
+
+/* writeAll: write whole buffer */
+static int writeAll(const char *p, int len)
+{
+   ssize_t r;
+
+   for(; len > 0; p += r, len -= (int) r)
+      if((r = write(1, p, len)) <= 0)
+         return -1;
+
+   return 0;
+}
+
+/* flood: write lines */
+static int flood(long count, int size)
+{
+   static char out[BENCHFLOOD_BUFLEN];
+   static char payload[BENCHFLOOD_MAXSIZE + 1];
+   long i;
+   int len = 0;
+
+   if(size > BENCHFLOOD_MAXSIZE)
+      size = BENCHFLOOD_MAXSIZE;
+   memset(payload, 'x', size);
+   payload[size] = '\0';
+
+   for(i = 0; i < count; i++) {
+      if(len + size + 64 > (int) sizeof(out)) {
+         if(writeAll(out, len) < 0)
+            return -1;
+         len = 0;
+      }
+      len += sprintf(out + len, "%s|%ld|%s\n", BENCHFLOOD_FLOOD, i, payload);
+   }
+   len += sprintf(out + len, "%s|%ld\n", BENCHFLOOD_END, count);
+
+   return writeAll(out, len);
+}
+
+/* now: monotonic time in sec */
+static double now()
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+/* pace: write lines one by one at given rate */
+static int pace(long count, long rate)
+{
+   char out[128];
+   long i;
+   int len;
+   double start = now(), t;
+
+   if(rate <= 0)
+      rate = 1;
+
+   for(i = 0; i < count; i++) {
+      /* wait for schedule, write at once when behind it */
+      while((t = now()) < start + (double) i / rate);
+      len = sprintf(out, "%s|%.9f\n", BENCHFLOOD_TICK, t);
+      if(writeAll(out, len) < 0)
+         return -1;
+   }
+   len = sprintf(out, "%s|%ld\n", BENCHFLOOD_END, count);
+
+   return writeAll(out, len);
+}
+
+/* main: main function */
+int main()
+{
+   static char in[BENCHFLOOD_BUFLEN];
+   int len = 0;
+   char *p, *q;
+   ssize_t r;
+
+   while((r = read(0, in + len, sizeof(in) - len - 1)) > 0) {
+      len += (int) r;
+
+      for(p = in; (q = (char *) memchr(p, '\n', in + len - p)) != NULL; p = q + 1) {
+         *q = '\0';
+         if(strncmp(p, BENCHFLOOD_GO, strlen(BENCHFLOOD_GO)) == 0) {
+            p += strlen(BENCHFLOOD_GO);
+            if(flood(atol(p), (strchr(p, '|') != NULL) ? atoi(strchr(p, '|') + 1) : 0) < 0)
+               return 1;
+         } else if(strncmp(p, BENCHFLOOD_RATE, strlen(BENCHFLOOD_RATE)) == 0) {
+            p += strlen(BENCHFLOOD_RATE);
+            if(pace(atol(p), (strchr(p, '|') != NULL) ? atol(strchr(p, '|') + 1) : 0) < 0)
+               return 1;
+         }
+      }
+
+      /* keep partial line, drop a line longer than buffer */
+      len -= (int) (p - in);
+      memmove(in, p, len);
+      if(len == (int) sizeof(in) - 1)
+         len = 0;
+   }
+
+   return 0;
+}
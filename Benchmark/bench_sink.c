@@ -0,0 +1,85 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* bench_sink: subprocess counting "BENCH_DATA" lines
+
+   "BENCH_END" is answered with "BENCH_DONE|count" and the count is reset. */
+
+/* headers */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* definitions */
+
+#define BENCHSINK_BUFLEN 1048576
+#define BENCHSINK_DATA   "BENCH_DATA"
+#define BENCHSINK_END    "BENCH_END"
+#define BENCHSINK_DONE   "BENCH_DONE"
+
+/* main: main function */
+int main()
+{
+   static char in[BENCHSINK_BUFLEN];
+   int len = 0;
+   unsigned long count = 0;
+   char *p, *q, out[64];
+   ssize_t r;
+
+   while((r = read(0, in + len, sizeof(in) - len)) > 0) {
+      len += (int) r;
+
+      for(p = in; (q = (char *) memchr(p, '\n', in + len - p)) != NULL; p = q + 1) {
+         if(strncmp(p, BENCHSINK_DATA, strlen(BENCHSINK_DATA)) == 0) {
+            count++;
+         } else if(strncmp(p, BENCHSINK_END, strlen(BENCHSINK_END)) == 0) {
+            snprintf(out, sizeof(out), "%s|%lu\n", BENCHSINK_DONE, count);
+            if(write(1, out, strlen(out)) < 0)
+               return 1;
+            count = 0;
+         }
+      }
+
+      /* keep partial line, drop a line longer than buffer */
+      len -= (int) (p - in);
+      memmove(in, p, len);
+      if(len == (int) sizeof(in))
+         len = 0;
+   }
+
+   return 0;
+}
@@ -41,16 +41,35 @@
 #define EXPORT extern "C"
 #endif /* _WIN32 */
 
-#define PLUGINSUBPROCESS_NAME         "SubProcess"
-#define PLUGINSUBPROCESS_STARTCOMMAND "SUBPROC_START"
-#define PLUGINSUBPROCESS_STOPCOMMAND  "SUBPROC_STOP"
+#define PLUGINSUBPROCESS_NAME             "SubProcess"
+#define PLUGINSUBPROCESS_STARTCOMMAND     "SUBPROC_START"
+#define PLUGINSUBPROCESS_STOPCOMMAND      "SUBPROC_STOP"
+#define PLUGINSUBPROCESS_SUBSCRIBECOMMAND "SUBPROC_SUBSCRIBE"
+#define PLUGINSUBPROCESS_PREWARMCOMMAND   "SUBPROC_PREWARM"
+#define PLUGINSUBPROCESS_COALESCECOMMAND  "SUBPROC_COALESCE"
+#define PLUGINSUBPROCESS_STATSCOMMAND     "SUBPROC_STATS"
+#define PLUGINSUBPROCESS_CALLCOMMAND      "SUBPROC_CALL"     /* "alias,timeout=msec|reqtype|args", timeout is optional and defaults to that of SUBPROC_START or 5000 msec */
+#define PLUGINSUBPROCESS_STANDBYCOMMAND   "SUBPROC_STANDBY"
+#define PLUGINSUBPROCESS_REGISTERCOMMAND  "SUBPROC_REGISTER"
 
 /* headers */
 
 #include "MMDAgent.h"
+#include <sys/uio.h>
 
-#include "SubProcess_Queue.h"
+#include "SubProcess_Stats.h"
+#include "SubProcess_Recorder.h"
+#include "SubProcess_Reactor.h"
+#include "SubProcess_Filter.h"
+#include "SubProcess_Option.h"
+#include "SubProcess_Slab.h"
+#include "SubProcess_Ring.h"
+#include "SubProcess_Buffer.h"
+#include "SubProcess_Call.h"
 #include "SubProcess_Thread.h"
+#include "SubProcess_Table.h"
+#include "SubProcess_Pool.h"
+#include "SubProcess_Reaper.h"
 #include "SubProcess_Manager.h"
 
 /* variables */
@@ -77,6 +96,20 @@ EXPORT void extProcMessage(MMDAgent *mmdagent, const char *type, const char *arg
             subprocess_manager.startProcess(args);
          } else if (MMDAgent_strequal(type, PLUGINSUBPROCESS_STOPCOMMAND)) {
             subprocess_manager.stopProcess(args);
+         } else if (MMDAgent_strequal(type, PLUGINSUBPROCESS_SUBSCRIBECOMMAND)) {
+            subprocess_manager.subscribeProcess(args);
+         } else if (MMDAgent_strequal(type, PLUGINSUBPROCESS_PREWARMCOMMAND)) {
+            subprocess_manager.prewarmProcess(args);
+         } else if (MMDAgent_strequal(type, PLUGINSUBPROCESS_COALESCECOMMAND)) {
+            subprocess_manager.coalesceProcess(args);
+         } else if (MMDAgent_strequal(type, PLUGINSUBPROCESS_STATSCOMMAND)) {
+            subprocess_manager.reportStats(args);
+         } else if (MMDAgent_strequal(type, PLUGINSUBPROCESS_CALLCOMMAND)) {
+            subprocess_manager.callProcess(args);
+         } else if (MMDAgent_strequal(type, PLUGINSUBPROCESS_STANDBYCOMMAND)) {
+            subprocess_manager.standbyProcess(args);
+         } else if (MMDAgent_strequal(type, PLUGINSUBPROCESS_REGISTERCOMMAND)) {
+            subprocess_manager.registerProcess(args);
          }
          /* enqueue message */
 		subprocess_manager.enqueueBuffer(type, args);
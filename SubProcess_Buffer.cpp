@@ -0,0 +1,332 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* headers */
+
+#include "MMDAgent.h"
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "SubProcess_Filter.h"
+#include "SubProcess_Slab.h"
+#include "SubProcess_Buffer.h"
+
+/* SubProcess_Buffer::initialize: initialize buffer */
+void SubProcess_Buffer::initialize()
+{
+   m_head = NULL;
+   m_tail = NULL;
+   m_offset = 0;
+
+   m_bytes = 0;
+   m_count = 0;
+
+   m_keys = NULL;
+   m_free = NULL;
+}
+
+/* SubProcess_Buffer::unlinkKey: remove cell from index */
+void SubProcess_Buffer::unlinkKey(Cell *cell)
+{
+   Cell **p;
+
+   if(cell->keylen == 0 || m_keys == NULL)
+      return;
+
+   for(p = &m_keys[cell->hash % SUBPROCESSBUFFER_KEYBUCKETS]; *p != NULL; p = &(*p)->keyNext) {
+      if(*p == cell) {
+         *p = cell->keyNext;
+         break;
+      }
+   }
+
+   cell->keylen = 0;
+   cell->keyNext = NULL;
+}
+
+/* SubProcess_Buffer::newCell: take a cell kept for reuse or allocate one */
+SubProcess_Buffer::Cell *SubProcess_Buffer::newCell()
+{
+   Cell *cell = m_free;
+
+   if(cell != NULL)
+      m_free = cell->next;
+   else
+      cell = (Cell *) malloc(sizeof(Cell));
+
+   return cell;
+}
+
+/* SubProcess_Buffer::freeCell: release message of cell and keep it for reuse */
+void SubProcess_Buffer::freeCell(Cell *cell)
+{
+   unlinkKey(cell);
+   SubProcess_Slab::release(cell->msg);
+   cell->msg = NULL;
+   cell->next = m_free;
+   m_free = cell;
+}
+
+/* SubProcess_Buffer::popHead: remove oldest message */
+void SubProcess_Buffer::popHead()
+{
+   Cell *cell = m_head;
+
+   if(cell == NULL)
+      return;
+
+   m_head = cell->next;
+   if(m_head == NULL)
+      m_tail = NULL;
+
+   m_bytes -= cell->len - m_offset;
+   m_count--;
+   m_offset = 0;
+
+   freeCell(cell);
+}
+
+/* SubProcess_Buffer::SubProcess_Buffer: buffer constructor */
+SubProcess_Buffer::SubProcess_Buffer()
+{
+   initialize();
+}
+
+/* SubProcess_Buffer::~SubProcess_Buffer: buffer destructor */
+SubProcess_Buffer::~SubProcess_Buffer()
+{
+   clear();
+}
+
+/* SubProcess_Buffer::clear: free buffer */
+void SubProcess_Buffer::clear()
+{
+   Cell *cell;
+
+   while(m_head != NULL)
+      popHead();
+   while((cell = m_free) != NULL) {
+      m_free = cell->next;
+      free(cell);
+   }
+   free(m_keys);
+
+   initialize();
+}
+
+/* SubProcess_Buffer::append: append line or frame of message, of which first bytes may already be written if buffer is empty, with key of latest value */
+void SubProcess_Buffer::append(SubProcess_Message *msg, const char *data, int len, int written, int keylen)
+{
+   Cell *cell = newCell(), **bucket;
+
+   SubProcess_Slab::retain(msg);
+   cell->msg = msg;
+   cell->data = data;
+   cell->len = len;
+   cell->keylen = 0;
+   cell->next = NULL;
+   cell->keyNext = NULL;
+
+   if(keylen > 0) {
+      if(m_keys == NULL)
+         m_keys = (Cell **) calloc(SUBPROCESSBUFFER_KEYBUCKETS, sizeof(Cell *));
+      cell->keylen = keylen;
+      cell->hash = SubProcess_Filter::hash(msg->line, keylen);
+      bucket = &m_keys[cell->hash % SUBPROCESSBUFFER_KEYBUCKETS];
+      cell->keyNext = *bucket;
+      *bucket = cell;
+   }
+
+   if(m_tail == NULL) {
+      m_head = cell;
+      m_offset = written;
+   } else {
+      m_tail->next = cell;
+   }
+   m_tail = cell;
+
+   m_bytes += cell->len - ((m_head == cell) ? m_offset : 0);
+   m_count++;
+}
+
+/* SubProcess_Buffer::dropOldest: discard oldest message not partially written */
+bool SubProcess_Buffer::dropOldest()
+{
+   Cell *cell;
+
+   if(m_head == NULL)
+      return false;
+
+   if(m_offset == 0) {
+      popHead();
+      return true;
+   }
+
+   /* keep partially written message not to break the stream */
+   cell = m_head->next;
+   if(cell == NULL)
+      return false;
+
+   m_head->next = cell->next;
+   if(m_tail == cell)
+      m_tail = m_head;
+
+   m_bytes -= cell->len;
+   m_count--;
+
+   freeCell(cell);
+
+   return true;
+}
+
+/* SubProcess_Buffer::replace: replace pending message of the same key, return false if none */
+bool SubProcess_Buffer::replace(SubProcess_Message *msg, const char *data, int len, int keylen)
+{
+   unsigned long h;
+   Cell *cell;
+
+   if(m_keys == NULL || keylen == 0)
+      return false;
+
+   h = SubProcess_Filter::hash(msg->line, keylen);
+   for(cell = m_keys[h % SUBPROCESSBUFFER_KEYBUCKETS]; cell != NULL; cell = cell->keyNext)
+      if(cell->hash == h && cell->keylen == keylen && memcmp(cell->msg->line, msg->line, keylen) == 0)
+         break;
+   if(cell == NULL)
+      return false;
+
+   /* partially written message stays, new one is appended and takes its key */
+   if(cell == m_head && m_offset > 0) {
+      unlinkKey(cell);
+      return false;
+   }
+
+   /* key stays valid since new message starts with the same bytes */
+   SubProcess_Slab::retain(msg);
+   SubProcess_Slab::release(cell->msg);
+   cell->msg = msg;
+   cell->data = data;
+   m_bytes += len - cell->len;
+   cell->len = len;
+
+   return true;
+}
+
+/* SubProcess_Buffer::front: get unwritten part of oldest message, return false if empty */
+bool SubProcess_Buffer::front(const char **data, int *len)
+{
+   if(m_head == NULL)
+      return false;
+
+   *data = m_head->data + m_offset;
+   *len = m_head->len - m_offset;
+
+   return true;
+}
+
+/* SubProcess_Buffer::pop: remove oldest message */
+void SubProcess_Buffer::pop()
+{
+   popHead();
+}
+
+/* SubProcess_Buffer::flush: write as much as possible without blocking, return -1 on error */
+int SubProcess_Buffer::flush(int fd)
+{
+   int n;
+   ssize_t len;
+   struct iovec iov[SUBPROCESSBUFFER_MAXIOV];
+   struct msghdr msg;
+   Cell *cell;
+
+   while(m_head != NULL) {
+      /* gather pending messages */
+      n = 0;
+      for(cell = m_head; cell != NULL && n < SUBPROCESSBUFFER_MAXIOV; cell = cell->next) {
+         iov[n].iov_base = (void *) cell->data;
+         iov[n].iov_len = cell->len;
+         n++;
+      }
+      iov[0].iov_base = (void *) (m_head->data + m_offset);
+      iov[0].iov_len = m_head->len - m_offset;
+
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = iov;
+      msg.msg_iovlen = n;
+
+      len = sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+      if(len < 0) {
+         if(errno == EINTR)
+            continue;
+         if(errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+         return -1;
+      }
+
+      /* remove written messages */
+      while(len > 0 && m_head != NULL) {
+         if(len >= m_head->len - m_offset) {
+            len -= m_head->len - m_offset;
+            popHead();
+         } else {
+            m_offset += (int) len;
+            m_bytes -= (int) len;
+            len = 0;
+         }
+      }
+   }
+
+   return 0;
+}
+
+/* SubProcess_Buffer::isEmpty: check empty */
+bool SubProcess_Buffer::isEmpty()
+{
+   return (m_head == NULL) ? true : false;
+}
+
+/* SubProcess_Buffer::getBytes: get bytes of pending messages */
+int SubProcess_Buffer::getBytes()
+{
+   return m_bytes;
+}
+
+/* SubProcess_Buffer::getCount: get number of pending messages */
+int SubProcess_Buffer::getCount()
+{
+   return m_count;
+}
@@ -0,0 +1,119 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* definitions */
+
+#define SUBPROCESSBUFFER_MAXIOV     256 /* number of messages written by a system call */
+#define SUBPROCESSBUFFER_KEYBUCKETS 256 /* buckets of index of keyed messages */
+
+/* SubProcess_Buffer: outbound buffer of messages waiting to be written to subprocess */
+class SubProcess_Buffer
+{
+private:
+
+   /* Cell: cell of buffer */
+   typedef struct _Cell {
+      SubProcess_Message *msg; /* reference of message */
+      const char *data;        /* line or frame of message */
+      int len;
+      int keylen;              /* bytes of line of message as key of latest value, 0 if none */
+      unsigned long hash;
+      struct _Cell *next;
+      struct _Cell *keyNext;   /* next cell in bucket of index */
+   } Cell;
+
+   Cell *m_head;  /* oldest message */
+   Cell *m_tail;  /* newest message */
+   int m_offset;  /* bytes of oldest message already written */
+
+   int m_bytes;   /* bytes of pending messages */
+   int m_count;   /* number of pending messages */
+
+   Cell **m_keys; /* index of keyed messages, NULL until used */
+   Cell *m_free;  /* cells kept for reuse */
+
+   /* initialize: initialize buffer */
+   void initialize();
+
+   /* popHead: remove oldest message */
+   void popHead();
+
+   /* unlinkKey: remove cell from index */
+   void unlinkKey(Cell *cell);
+
+   /* newCell: take a cell kept for reuse or allocate one */
+   Cell *newCell();
+
+   /* freeCell: release message of cell and keep it for reuse */
+   void freeCell(Cell *cell);
+
+public:
+
+   /* SubProcess_Buffer: buffer constructor */
+   SubProcess_Buffer();
+
+   /* ~SubProcess_Buffer: buffer destructor */
+   ~SubProcess_Buffer();
+
+   /* clear: free buffer */
+   void clear();
+
+   /* append: append line or frame of message, of which first bytes may already be written if buffer is empty, with key of latest value */
+   void append(SubProcess_Message *msg, const char *data, int len, int written, int keylen = 0);
+
+   /* replace: replace pending message of the same key, return false if none */
+   bool replace(SubProcess_Message *msg, const char *data, int len, int keylen);
+
+   /* dropOldest: discard oldest message not partially written */
+   bool dropOldest();
+
+   /* front: get unwritten part of oldest message, return false if empty */
+   bool front(const char **data, int *len);
+
+   /* pop: remove oldest message */
+   void pop();
+
+   /* flush: write as much as possible without blocking, return -1 on error */
+   int flush(int fd);
+
+   /* isEmpty: check empty */
+   bool isEmpty();
+
+   /* getBytes: get bytes of pending messages */
+   int getBytes();
+
+   /* getCount: get number of pending messages */
+   int getCount();
+};
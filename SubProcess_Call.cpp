@@ -0,0 +1,229 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* headers */
+
+#include "MMDAgent.h"
+
+#include "SubProcess_Call.h"
+
+/* SubProcess_Call::initialize: initialize requests */
+void SubProcess_Call::initialize()
+{
+   m_mutex = NULL;
+   m_head = NULL;
+   m_id = 0;
+   m_deadline = 0.0;
+}
+
+/* SubProcess_Call::update: recompute earliest deadline, with requests locked */
+void SubProcess_Call::update()
+{
+   double deadline = 0.0;
+   Request *req;
+
+   for(req = m_head; req != NULL; req = req->next)
+      if(deadline == 0.0 || req->deadline < deadline)
+         deadline = req->deadline;
+
+   __atomic_store(&m_deadline, &deadline, __ATOMIC_RELAXED);
+}
+
+/* SubProcess_Call::SubProcess_Call: requests constructor */
+SubProcess_Call::SubProcess_Call()
+{
+   initialize();
+}
+
+/* SubProcess_Call::~SubProcess_Call: requests destructor */
+SubProcess_Call::~SubProcess_Call()
+{
+   clear();
+}
+
+/* SubProcess_Call::setup: prepare for requests */
+bool SubProcess_Call::setup()
+{
+   clear();
+
+   m_mutex = glfwCreateMutex();
+
+   return (m_mutex != NULL) ? true : false;
+}
+
+/* SubProcess_Call::clear: free requests */
+void SubProcess_Call::clear()
+{
+   Request *req;
+
+   while((req = m_head) != NULL) {
+      m_head = req->next;
+      free(req->reqtype);
+      free(req);
+   }
+   if(m_mutex != NULL)
+      glfwDestroyMutex(m_mutex);
+
+   initialize();
+}
+
+/* SubProcess_Call::add: register request with timeout in msec, return its correlation ID or 0 on failure */
+unsigned long SubProcess_Call::add(const char *reqtype, double timeout)
+{
+   Request *req, **p;
+   unsigned long id;
+
+   if(m_mutex == NULL)
+      return 0;
+
+   if(timeout <= 0.0)
+      timeout = SUBPROCESSCALL_TIMEOUT;
+
+   req = (Request *) malloc(sizeof(Request));
+   req->reqtype = MMDAgent_strdup(reqtype);
+   req->start = glfwGetTime();
+   req->deadline = req->start + timeout / 1000.0;
+   req->next = NULL;
+
+   glfwLockMutex(m_mutex);
+   id = ++m_id;
+   if(id == 0)
+      id = ++m_id;
+   req->id = id;
+   for(p = &m_head; *p != NULL; p = &(*p)->next);
+   *p = req;
+   update();
+   glfwUnlockMutex(m_mutex);
+
+   return id;
+}
+
+/* SubProcess_Call::take: remove request by correlation ID, copying its type into buff of MMDAGENT_MAXBUFLEN, return false if unknown */
+bool SubProcess_Call::take(unsigned long id, char *reqtype, double *start)
+{
+   Request *req = NULL, **p;
+
+   if(m_mutex == NULL)
+      return false;
+
+   glfwLockMutex(m_mutex);
+   for(p = &m_head; *p != NULL; p = &(*p)->next) {
+      if((*p)->id == id) {
+         req = *p;
+         *p = req->next;
+         update();
+         break;
+      }
+   }
+   glfwUnlockMutex(m_mutex);
+
+   if(req == NULL)
+      return false;
+
+   strncpy(reqtype, req->reqtype, MMDAGENT_MAXBUFLEN - 1);
+   reqtype[MMDAGENT_MAXBUFLEN - 1] = '\0';
+   *start = req->start;
+   free(req->reqtype);
+   free(req);
+
+   return true;
+}
+
+/* SubProcess_Call::expire: remove a request past deadline at now (negative means any), copying its ID and type, return false if none */
+bool SubProcess_Call::expire(double now, unsigned long *id, char *reqtype)
+{
+   Request *req = NULL, **p;
+
+   if(m_mutex == NULL)
+      return false;
+
+   glfwLockMutex(m_mutex);
+   for(p = &m_head; *p != NULL; p = &(*p)->next) {
+      if(now < 0.0 || (*p)->deadline <= now) {
+         req = *p;
+         *p = req->next;
+         update();
+         break;
+      }
+   }
+   glfwUnlockMutex(m_mutex);
+
+   if(req == NULL)
+      return false;
+
+   *id = req->id;
+   strncpy(reqtype, req->reqtype, MMDAGENT_MAXBUFLEN - 1);
+   reqtype[MMDAGENT_MAXBUFLEN - 1] = '\0';
+   free(req->reqtype);
+   free(req);
+
+   return true;
+}
+
+/* SubProcess_Call::moveTo: hand requests over to another subprocess which received the same requests, continuing correlation IDs there */
+void SubProcess_Call::moveTo(SubProcess_Call *calls)
+{
+   Request *head, **p;
+   unsigned long id;
+
+   if(m_mutex == NULL || calls->m_mutex == NULL)
+      return;
+
+   glfwLockMutex(m_mutex);
+   head = m_head;
+   id = m_id;
+   m_head = NULL;
+   update();
+   glfwUnlockMutex(m_mutex);
+
+   /* requests issued to the other one directly are kept too */
+   glfwLockMutex(calls->m_mutex);
+   for(p = &calls->m_head; *p != NULL; p = &(*p)->next);
+   *p = head;
+   if(calls->m_id < id)
+      calls->m_id = id;
+   calls->update();
+   glfwUnlockMutex(calls->m_mutex);
+}
+
+/* SubProcess_Call::getDeadline: get earliest deadline, 0 if none */
+double SubProcess_Call::getDeadline()
+{
+   double deadline;
+
+   __atomic_load(&m_deadline, &deadline, __ATOMIC_RELAXED);
+
+   return deadline;
+}
@@ -0,0 +1,93 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* definitions */
+
+#define SUBPROCESSCALL_TIMEOUT 5000.0 /* msec, deadline of request without valid timeout */
+
+/* SubProcess_Call: requests in flight to a subprocess, matched with replies by correlation ID */
+class SubProcess_Call
+{
+private:
+
+   /* Request: request waiting for reply */
+   typedef struct _Request {
+      unsigned long id;
+      char *reqtype;
+      double start;    /* time of issue */
+      double deadline;
+      struct _Request *next;
+   } Request;
+
+   GLFWmutex m_mutex;  /* requests are added by main thread, replied by reader and expired by dispatcher */
+   Request *m_head;    /* in order of issue */
+   unsigned long m_id; /* last correlation ID */
+   double m_deadline;  /* earliest deadline, 0 if none */
+
+   /* initialize: initialize requests */
+   void initialize();
+
+   /* update: recompute earliest deadline, with requests locked */
+   void update();
+
+public:
+
+   /* SubProcess_Call: requests constructor */
+   SubProcess_Call();
+
+   /* ~SubProcess_Call: requests destructor */
+   ~SubProcess_Call();
+
+   /* setup: prepare for requests */
+   bool setup();
+
+   /* clear: free requests */
+   void clear();
+
+   /* add: register request with timeout in msec, return its correlation ID or 0 on failure */
+   unsigned long add(const char *reqtype, double timeout);
+
+   /* take: remove request by correlation ID, copying its type into buff of MMDAGENT_MAXBUFLEN, return false if unknown */
+   bool take(unsigned long id, char *reqtype, double *start);
+
+   /* expire: remove a request past deadline at now (negative means any), copying its ID and type, return false if none */
+   bool expire(double now, unsigned long *id, char *reqtype);
+
+   /* moveTo: hand requests over to another subprocess which received the same requests, continuing correlation IDs there */
+   void moveTo(SubProcess_Call *calls);
+
+   /* getDeadline: get earliest deadline, 0 if none */
+   double getDeadline();
+};
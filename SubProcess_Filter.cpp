@@ -0,0 +1,303 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* headers */
+
+#include "MMDAgent.h"
+
+#include "SubProcess_Filter.h"
+
+/* SubProcess_Filter::initialize: initialize filter */
+void SubProcess_Filter::initialize()
+{
+   m_table = NULL;
+   m_tableSize = 0;
+   m_numEntries = 0;
+
+   m_prefixLens = NULL;
+   m_numPrefixLens = 0;
+
+   m_globs = NULL;
+}
+
+/* SubProcess_Filter::hash: hash of string (FNV-1a) */
+unsigned long SubProcess_Filter::hash(const char *str, int len)
+{
+   int i;
+   unsigned long h = 2166136261UL;
+
+   for(i = 0; i < len; i++) {
+      h ^= (unsigned char) str[i];
+      h *= 16777619UL;
+   }
+
+   return h;
+}
+
+/* SubProcess_Filter::find: find entry in table */
+SubProcess_Filter::Entry *SubProcess_Filter::find(const char *str, int len, unsigned long h, bool prefix)
+{
+   int i;
+   Entry *entry;
+
+   if(m_table == NULL)
+      return NULL;
+
+   for(i = (int) (h & (m_tableSize - 1));; i = (i + 1) & (m_tableSize - 1)) {
+      entry = &m_table[i];
+      if(entry->str == NULL)
+         return NULL;
+      if(entry->hash == h && entry->len == len && entry->prefix == prefix && memcmp(entry->str, str, len) == 0)
+         return entry;
+   }
+}
+
+/* SubProcess_Filter::insert: insert entry to table */
+void SubProcess_Filter::insert(const char *str, int len, bool prefix, int value)
+{
+   int i, j, oldSize;
+   unsigned long h = hash(str, len);
+   Entry *oldTable, *entry;
+
+   if(find(str, len, h, prefix) != NULL)
+      return;
+
+   /* keep load factor under 0.5 */
+   if((m_numEntries + 1) * 2 > m_tableSize) {
+      oldTable = m_table;
+      oldSize = m_tableSize;
+      m_tableSize = (oldSize == 0) ? 16 : oldSize * 2;
+      m_table = (Entry *) calloc(m_tableSize, sizeof(Entry));
+      for(i = 0; i < oldSize; i++) {
+         if(oldTable[i].str == NULL)
+            continue;
+         for(j = (int) (oldTable[i].hash & (m_tableSize - 1)); m_table[j].str != NULL; j = (j + 1) & (m_tableSize - 1));
+         m_table[j] = oldTable[i];
+      }
+      free(oldTable);
+   }
+
+   for(i = (int) (h & (m_tableSize - 1)); m_table[i].str != NULL; i = (i + 1) & (m_tableSize - 1));
+   entry = &m_table[i];
+   entry->str = (char *) malloc(sizeof(char) * (len + 1));
+   memcpy(entry->str, str, len);
+   entry->str[len] = '\0';
+   entry->len = len;
+   entry->hash = h;
+   entry->prefix = prefix;
+   entry->value = value;
+   m_numEntries++;
+
+   /* remember length of prefix, sorted in ascending order */
+   if(prefix == true) {
+      for(i = 0; i < m_numPrefixLens; i++)
+         if(m_prefixLens[i] >= len)
+            break;
+      if(i < m_numPrefixLens && m_prefixLens[i] == len)
+         return;
+      m_prefixLens = (int *) realloc(m_prefixLens, sizeof(int) * (m_numPrefixLens + 1));
+      memmove(&m_prefixLens[i + 1], &m_prefixLens[i], sizeof(int) * (m_numPrefixLens - i));
+      m_prefixLens[i] = len;
+      m_numPrefixLens++;
+   }
+}
+
+/* SubProcess_Filter::globMatch: match string against glob pattern */
+bool SubProcess_Filter::globMatch(const char *pattern, const char *str)
+{
+   const char *starPattern = NULL, *starStr = NULL;
+
+   while(*str != '\0') {
+      if(*pattern == SUBPROCESSFILTER_WILDCARD) {
+         starPattern = ++pattern;
+         starStr = str;
+      } else if(*pattern == SUBPROCESSFILTER_ANYCHAR || *pattern == *str) {
+         pattern++;
+         str++;
+      } else if(starPattern != NULL) {
+         /* backtrack to the last wildcard */
+         pattern = starPattern;
+         str = ++starStr;
+      } else {
+         return false;
+      }
+   }
+
+   while(*pattern == SUBPROCESSFILTER_WILDCARD)
+      pattern++;
+
+   return (*pattern == '\0') ? true : false;
+}
+
+/* SubProcess_Filter::SubProcess_Filter: filter constructor */
+SubProcess_Filter::SubProcess_Filter()
+{
+   initialize();
+}
+
+/* SubProcess_Filter::~SubProcess_Filter: filter destructor */
+SubProcess_Filter::~SubProcess_Filter()
+{
+   clear();
+}
+
+/* SubProcess_Filter::clear: free filter */
+void SubProcess_Filter::clear()
+{
+   int i;
+   Glob *glob, *next;
+
+   for(i = 0; i < m_tableSize; i++)
+      free(m_table[i].str);
+   free(m_table);
+   free(m_prefixLens);
+
+   for(glob = m_globs; glob != NULL; glob = next) {
+      next = glob->next;
+      free(glob->str);
+      delete glob;
+   }
+
+   initialize();
+}
+
+/* SubProcess_Filter::add: add a pattern ("TYPE", "PREFIX*" or glob) with a value */
+void SubProcess_Filter::add(const char *pattern, int value)
+{
+   int i, len;
+   Glob *glob, *last;
+
+   /* trim white spaces */
+   while(*pattern == ' ' || *pattern == '\t')
+      pattern++;
+   for(len = MMDAgent_strlen(pattern); len > 0; len--)
+      if(pattern[len - 1] != ' ' && pattern[len - 1] != '\t')
+         break;
+   if(len == 0)
+      return;
+
+   for(i = 0; i < len; i++)
+      if(pattern[i] == SUBPROCESSFILTER_WILDCARD || pattern[i] == SUBPROCESSFILTER_ANYCHAR)
+         break;
+
+   if(i == len) {
+      /* exact */
+      insert(pattern, len, false, value);
+   } else if(i == len - 1 && pattern[i] == SUBPROCESSFILTER_WILDCARD) {
+      /* prefix */
+      insert(pattern, len - 1, true, value);
+   } else {
+      /* glob, tested in order of addition */
+      glob = new Glob;
+      glob->str = (char *) malloc(sizeof(char) * (len + 1));
+      memcpy(glob->str, pattern, len);
+      glob->str[len] = '\0';
+      glob->value = value;
+      glob->next = NULL;
+      if(m_globs == NULL) {
+         m_globs = glob;
+      } else {
+         for(last = m_globs; last->next != NULL; last = last->next);
+         last->next = glob;
+      }
+   }
+}
+
+/* SubProcess_Filter::addList: add separated list of patterns with a value */
+void SubProcess_Filter::addList(const char *patterns, int value)
+{
+   const char *p, *q;
+   char *buff;
+
+   if(patterns == NULL)
+      return;
+
+   buff = (char *) malloc(sizeof(char) * (MMDAgent_strlen(patterns) + 1));
+   for(p = patterns; *p != '\0'; p = (*q != '\0') ? q + 1 : q) {
+      for(q = p; *q != SUBPROCESSFILTER_SEPARATOR && *q != '\0'; q++);
+      memcpy(buff, p, q - p);
+      buff[q - p] = '\0';
+      add(buff, value);
+   }
+   free(buff);
+}
+
+/* SubProcess_Filter::match: return value of matching pattern, or -1 if none matches */
+int SubProcess_Filter::match(const char *type)
+{
+   int i, len, pos;
+   unsigned long h;
+   Entry *entry, *found = NULL;
+   Glob *glob;
+
+   if(type == NULL)
+      return -1;
+   len = MMDAgent_strlen(type);
+
+   if(m_numEntries > 0) {
+      /* exact */
+      entry = find(type, len, hash(type, len), false);
+      if(entry != NULL)
+         return entry->value;
+
+      /* prefixes: hash is extended incrementally, the longest match wins */
+      h = hash(type, 0);
+      pos = 0;
+      for(i = 0; i < m_numPrefixLens && m_prefixLens[i] <= len; i++) {
+         for(; pos < m_prefixLens[i]; pos++) {
+            h ^= (unsigned char) type[pos];
+            h *= 16777619UL;
+         }
+         entry = find(type, pos, h, true);
+         if(entry != NULL)
+            found = entry;
+      }
+      if(found != NULL)
+         return found->value;
+   }
+
+   /* globs */
+   for(glob = m_globs; glob != NULL; glob = glob->next)
+      if(globMatch(glob->str, type) == true)
+         return glob->value;
+
+   return -1;
+}
+
+/* SubProcess_Filter::isEmpty: check empty */
+bool SubProcess_Filter::isEmpty()
+{
+   return (m_numEntries == 0 && m_globs == NULL) ? true : false;
+}
@@ -0,0 +1,109 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* definitions */
+
+#define SUBPROCESSFILTER_SEPARATOR ','
+#define SUBPROCESSFILTER_WILDCARD  '*'
+#define SUBPROCESSFILTER_ANYCHAR   '?'
+
+/* SubProcess_Filter: matcher of message types against exact, prefix and glob patterns */
+class SubProcess_Filter
+{
+private:
+
+   /* Entry: exact or prefix pattern in hash table */
+   typedef struct _Entry {
+      char *str;
+      int len;
+      unsigned long hash;
+      bool prefix;
+      int value;
+   } Entry;
+
+   /* Glob: glob pattern tested one by one */
+   typedef struct _Glob {
+      char *str;
+      int value;
+      struct _Glob *next;
+   } Glob;
+
+   Entry *m_table;      /* open addressing hash table */
+   int m_tableSize;     /* size of table (power of two) */
+   int m_numEntries;    /* number of entries in table */
+
+   int *m_prefixLens;   /* distinct lengths of prefix patterns, shortest first */
+   int m_numPrefixLens;
+
+   Glob *m_globs;       /* list of glob patterns */
+
+   /* initialize: initialize filter */
+   void initialize();
+
+   /* find: find entry in table */
+   Entry *find(const char *str, int len, unsigned long h, bool prefix);
+
+   /* insert: insert entry to table */
+   void insert(const char *str, int len, bool prefix, int value);
+
+   /* globMatch: match string against glob pattern */
+   static bool globMatch(const char *pattern, const char *str);
+
+public:
+
+   /* SubProcess_Filter: filter constructor */
+   SubProcess_Filter();
+
+   /* ~SubProcess_Filter: filter destructor */
+   ~SubProcess_Filter();
+
+   /* clear: free filter */
+   void clear();
+
+   /* add: add a pattern ("TYPE", "PREFIX*" or glob) with a value */
+   void add(const char *pattern, int value);
+
+   /* addList: add separated list of patterns with a value */
+   void addList(const char *patterns, int value);
+
+   /* match: return value of matching pattern, or -1 if none matches */
+   int match(const char *type);
+
+   /* isEmpty: check empty */
+   bool isEmpty();
+
+   /* hash: hash of string */
+   static unsigned long hash(const char *str, int len);
+};
@@ -36,18 +36,163 @@
 /* headers */
 
 #include "MMDAgent.h"
+#include <poll.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
-#include "SubProcess_Queue.h"
+#include "SubProcess_Stats.h"
+#include "SubProcess_Recorder.h"
+#include "SubProcess_Reactor.h"
+#include "SubProcess_Filter.h"
+#include "SubProcess_Option.h"
+#include "SubProcess_Slab.h"
+#include "SubProcess_Ring.h"
+#include "SubProcess_Buffer.h"
+#include "SubProcess_Call.h"
 #include "SubProcess_Thread.h"
+#include "SubProcess_Table.h"
+#include "SubProcess_Pool.h"
+#include "SubProcess_Reaper.h"
 #include "SubProcess_Manager.h"
 
 /* mainThread: main thread */
 static void mainThread(void *param)
 {
    SubProcess_Manager *subprocess_manager = (SubProcess_Manager *) param;
+   sppin();
    subprocess_manager->run();
 }
 
+/* writerThread: dispatcher thread */
+static void writerThread(void *param)
+{
+   SubProcess_Writer *writer = (SubProcess_Writer *) param;
+   sppin();
+   writer->manager->runWriter(writer);
+}
+
+/* standbyThread: thread launching hot-standby replicas */
+static void standbyThread(void *param)
+{
+   SubProcess_Manager *subprocess_manager = (SubProcess_Manager *) param;
+   subprocess_manager->runStandby();
+}
+
+/* freeLink: free subprocess torn down by reaper */
+static void freeLink(void *param)
+{
+   SubProcess_Link *link = (SubProcess_Link *) param;
+
+   glfwDestroyMutex(link->mutex);
+   delete link;
+}
+
+/* freeRegistration: free command registered by SUBPROC_REGISTER */
+static void freeRegistration(SubProcess_Registration *reg)
+{
+   int i;
+
+   for(i = 0; i < reg->numPending; i++)
+      SubProcess_Slab::release(reg->pending[i]);
+   free(reg->pending);
+   free(reg->name);
+   free(reg->args);
+   free(reg->subscription);
+   delete reg;
+}
+
+/* hangupLink: handler of hang-up of registered subprocess */
+static bool hangupLink(void *param)
+{
+   SubProcess_Link *link = (SubProcess_Link *) param;
+
+   if(link->manager->failover(link) == true)
+      return true;
+   return link->manager->watchExit(link);
+}
+
+/* mixHash: spread bits of hash over consistent-hash ring (finalizer of splitmix64) */
+static unsigned long mixHash(unsigned long h)
+{
+   h ^= h >> 30;
+   h *= 0xbf58476d1ce4e5b9UL;
+   h ^= h >> 27;
+   h *= 0x94d049bb133111ebUL;
+   h ^= h >> 31;
+   return h;
+}
+
+/* comparePoint: compare points on ring */
+static int comparePoint(const void *a, const void *b)
+{
+   unsigned long x = *(const unsigned long *) a, y = *(const unsigned long *) b;
+
+   return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+/* keyHash: hash of field of "arg|arg|..." of len bytes, from 1, on ring */
+static unsigned long keyHash(const char *args, int len, int field)
+{
+   int i, start = 0;
+
+   for(i = 0; i < len && field > 1; i++) {
+      if(args[i] == SUBPROCESSTHREAD_SEPARATOR) {
+         start = i + 1;
+         field--;
+      }
+   }
+   if(field > 1)
+      start = len; /* missing field is empty */
+   for(i = start; i < len && args[i] != SUBPROCESSTHREAD_SEPARATOR; i++);
+
+   return mixHash(SubProcess_Filter::hash(args + start, i - start));
+}
+
+/* ownerOf: find worker owning hash, which has the nearest point clockwise on ring */
+static int ownerOf(SubProcess_Link **members, int num, unsigned long h)
+{
+   int i, x = 0, lo, hi, mid;
+   unsigned long d, min = 0;
+
+   for(i = 0; i < num; i++) {
+      lo = 0;
+      hi = SUBPROCESSMANAGER_VNODES;
+      while(lo < hi) {
+         mid = (lo + hi) / 2;
+         if(members[i]->points[mid] < h)
+            lo = mid + 1;
+         else
+            hi = mid;
+      }
+      /* distance wraps around */
+      d = members[i]->points[lo % SUBPROCESSMANAGER_VNODES] - h;
+      if(i == 0 || d < min) {
+         min = d;
+         x = i;
+      }
+   }
+
+   return x;
+}
+
+/* joinGroup: make subprocess a worker of group, placing it on ring by alias of worker, so that a restarted worker takes back its keys */
+static void joinGroup(SubProcess_Link *link, SubProcess_Group *group, int member)
+{
+   int i;
+   unsigned long h;
+
+   __atomic_add_fetch(&group->refs, 1, __ATOMIC_RELAXED);
+   link->group = group;
+   link->member = member;
+   link->points = (unsigned long *) malloc(sizeof(unsigned long) * SUBPROCESSMANAGER_VNODES);
+   h = SubProcess_Filter::hash(link->proc.getName(), MMDAgent_strlen(link->proc.getName()));
+   for(i = 0; i < SUBPROCESSMANAGER_VNODES; i++)
+      link->points[i] = mixHash(h + 0x9e3779b97f4a7c15UL * (i + 1));
+   qsort(link->points, SUBPROCESSMANAGER_VNODES, sizeof(unsigned long), comparePoint);
+}
+
 /* SubProcess_Manager::initialize: initialize thread */
 void SubProcess_Manager::initialize()
 {
@@ -56,46 +201,124 @@ void SubProcess_Manager::initialize()
    m_kill = false;
 
    m_mutex = NULL;
-   m_mutex2 = NULL;
-   m_cond = NULL;
    m_thread = -1;
 
-   m_procs = NULL;
+   memset(m_table, 0, sizeof(m_table));
+   m_snapshot = NULL;
+   m_groups = NULL;
+   m_registered = NULL;
+
+   m_reactors = NULL;
+   m_numReactors = 0;
+
+   memset(m_weights, 0, sizeof(m_weights));
+
+   m_spare = NULL;
+
+   m_standbyThread = -1;
+   m_standbyCond = NULL;
+   m_retired = NULL;
+
+   memset(&m_writer, 0, sizeof(SubProcess_Writer));
+   m_writer.manager = this;
+   m_writer.thread = -1;
+   m_writer.eventfd = -1;
+   m_writers = NULL;
+   m_numWriters = 0;
 }
 
 /* SubProcess_Manager::clear: free thread */
 void SubProcess_Manager::clear()
 {
+   int i;
    SubProcess_Link *link, *next;
+   SubProcess_Group *group;
+   SubProcess_Registration *reg;
+   SubProcess_Batch *batch;
 
    m_kill = true;
 
-   /* wait */
-   if(m_cond != NULL)
-      glfwSignalCond(m_cond);
-
-   /* stop thread & close mutex */
-   if(m_mutex != NULL || m_mutex2 != NULL || m_cond != NULL || m_thread >= 0) {
-      if(m_thread >= 0) {
-         glfwWaitThread(m_thread, GLFW_WAIT);
-         glfwDestroyThread(m_thread);
-      }
-      if(m_cond != NULL)
-         glfwDestroyCond(m_cond);
-      if(m_mutex != NULL)
-         glfwDestroyMutex(m_mutex);
-      if(m_mutex2 != NULL)
-         glfwDestroyMutex(m_mutex2);
+   /* wake up */
+   for(i = 0; i < SUBPROCESSMANAGER_LANES; i++)
+      m_rings[i].close();
+   for(i = 0; i < m_numWriters; i++) {
+      if(m_writers[i].mutex == NULL || m_writers[i].cond == NULL || m_writers[i].eventfd < 0)
+         continue;
+      glfwLockMutex(m_writers[i].mutex);
+      m_writers[i].kill = true;
+      glfwSignalCond(m_writers[i].cond);
+      glfwUnlockMutex(m_writers[i].mutex);
+      eventfd_write(m_writers[i].eventfd, 1);
+   }
+
+   /* stop threads */
+   if(m_thread >= 0) {
+      glfwWaitThread(m_thread, GLFW_WAIT);
+      glfwDestroyThread(m_thread);
+   }
+   stopWriters();
+   if(m_standbyThread >= 0) {
+      glfwLockMutex(m_mutex);
+      glfwSignalCond(m_standbyCond);
+      glfwUnlockMutex(m_mutex);
+      glfwWaitThread(m_standbyThread, GLFW_WAIT);
+      glfwDestroyThread(m_standbyThread);
+   }
+
+   /* stop subprocesses, waiting for reaper before GLFW is terminated */
+   releaseSnapshot(m_snapshot);
+   for(i = 0; i < SUBPROCESSMANAGER_BUCKETS; i++) {
+      for(link = m_table[i]; link != NULL; link = next) {
+         next = link->next;
+         releaseLink(link);
+      }
+   }
+   for(link = m_retired; link != NULL; link = next) {
+      next = link->next;
+      releaseLink(link);
+   }
+   m_reaper.stop();
+   m_pool.stop();
+   m_procs.clear();
+
+   /* close mutex */
+   if(m_mutex != NULL) {
+      if(m_standbyCond != NULL)
+         glfwDestroyCond(m_standbyCond);
+      glfwDestroyMutex(m_mutex);
       glfwTerminate();
    }
 
    /* free */
-   m_queue.clear();
+   for(i = 0; i < SUBPROCESSMANAGER_LANES; i++)
+      m_rings[i].clear();
+   m_lanes.clear();
 
-   for(link = m_procs; link != NULL; link = next) {
-      next = link->next;
-      delete link;
+   while((group = m_groups) != NULL) {
+      m_groups = group->next;
+      releaseGroup(group);
+   }
+   while((reg = m_registered) != NULL) {
+      m_registered = reg->next;
+      freeRegistration(reg);
+   }
+
+   if(m_reactors != NULL)
+      delete [] m_reactors;
+
+   m_stats.clear();
+   m_recorder.clear();
+
+   while((batch = m_spare) != NULL) {
+      m_spare = batch->next;
+      free(batch->msgs);
+      free(batch);
    }
+   free(m_writer.msgs);
+   free(m_writer.pfd);
+
+   /* all messages have been released with batches and subprocesses */
+   m_slab.clear();
 
    initialize();
 }
@@ -115,6 +338,8 @@ SubProcess_Manager::~SubProcess_Manager()
 /* SubProcess_Manager::loadAndStart: start thread manager */
 void SubProcess_Manager::loadAndStart(MMDAgent *mmdagent)
 {
+   int i;
+
    clear();
 
    if(mmdagent == NULL)
@@ -122,16 +347,54 @@ void SubProcess_Manager::loadAndStart(MMDAgent *mmdagent)
 
    m_mmdagent = mmdagent;
 
+   /* allocate queues */
+   for(i = 0; i < SUBPROCESSMANAGER_LANES; i++) {
+      if(m_rings[i].setup(SUBPROCESSRING_SIZE) == false) {
+         clear();
+         return;
+      }
+   }
+   setupLanes();
+
+   /* statistics and recording are optional */
+   m_stats.setup();
+   m_recorder.setup();
+
+   /* start reactors in epoll mode, fall back to a thread per subprocess on failure */
+   if(MMDAgent_strequal(getenv(SUBPROCESSREACTOR_ENVENGINE), "epoll")) {
+      m_numReactors = (getenv(SUBPROCESSREACTOR_ENVREACTORS) != NULL) ? MMDAgent_str2int(getenv(SUBPROCESSREACTOR_ENVREACTORS)) : 1;
+      if(m_numReactors < 1)
+         m_numReactors = 1;
+      m_reactors = new SubProcess_Reactor[m_numReactors];
+      for(i = 0; i < m_numReactors; i++) {
+         if(m_reactors[i].start() == false) {
+            delete [] m_reactors;
+            m_reactors = NULL;
+            m_numReactors = 0;
+            break;
+         }
+      }
+   }
+
    /* start thread */
    glfwInit();
    m_mutex = glfwCreateMutex();
-   m_mutex2 = glfwCreateMutex();
-   m_cond = glfwCreateCond();
+   if(m_mutex == NULL || m_procs.setup() == false || m_slab.setup() == false || startWriters((getenv(SUBPROCESSMANAGER_ENVDISPATCHERS) != NULL) ? MMDAgent_str2int(getenv(SUBPROCESSMANAGER_ENVDISPATCHERS)) : 1) == false) {
+      clear();
+      return;
+   }
+   m_pool.start(m_mmdagent, &m_procs);
+   m_reaper.start(&m_procs);
    m_thread = glfwCreateThread(mainThread, this);
-   if(m_mutex == NULL || m_mutex2 == NULL || m_cond == NULL || m_thread < 0) {
+   if(m_thread < 0) {
       clear();
       return;
    }
+
+   /* standbys are launched in background */
+   m_standbyCond = glfwCreateCond();
+   if(m_standbyCond != NULL)
+      m_standbyThread = glfwCreateThread(standbyThread, this);
 }
 
 /* SubProcess_Manager::stopAndRelease: stop threads and release */
@@ -140,158 +403,1859 @@ void SubProcess_Manager::stopAndRelease()
    clear();
 }
 
-/* SubProcess_Manager::run: main loop */
-void SubProcess_Manager::run()
+/* SubProcess_Manager::wait: sleep until message arrives or pending output of shard of writer can be written (NULL means no shard) */
+void SubProcess_Manager::wait(SubProcess_Writer *writer)
 {
-   char *type, *args, *buff;
-   SubProcess_Link *link, *prev, *unused;
+   int i, n = 0, size, timeout = -1, ms;
+   bool sleep = true, manager = (writer == NULL || writer == &m_writer) ? true : false, calls = false;
+   double now, t;
+   eventfd_t value;
+   pollfd lanes[SUBPROCESSMANAGER_LANES], *pfd = lanes;
+   SubProcess_Link *link;
+   SubProcess_Snapshot *snapshot = (writer != NULL) ? acquire() : NULL;
 
-   while(m_kill == false) {
-      glfwLockMutex(m_mutex);
+   /* room for every subprocess of shard, not only those with output due, so that descriptors grow with subprocesses and not with traffic */
+   size = (manager == true) ? SUBPROCESSMANAGER_LANES : 1;
+   for(i = 0; snapshot != NULL && i < snapshot->num; i++)
+      if(m_writers == NULL || snapshot->procs[i]->shard == writer->index)
+         size++;
 
-      /* wait messages from main program */
-      while(m_queue.isEmpty()) {
-         glfwWaitCond(m_cond, m_mutex, GLFW_INFINITY);
-         if(m_kill == true)
-            return;
+   /* descriptors are kept for next wait */
+   if(writer != NULL && size > writer->pfdSize) {
+      writer->pfdSize = size * 2;
+      writer->pfd = (pollfd *) realloc(writer->pfd, sizeof(pollfd) * writer->pfdSize);
+   }
+   if(writer != NULL)
+      pfd = writer->pfd;
+
+   /* manager thread waits for messages from main program, dispatcher threads wait for batches */
+   if(manager == true) {
+      for(i = 0; i < SUBPROCESSMANAGER_LANES; i++) {
+         pfd[n].fd = m_rings[i].getWakeupFd();
+         pfd[n].events = POLLIN;
+         n++;
+      }
+   } else {
+      pfd[n].fd = writer->eventfd;
+      pfd[n].events = POLLIN;
+      n++;
+   }
+
+   /* wait for room of sockets with output due, and for end of flush windows and call deadlines */
+   now = glfwGetTime();
+   for(i = 0; snapshot != NULL && i < snapshot->num; i++) {
+      link = snapshot->procs[i];
+      if(m_writers != NULL && link->shard != writer->index)
+         continue;
+      t = link->proc.getCallDeadline();
+      if(t > 0.0) {
+         calls = true;
+         ms = (t <= now) ? 0 : (int) ((t - now) * 1000.0) + 1;
+         if(timeout < 0 || ms < timeout)
+            timeout = ms;
+      }
+      t = link->proc.getFlushTime();
+      if(t <= 0.0)
+         continue;
+      if(t <= now) {
+         pfd[n].fd = link->proc.getFd();
+         pfd[n].events = POLLOUT;
+         n++;
+      } else {
+         ms = (int) ((t - now) * 1000.0) + 1;
+         if(timeout < 0 || ms < timeout)
+            timeout = ms;
       }
+   }
 
-      /* dequeue event */
-      m_queue.dequeue(&type, &args);
+   /* stopped subprocesses must not wait for wake up to be freed */
+   releaseSnapshot(snapshot);
 
-      glfwUnlockMutex(m_mutex);
+   if(manager == true) {
+      /* sleep only if every lane is still empty after announcing it */
+      for(i = 0; i < SUBPROCESSMANAGER_LANES && m_rings[i].prepareWait() == true; i++);
+      if(i == SUBPROCESSMANAGER_LANES) {
+         while(poll(pfd, n, timeout) < 0 && errno == EINTR);
+         if(m_stats.getSegment() != NULL)
+            subprocstats_add(&m_stats.getSegment()->wakeups, 1);
+      }
+      while(i-- > 0)
+         m_rings[i].finishWait();
+   } else {
+      /* batch queued after this check finds thread waiting and wakes it up */
+      glfwLockMutex(writer->mutex);
+      if(writer->numBatches > 0 || writer->kill == true)
+         sleep = false;
+      writer->waiting = sleep;
+      glfwUnlockMutex(writer->mutex);
+      if(sleep == true) {
+         while(poll(pfd, n, timeout) < 0 && errno == EINTR);
+         eventfd_read(writer->eventfd, &value);
+         glfwLockMutex(writer->mutex);
+         writer->waiting = false;
+         glfwUnlockMutex(writer->mutex);
+      }
+   }
 
-      /* send message to all subprocesses */
-      buff = (char *) malloc(sizeof(char) * (MMDAgent_strlen(type)
-                                             + MMDAgent_strlen(args) + 4));
-      if(MMDAgent_strlen(args) > 0) {
-		sprintf(buff, "%s|%s", type, args);
-      } else {
-		sprintf(buff, "%s", type);
+   if(writer != NULL && (size > ((manager == true) ? SUBPROCESSMANAGER_LANES : 1) || calls == true)) {
+      /* write pending messages which are due, and report requests past deadline */
+      snapshot = acquire();
+      now = glfwGetTime();
+      for(i = 0; snapshot != NULL && i < snapshot->num; i++) {
+         link = snapshot->procs[i];
+         if(m_writers != NULL && link->shard != writer->index)
+            continue;
+         t = link->proc.getFlushTime();
+         if(t > 0.0 && t <= now)
+            link->proc.flush();
+         t = link->proc.getCallDeadline();
+         if(t > 0.0 && t <= now)
+            link->proc.expireCalls(now);
       }
+      releaseSnapshot(snapshot);
+   }
+}
 
-      glfwLockMutex(m_mutex2);
+/* SubProcess_Manager::setupLanes: map message types to lanes and set draining from environment */
+void SubProcess_Manager::setupLanes()
+{
+   int i;
+   const char *env, *w;
+   char *buff, *p, *q;
 
-      prev = unused = NULL;
-      for(link = m_procs; link != NULL;) {
-         if(link->proc.isRunning() == true) {
-            /* send message to thread */
-            link->proc.puts(buff);
-            prev = link;
-            link = link->next;
-         } else {
-            /* discard link of thread not running */
-            if(prev == NULL) {
-               m_procs = link->next;
-               link->next = unused;
-               unused = link;
-               link = m_procs;
-            } else {
-               prev->next = link->next;
-               link->next = unused;
-               unused = link;
-               link = prev->next;
-            }
-         }
+   /* "patterns|patterns", an empty value puts all messages in one lane */
+   env = getenv(SUBPROCESSMANAGER_ENVLANES);
+   if(env == NULL)
+      env = SUBPROCESSMANAGER_DEFAULTLANES;
+   buff = MMDAgent_strdup(env);
+   for(i = 0, p = buff; p != NULL && i < SUBPROCESSMANAGER_LANES - 1; i++, p = q) {
+      q = strchr(p, SUBPROCESSTHREAD_SEPARATOR);
+      if(q != NULL)
+         *q++ = '\0';
+      m_lanes.addList(p, i);
+   }
+   free(buff);
+
+   /* "w0,w1,..." */
+   env = getenv(SUBPROCESSMANAGER_ENVWEIGHTS);
+   for(i = 0, w = env; w != NULL && i < SUBPROCESSMANAGER_LANES; i++) {
+      m_weights[i] = MMDAgent_str2int(w);
+      if(m_weights[i] < 1)
+         m_weights[i] = 1;
+      w = strchr(w, SUBPROCESSFILTER_SEPARATOR);
+      if(w != NULL)
+         w++;
+   }
+   for(; env != NULL && i < SUBPROCESSMANAGER_LANES; i++)
+      m_weights[i] = 1;
+}
+
+/* SubProcess_Manager::isIdle: check if all lanes are empty */
+bool SubProcess_Manager::isIdle()
+{
+   int i;
+
+   for(i = 0; i < SUBPROCESSMANAGER_LANES; i++)
+      if(m_rings[i].isEmpty() == false)
+         return false;
+
+   return true;
+}
+
+/* SubProcess_Manager::take: move up to max messages of lane into batch, return number of them */
+int SubProcess_Manager::take(SubProcess_Batch *batch, int lane, int max)
+{
+   int n = 0;
+   double now = glfwGetTime();
+   SubProcess_Message *msg;
+   SubProcStats_Segment *seg = m_stats.getSegment();
+
+   /* references of messages move from ring to batch */
+   while(n < max && m_rings[lane].front(&msg) == true) {
+      if(batch->num == batch->size) {
+         batch->size = (batch->size == 0) ? 64 : batch->size * 2;
+         batch->msgs = (SubProcess_Message **) realloc(batch->msgs, sizeof(SubProcess_Message *) * batch->size);
       }
+      batch->msgs[batch->num++] = msg;
+      m_rings[lane].pop();
+      n++;
+      if(seg != NULL)
+         subprocstats_record(&seg->laneWait[lane], (now - msg->time) * 1000000.0);
+   }
+
+   if(seg != NULL && n > 0)
+      subprocstats_add(&seg->laneDequeued[lane], n);
+
+   return n;
+}
+
+/* SubProcess_Manager::drain: move queued messages into a batch, higher lanes first or by weights */
+SubProcess_Batch *SubProcess_Manager::drain()
+{
+   int i, n;
+   SubProcess_Batch *batch;
+
+   /* take a released batch, only manager thread takes them */
+   batch = __atomic_load_n(&m_spare, __ATOMIC_ACQUIRE);
+   while(batch != NULL && __atomic_compare_exchange_n(&m_spare, &batch, batch->next, true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE) == false);
+   if(batch == NULL)
+      batch = (SubProcess_Batch *) calloc(1, sizeof(SubProcess_Batch));
 
-      glfwUnlockMutex(m_mutex2);
+   batch->refs = 1;
+   batch->num = 0;
+   batch->next = NULL;
 
-      for(link = unused; link != NULL; link = link->next) {
-         delete link;
+   if(m_weights[0] == 0) {
+      /* strict: lower lanes only get the rest of a batch */
+      for(i = 0; i < SUBPROCESSMANAGER_LANES && batch->num < SUBPROCESSMANAGER_MAXDRAIN; i++)
+         take(batch, i, SUBPROCESSMANAGER_MAXDRAIN - batch->num);
+   } else {
+      /* weighted: lanes take turns until batch is full or all are empty */
+      do {
+         n = 0;
+         for(i = 0; i < SUBPROCESSMANAGER_LANES && batch->num < SUBPROCESSMANAGER_MAXDRAIN; i++)
+            n += take(batch, i, (m_weights[i] < SUBPROCESSMANAGER_MAXDRAIN - batch->num) ? m_weights[i] : SUBPROCESSMANAGER_MAXDRAIN - batch->num);
+      } while(n > 0 && batch->num < SUBPROCESSMANAGER_MAXDRAIN);
+   }
+
+   /* subprocesses to be written to */
+   batch->snapshot = acquire();
+
+   if(m_stats.getSegment() != NULL) {
+      subprocstats_add(&m_stats.getSegment()->dequeued, batch->num);
+      subprocstats_add(&m_stats.getSegment()->batches, 1);
+      subprocstats_set(&m_stats.getSegment()->allocs, m_slab.getAllocs());
+      for(i = 0; i < SUBPROCESSMANAGER_LANES; i++)
+         subprocstats_set(&m_stats.getSegment()->laneOverflows[i], m_rings[i].getDrops());
+   }
+
+   return batch;
+}
+
+/* SubProcess_Manager::releaseBatch: release reference of batch and its messages, keeping it for reuse at last */
+void SubProcess_Manager::releaseBatch(SubProcess_Batch *batch)
+{
+   int i;
+   SubProcess_Batch *head;
+
+   if(__atomic_sub_fetch(&batch->refs, 1, __ATOMIC_ACQ_REL) > 0)
+      return;
+
+   for(i = 0; i < batch->num; i++)
+      SubProcess_Slab::release(batch->msgs[i]);
+   batch->num = 0;
+
+   releaseSnapshot(batch->snapshot);
+   batch->snapshot = NULL;
+
+   head = __atomic_load_n(&m_spare, __ATOMIC_RELAXED);
+   do {
+      batch->next = head;
+   } while(__atomic_compare_exchange_n(&m_spare, &head, batch, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED) == false);
+}
+
+/* SubProcess_Manager::distribute: choose worker of group for each message of batch, from running workers in snapshot */
+void SubProcess_Manager::distribute(SubProcess_Group *group, SubProcess_Batch *batch)
+{
+   int i, j, x, num = 0, argslen;
+   SubProcess_Link *link;
+   SubProcess_Message *msg;
+   SubProcess_Snapshot *snapshot = batch->snapshot;
+
+   if(batch->num > group->size) {
+      group->size = batch->size;
+      group->assign = (int *) realloc(group->assign, sizeof(int) * group->size);
+   }
+
+   /* standbys of a worker are given its messages, so that they are not chosen */
+   for(j = 0; j < snapshot->num && num < SUBPROCESSOPTION_MAXWORKERS; j++) {
+      link = snapshot->procs[j];
+      if(link->group != group || link->proc.isStandby() == true || link->proc.isRunning() == false)
+         continue;
+      if(group->balance == SUBPROCESSOPTION_BALANCE_LEAST) {
+         glfwLockMutex(link->mutex);
+         group->loads[num] = link->proc.getOutstanding();
+         glfwUnlockMutex(link->mutex);
       }
+      group->members[num++] = link;
+   }
 
-      free(type);
-      free(args);
-      free(buff);
+   if(num > 0)
+      glfwLockMutex(group->members[0]->mutex);
+   for(i = 0; i < batch->num; i++) {
+      msg = batch->msgs[i];
+      group->assign[i] = -1;
+      /* requests go to their worker by alias, and workers share subscription */
+      if(num == 0 || msg->target != NULL || group->members[0]->proc.accepts(msg->type) == false)
+         continue;
+      switch(group->balance) {
+      case SUBPROCESSOPTION_BALANCE_KEY:
+         argslen = msg->len - msg->typelen - 2;
+         x = ownerOf(group->members, num, keyHash(msg->line + msg->typelen + 1, (argslen > 0) ? argslen : 0, group->key));
+         break;
+      case SUBPROCESSOPTION_BALANCE_ROUNDROBIN:
+         x = group->cursor++ % num;
+         break;
+      default:
+         /* fewest bytes not yet read, in turn among equal ones */
+         x = group->cursor % num;
+         for(j = 1; j < num; j++)
+            if(group->loads[(group->cursor + j) % num] < group->loads[x])
+               x = (group->cursor + j) % num;
+         group->cursor = x + 1;
+         group->loads[x] += msg->len;
+         break;
+      }
+      group->assign[i] = group->members[x]->member;
    }
+   if(num > 0)
+      glfwUnlockMutex(group->members[0]->mutex);
 }
 
-/* SubProcess_Manager::isRunning: check running */
-bool SubProcess_Manager::isRunning()
+/* SubProcess_Manager::dispatch: write batch to subprocesses of shard of writer */
+void SubProcess_Manager::dispatch(SubProcess_Writer *writer, SubProcess_Batch *batch)
 {
-   if (m_kill == true || m_mutex == NULL || m_mutex2 == NULL || m_cond == NULL || m_thread < 0)
-      return false;
-   else
-      return true;
+   int i, j, n;
+   double now, t;
+   SubProcess_Link *link;
+   SubProcess_Group *group;
+   SubProcess_Message *msg;
+   SubProcess_Snapshot *snapshot = batch->snapshot;
+   SubProcStats_Proc *stats;
+
+   if(batch->num > writer->size) {
+      writer->size = batch->size;
+      writer->msgs = (SubProcess_Message **) realloc(writer->msgs, sizeof(SubProcess_Message *) * writer->size);
+   }
+   writer->round++;
+
+   for(j = 0; snapshot != NULL && j < snapshot->num; j++) {
+      link = snapshot->procs[j];
+      if(m_writers != NULL && link->shard != writer->index)
+         continue;
+      if(link->proc.isRunning() == false) {
+         /* discard thread not running */
+         discard(link);
+         continue;
+      }
+
+      /* workers of a group are on a shard, where their messages are chosen once in a dispatch */
+      group = link->group;
+      if(group != NULL && group->round != writer->round) {
+         group->round = writer->round;
+         distribute(group, batch);
+      }
+
+      /* send subscribed messages to thread at once */
+      glfwLockMutex(link->mutex);
+      n = 0;
+      for(i = 0; i < batch->num; i++) {
+         msg = batch->msgs[i];
+         if(msg->target != NULL) {
+            /* requests go to their subprocess only, regardless of subscription */
+            if(msg->targetHash == link->hash && MMDAgent_strequal(msg->target, link->proc.getName()) == true)
+               writer->msgs[n++] = msg;
+         } else if((group == NULL || group->assign[i] == link->member) && msg->time >= link->since && link->proc.accepts(msg->type) == true) {
+            writer->msgs[n++] = msg;
+         }
+      }
+      if(n > 0 || link->proc.getFlushTime() > 0.0)
+         link->proc.putv(writer->msgs, n);
+      glfwUnlockMutex(link->mutex);
+
+      /* report requests past deadline */
+      t = link->proc.getCallDeadline();
+      if(t > 0.0 && t <= glfwGetTime())
+         link->proc.expireCalls(glfwGetTime());
+
+      stats = link->proc.getStats();
+      if(stats != NULL && n > 0) {
+         now = glfwGetTime();
+         for(i = 0; i < n; i++)
+            subprocstats_record(&stats->dispatch, (now - writer->msgs[i]->time) * 1000000.0);
+      }
+   }
 }
 
-/* SubProcess_Manager::startProcess: start subprocess by creating socketpair */
-void SubProcess_Manager::startProcess(const char *str)
+/* SubProcess_Manager::queue: pass batch to dispatcher thread, waiting while its queue is full */
+void SubProcess_Manager::queue(SubProcess_Writer *writer, SubProcess_Batch *batch)
 {
-   SubProcess_Link *newlink, *link, *prev = NULL;
+   bool wake;
+
+   glfwLockMutex(writer->mutex);
 
-   newlink = new SubProcess_Link;
-   newlink->proc.loadAndStart(m_mmdagent, str);
-   if(newlink->proc.isRunning() == false) {
-      delete newlink;
+   while(writer->numBatches >= SUBPROCESSMANAGER_MAXBATCHES && writer->kill == false)
+      glfwWaitCond(writer->cond, writer->mutex, GLFW_INFINITY);
+
+   if(writer->kill == true) {
+      glfwUnlockMutex(writer->mutex);
+      releaseBatch(batch);
       return;
    }
 
-   glfwLockMutex(m_mutex2);
+   writer->batches[(writer->first + writer->numBatches) % SUBPROCESSMANAGER_MAXBATCHES] = batch;
+   writer->numBatches++;
 
-   for(link = m_procs; link != NULL; link = link->next) {
-      if(link->proc.checkName(str) == true)
-         break;
-      prev = link;
+   /* only the first batch after sleep wakes it up */
+   wake = writer->waiting;
+   writer->waiting = false;
+
+   glfwUnlockMutex(writer->mutex);
+
+   if(wake == true)
+      eventfd_write(writer->eventfd, 1);
+}
+
+/* SubProcess_Manager::startWriters: start dispatcher threads */
+bool SubProcess_Manager::startWriters(int num)
+{
+   int i;
+   SubProcess_Writer *writer;
+
+   /* manager thread writes by itself */
+   if(num <= 1)
+      return true;
+
+   m_writers = (SubProcess_Writer *) calloc(num, sizeof(SubProcess_Writer));
+   m_numWriters = num;
+   for(i = 0; i < num; i++) {
+      writer = &m_writers[i];
+      writer->manager = this;
+      writer->index = i;
+      writer->thread = -1;
+      writer->mutex = glfwCreateMutex();
+      writer->cond = glfwCreateCond();
+      writer->eventfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+   }
+   for(i = 0; i < num; i++) {
+      writer = &m_writers[i];
+      if(writer->mutex == NULL || writer->cond == NULL || writer->eventfd < 0)
+         return false;
+      writer->thread = glfwCreateThread(writerThread, writer);
+      if(writer->thread < 0)
+         return false;
    }
 
-   if(link != NULL)
-      /* replace existing thread if name is already used */
-      newlink->next = link->next;
-   else
-      /* add new thread to the end of the list */
-      newlink->next = NULL;
+   return true;
+}
 
-   if(prev == NULL)
-      m_procs = newlink;
-   else
-      prev->next = newlink;
+/* SubProcess_Manager::stopWriters: stop dispatcher threads and release their queues */
+void SubProcess_Manager::stopWriters()
+{
+   int i;
+   SubProcess_Writer *writer;
+
+   for(i = 0; i < m_numWriters; i++) {
+      writer = &m_writers[i];
+      if(writer->mutex != NULL) {
+         glfwLockMutex(writer->mutex);
+         writer->kill = true;
+         glfwUnlockMutex(writer->mutex);
+      }
+      if(writer->eventfd >= 0)
+         eventfd_write(writer->eventfd, 1);
+      if(writer->thread >= 0) {
+         glfwWaitThread(writer->thread, GLFW_WAIT);
+         glfwDestroyThread(writer->thread);
+      }
+      for(; writer->numBatches > 0; writer->numBatches--) {
+         releaseBatch(writer->batches[writer->first]);
+         writer->first = (writer->first + 1) % SUBPROCESSMANAGER_MAXBATCHES;
+      }
+      if(writer->mutex != NULL)
+         glfwDestroyMutex(writer->mutex);
+      if(writer->cond != NULL)
+         glfwDestroyCond(writer->cond);
+      if(writer->eventfd >= 0)
+         close(writer->eventfd);
+      free(writer->msgs);
+      free(writer->pfd);
+   }
+
+   free(m_writers);
+   m_writers = NULL;
+   m_numWriters = 0;
+}
 
-   glfwUnlockMutex(m_mutex2);
+/* SubProcess_Manager::push: enqueue formatted message to its lane and wake up manager thread, releasing it on failure */
+bool SubProcess_Manager::push(SubProcess_Message *msg)
+{
+   int lane;
 
-   if(link != NULL)
-      delete link;
+   /* lanes are fixed while running, so that producers read them without lock */
+   lane = m_lanes.match(msg->type);
+   if(lane < 0)
+      lane = SUBPROCESSMANAGER_LANES - 1;
+
+   if(m_rings[lane].enqueue(msg) == false) {
+      SubProcess_Slab::release(msg);
+      return false;
+   }
+   if(m_stats.getSegment() != NULL) {
+      subprocstats_add(&m_stats.getSegment()->enqueued, 1);
+      subprocstats_add(&m_stats.getSegment()->laneEnqueued[lane], 1);
+   }
+   return true;
 }
 
-/* SubProcess_Manager::stopProcess: stop subprocess and close socketpair */
-void SubProcess_Manager::stopProcess(const char *str)
+/* SubProcess_Manager::chooseShard: choose dispatcher thread with fewest subprocesses, with registry locked */
+int SubProcess_Manager::chooseShard()
 {
-   SubProcess_Link *link, *prev = NULL;
+   int i, j, n, shard = 0, min = -1;
 
-   glfwLockMutex(m_mutex2);
+   for(i = 0; i < m_numWriters; i++) {
+      n = 0;
+      for(j = 0; m_snapshot != NULL && j < m_snapshot->num; j++)
+         if(m_snapshot->procs[j]->shard == i)
+            n++;
+      if(min < 0 || n < min) {
+         min = n;
+         shard = i;
+      }
+   }
 
-   for(link = m_procs; link != NULL; link = link->next) {
-      if(link->proc.checkName(str) == true) {
-         /* remove link from thread list */
-         if(prev == NULL)
-            m_procs = link->next;
-         else
-            prev->next = link->next;
+   return shard;
+}
 
-         break;
+/* SubProcess_Manager::run: main loop */
+void SubProcess_Manager::run()
+{
+   int i;
+   SubProcess_Batch *batch;
+
+   while(m_kill == false) {
+      /* wait messages from main program */
+      if(isIdle() == true) {
+         wait((m_writers == NULL) ? &m_writer : NULL);
+         continue;
+      }
+
+      /* dequeue events, urgent ones first */
+      batch = drain();
+
+      if(m_writers == NULL) {
+         dispatch(&m_writer, batch);
+         releaseBatch(batch);
+      } else {
+         /* each dispatcher thread writes batches in order to its shard */
+         batch->refs = m_numWriters;
+         for(i = 0; i < m_numWriters; i++)
+            queue(&m_writers[i], batch);
       }
-      prev = link;
    }
+}
 
-   glfwUnlockMutex(m_mutex2);
+/* SubProcess_Manager::runWriter: main loop of dispatcher thread */
+void SubProcess_Manager::runWriter(SubProcess_Writer *writer)
+{
+   SubProcess_Batch *batch;
 
-   if (link != NULL) {
-      link->proc.stopAndRelease();
-      delete link;
+   while(true) {
+      glfwLockMutex(writer->mutex);
+      if(writer->kill == true) {
+         glfwUnlockMutex(writer->mutex);
+         break;
+      }
+      batch = NULL;
+      if(writer->numBatches > 0) {
+         batch = writer->batches[writer->first];
+         writer->first = (writer->first + 1) % SUBPROCESSMANAGER_MAXBATCHES;
+         if(writer->numBatches-- == SUBPROCESSMANAGER_MAXBATCHES)
+            glfwSignalCond(writer->cond);
+      }
+      glfwUnlockMutex(writer->mutex);
+
+      if(batch == NULL) {
+         wait(writer);
+         continue;
+      }
+
+      dispatch(writer, batch);
+      releaseBatch(batch);
    }
 }
 
-/* SubProcess_Manager::enqueueBuffer: enqueue buffer to send */
-void SubProcess_Manager::enqueueBuffer(const char *type, const char *args)
+/* SubProcess_Manager::runStandby: main loop of standby thread */
+void SubProcess_Manager::runStandby()
 {
+   int i, n;
+   double now, wait;
+   char *args, name[MMDAGENT_MAXBUFLEN];
+   SubProcess_Link *link, *next, *primary, *standby, **p, *replaced, *sibling;
+   SubProcess_Group *group;
+   SubProcess_Registration *reg;
+   SubProcess_Snapshot *old;
+
    glfwLockMutex(m_mutex);
+   while(m_kill == false) {
+      /* free subprocesses given up by failover, which waits for their readers */
+      if(m_retired != NULL) {
+         link = m_retired;
+         m_retired = NULL;
+         glfwUnlockMutex(m_mutex);
+         for(; link != NULL; link = next) {
+            next = link->next;
+            releaseLink(link);
+         }
+         glfwLockMutex(m_mutex);
+         continue;
+      }
 
-   /* enqueue event */
-   m_queue.enqueue(type, args);
+      /* stop subprocess launched on demand when no message of its types arrived for idle period, to be launched again by next one */
+      now = glfwGetTime();
+      wait = GLFW_INFINITY;
+      for(reg = m_registered, link = NULL; reg != NULL; reg = reg->next) {
+         if(reg->idleTimeout <= 0.0 || (link = findLink(reg->name, reg->hash)) == NULL || link->registered == false)
+            continue;
+         if(reg->lastUsed + reg->idleTimeout <= now)
+            break;
+         if(reg->lastUsed + reg->idleTimeout - now < wait)
+            wait = reg->lastUsed + reg->idleTimeout - now;
+      }
+      if(reg != NULL) {
+         dropStandbys(link);
+         removeLink(link);
+         link->notify = true;
+         old = rebuild(NULL, link);
+         glfwUnlockMutex(m_mutex);
+         releaseSnapshot(old);
+         releaseLink(link);
+         glfwLockMutex(m_mutex);
+         continue;
+      }
 
-   /* start message dispatcher thread */
-   glfwSignalCond(m_cond);
+      /* launch registered subprocess for which messages are kept */
+      for(reg = m_registered; reg != NULL; reg = reg->next) {
+         if(reg->numPending == 0)
+            continue;
+         if(reg->respawn <= now)
+            break;
+         if(reg->respawn - now < wait)
+            wait = reg->respawn - now;
+      }
+      if(reg != NULL) {
+         launch(reg);
+         continue;
+      }
 
-   glfwUnlockMutex(m_mutex);
+      /* find primary short of standbys */
+      primary = NULL;
+      for(i = 0; i < SUBPROCESSMANAGER_BUCKETS && primary == NULL; i++) {
+         for(link = m_table[i]; link != NULL; link = link->next) {
+            for(n = 0, standby = link->standby; standby != NULL; standby = standby->standby, n++);
+            if(n >= link->replicas)
+               continue;
+            if(link->respawn <= now) {
+               primary = link;
+               break;
+            }
+            if(link->respawn - now < wait)
+               wait = link->respawn - now;
+         }
+      }
+
+      /* find group short of workers, whose failed worker may be failing over */
+      for(group = m_groups, n = 0; group != NULL && primary == NULL; group = group->next) {
+         for(n = 0; n < group->workers; n++) {
+            snprintf(name, MMDAGENT_MAXBUFLEN, "%s%c%d", group->name, SUBPROCESSMANAGER_WORKERMARK, n);
+            link = findLink(name, SubProcess_Filter::hash(name, MMDAgent_strlen(name)));
+            if(link == NULL || (link->proc.isRunning() == false && link->standby == NULL))
+               break;
+         }
+         if(n >= group->workers)
+            continue;
+         if(group->respawn <= now)
+            break;
+         if(group->respawn - now < wait)
+            wait = group->respawn - now;
+      }
+      if(primary == NULL && group != NULL) {
+         __atomic_add_fetch(&group->refs, 1, __ATOMIC_RELAXED);
+         glfwUnlockMutex(m_mutex);
+
+         /* launch without lock, group may be stopped meanwhile */
+         link = newWorker(group, n);
+
+         glfwLockMutex(m_mutex);
+         old = NULL;
+         replaced = NULL;
+         if(link == NULL) {
+            group->respawn = glfwGetTime() + SUBPROCESSMANAGER_STANDBYRETRY;
+         } else if(findGroup(group->name, group->hash) != group || ((replaced = findLink(link->proc.getName(), link->hash)) != NULL && (replaced->proc.isRunning() == true || replaced->standby != NULL))) {
+            link->next = m_retired;
+            m_retired = link;
+            replaced = NULL;
+         } else {
+            /* settings of group are taken from another worker */
+            for(i = 0, sibling = NULL; i < SUBPROCESSMANAGER_BUCKETS && sibling == NULL; i++)
+               for(sibling = m_table[i]; sibling != NULL && sibling->group != group; sibling = sibling->next);
+            if(sibling != NULL)
+               adopt(link, sibling, false);
+            old = insert(link, &replaced);
+         }
+         glfwUnlockMutex(m_mutex);
+
+         releaseSnapshot(old);
+         releaseLink(replaced);
+         releaseGroup(group);
+
+         glfwLockMutex(m_mutex);
+         continue;
+      }
+      if(primary == NULL) {
+         glfwWaitCond(m_standbyCond, m_mutex, wait);
+         continue;
+      }
+      __atomic_add_fetch(&primary->refs, 1, __ATOMIC_RELAXED);
+      args = MMDAgent_strdup(primary->args);
+      glfwUnlockMutex(m_mutex);
+
+      /* launch without lock, primary may be stopped meanwhile */
+      standby = newLink(args, true);
+      free(args);
+
+      glfwLockMutex(m_mutex);
+      old = NULL;
+      for(n = 0, p = &primary->standby; *p != NULL; p = &(*p)->standby, n++);
+      if(standby == NULL) {
+         primary->respawn = glfwGetTime() + SUBPROCESSMANAGER_STANDBYRETRY;
+      } else if(findLink(primary->proc.getName(), primary->hash) != primary || n >= primary->replicas) {
+         standby->next = m_retired;
+         m_retired = standby;
+         standby = NULL;
+      } else {
+         /* receive input from now on */
+         *p = standby;
+         standby->primary = primary;
+         if(primary->group != NULL) {
+            /* standby of worker is given the messages of it */
+            joinGroup(standby, primary->group, primary->member);
+            standby->shard = primary->group->shard;
+         } else {
+            standby->shard = chooseShard();
+         }
+         adopt(standby, primary, true);
+         old = rebuild(standby, NULL);
+         strncpy(name, primary->proc.getName(), MMDAGENT_MAXBUFLEN - 1);
+         name[MMDAGENT_MAXBUFLEN - 1] = '\0';
+         n++;
+      }
+      glfwUnlockMutex(m_mutex);
+
+      releaseSnapshot(old);
+      if(standby != NULL) {
+         m_mmdagent->sendMessage(SUBPROCESSMANAGER_EVENTSTANDBY, "%s|%d", name, n);
+         if(m_stats.getSegment() != NULL)
+            subprocstats_add(&m_stats.getSegment()->standbys, 1);
+      }
+      releaseLink(primary);
+
+      glfwLockMutex(m_mutex);
+   }
+   glfwUnlockMutex(m_mutex);
+}
+
+/* SubProcess_Manager::retire: pass reference of subprocess to standby thread to be freed there, after its snapshots are released */
+void SubProcess_Manager::retire(SubProcess_Link *link)
+{
+   glfwLockMutex(m_mutex);
+   link->next = m_retired;
+   m_retired = link;
+   if(m_standbyCond != NULL)
+      glfwSignalCond(m_standbyCond);
+   glfwUnlockMutex(m_mutex);
+}
+
+/* SubProcess_Manager::failover: handle hang-up of subprocess, promoting its standby, return true if stop event is taken over */
+bool SubProcess_Manager::failover(SubProcess_Link *link)
+{
+   int n = 0;
+   double start = glfwGetTime(), usec;
+   char name[MMDAGENT_MAXBUFLEN];
+   SubProcess_Link *standby, *next, **p;
+   SubProcess_Snapshot *old;
+
+   if(m_kill == true)
+      return false;
+
+   glfwLockMutex(m_mutex);
+
+   if(link->primary != NULL) {
+      /* standby stopped, another one is launched after a while */
+      for(p = &link->primary->standby; *p != NULL; p = &(*p)->standby) {
+         if(*p == link) {
+            *p = link->standby;
+            break;
+         }
+      }
+      link->primary->respawn = start + SUBPROCESSMANAGER_STANDBYRETRY;
+      link->primary = NULL;
+      link->standby = NULL;
+      old = rebuild(NULL, link);
+      glfwUnlockMutex(m_mutex);
+      releaseSnapshot(old);
+      retire(link);
+      return true;
+   }
+
+   if(link->standby == NULL || findLink(link->proc.getName(), link->hash) != link) {
+      if(link->group != NULL && findLink(link->proc.getName(), link->hash) == link) {
+         /* worker is launched again after a while, taking back its keys */
+         link->group->respawn = start + SUBPROCESSMANAGER_STANDBYRETRY;
+         if(m_standbyCond != NULL)
+            glfwSignalCond(m_standbyCond);
+      }
+      glfwUnlockMutex(m_mutex);
+      return false;
+   }
+
+   /* first standby has received the same input, so that it only starts to forward output */
+   standby = link->standby;
+   removeLink(link);
+   standby->next = m_table[standby->hash % SUBPROCESSMANAGER_BUCKETS];
+   m_table[standby->hash % SUBPROCESSMANAGER_BUCKETS] = standby;
+   standby->primary = NULL;
+   link->standby = NULL;
+   for(next = standby->standby; next != NULL; next = next->standby, n++)
+      next->primary = standby;
+
+   /* settings of primary are taken over */
+   standby->replicas = link->replicas;
+   standby->args = link->args;
+   standby->subscription = link->subscription;
+   standby->coalesce = link->coalesce;
+   standby->standbyTypes = link->standbyTypes;
+   standby->registered = link->registered;
+   link->args = link->subscription = link->coalesce = link->standbyTypes = NULL;
+   if(standby->standbyTypes != NULL)
+      configure(standby, standby, true);
+   standby->proc.promote(&link->proc);
+   strncpy(name, standby->proc.getName(), MMDAGENT_MAXBUFLEN - 1);
+   name[MMDAGENT_MAXBUFLEN - 1] = '\0';
+
+   old = rebuild(NULL, link);
+
+   glfwUnlockMutex(m_mutex);
+
+   /* failed primary is freed by standby thread, which also launches a new standby */
+   releaseSnapshot(old);
+   retire(link);
+
+   usec = (glfwGetTime() - start) * 1000000.0;
+   if(m_stats.getSegment() != NULL) {
+      subprocstats_add(&m_stats.getSegment()->failovers, 1);
+      subprocstats_record(&m_stats.getSegment()->failover, usec);
+   }
+   m_mmdagent->sendMessage(SUBPROCESSMANAGER_EVENTFAILOVER, "%s|%.0f|%d", name, usec, n);
+
+   return true;
+}
+
+/* SubProcess_Manager::watchExit: let reaper send stop event when subprocess which hung up exits, return true if stop event is taken over */
+bool SubProcess_Manager::watchExit(SubProcess_Link *link)
+{
+   if(m_kill == true)
+      return false;
+
+   /* reaper holds subprocess until it sends stop event, reader goes on without waiting */
+   __atomic_add_fetch(&link->refs, 1, __ATOMIC_RELAXED);
+   m_reaper.watch(&link->proc, unwatchLink, link);
+
+   return true;
+}
+
+/* SubProcess_Manager::isRunning: check running */
+bool SubProcess_Manager::isRunning()
+{
+   if (m_kill == true || m_mutex == NULL || m_thread < 0)
+      return false;
+   else
+      return true;
+}
+
+/* SubProcess_Manager::newLink: start subprocess by "alias,options|command", as hot-standby replica if standby is true, NULL on failure */
+SubProcess_Link *SubProcess_Manager::newLink(const char *str, bool standby)
+{
+   int i;
+   SubProcess_Link *link;
+   SubProcess_Reactor *reactor = NULL;
+
+   /* choose the least loaded reactor in epoll mode */
+   for(i = 0; i < m_numReactors; i++)
+      if(reactor == NULL || m_reactors[i].getNumProcs() < reactor->getNumProcs())
+         reactor = &m_reactors[i];
+
+   link = new SubProcess_Link;
+   link->proc.loadAndStart(m_mmdagent, &m_procs, str, reactor, &m_pool, &m_stats, &m_recorder, standby);
+   if(link->proc.isRunning() == false) {
+      delete link;
+      return NULL;
+   }
+   link->manager = this;
+   link->hash = SubProcess_Filter::hash(link->proc.getName(), MMDAgent_strlen(link->proc.getName()));
+   link->refs = 1;
+   link->shard = 0;
+   link->notify = false;
+   link->mutex = glfwCreateMutex();
+   link->next = NULL;
+
+   link->registered = false;
+   link->since = 0.0;
+
+   link->replicas = (standby == false) ? link->proc.getStandbys() : 0;
+   link->args = (link->replicas > 0) ? MMDAgent_strdup(str) : NULL;
+   link->respawn = 0.0;
+   link->subscription = NULL;
+   link->coalesce = NULL;
+   link->standbyTypes = NULL;
+   link->primary = NULL;
+   link->standby = NULL;
+
+   link->group = NULL;
+   link->member = 0;
+   link->points = NULL;
+
+   /* hang-up before this is found by dispatcher */
+   link->proc.setHangup(hangupLink, link);
+
+   return link;
+}
+
+/* SubProcess_Manager::configure: give filter of primary, or subset for standbys unless promoted, to standby, with registry locked */
+void SubProcess_Manager::configure(SubProcess_Link *standby, SubProcess_Link *primary, bool promoted)
+{
+   glfwLockMutex(standby->mutex);
+   if(promoted == false && primary->standbyTypes != NULL)
+      standby->proc.subscribe(primary->standbyTypes);
+   else if(primary->subscription != NULL)
+      standby->proc.subscribe(primary->subscription);
+   else
+      standby->proc.subscribe(primary->proc.getName()); /* alias only clears filter */
+   glfwUnlockMutex(standby->mutex);
+}
+
+/* SubProcess_Manager::adopt: give filter and coalesce rules of subprocess to its standby, or to another worker of its group, with registry locked */
+void SubProcess_Manager::adopt(SubProcess_Link *link, SubProcess_Link *from, bool standby)
+{
+   char *args, *line, *end;
+
+   configure(link, from, standby == false);
+   if(from->coalesce != NULL) {
+      args = MMDAgent_strdup(from->coalesce);
+      for(line = args; line != NULL; line = end) {
+         end = strchr(line, '\n');
+         if(end != NULL)
+            *end++ = '\0';
+         link->proc.coalesce(line);
+      }
+      free(args);
+   }
+
+   /* worker keeps them for its standbys */
+   if(standby == false) {
+      link->subscription = MMDAgent_strdup(from->subscription);
+      link->coalesce = MMDAgent_strdup(from->coalesce);
+      link->standbyTypes = MMDAgent_strdup(from->standbyTypes);
+   }
+}
+
+/* SubProcess_Manager::dropStandbys: remove standbys of primary from snapshot, leaving them to be freed with it, with registry locked */
+void SubProcess_Manager::dropStandbys(SubProcess_Link *link)
+{
+   SubProcess_Link *standby;
+
+   for(standby = link->standby; standby != NULL; standby = standby->standby) {
+      standby->primary = NULL;
+      /* standby is still referenced by primary, so that nothing is freed with registry locked */
+      releaseSnapshot(rebuild(NULL, standby));
+   }
+}
+
+/* SubProcess_Manager::newWorker: start worker of group by index, NULL on failure */
+SubProcess_Link *SubProcess_Manager::newWorker(SubProcess_Group *group, int member)
+{
+   int n;
+   char *args;
+   SubProcess_Link *link;
+
+   /* "alias#N" followed by options and command of group */
+   n = strcspn(group->args, ",|");
+   args = (char *) malloc(sizeof(char) * (strlen(group->args) + 16));
+   sprintf(args, "%.*s%c%d%s", n, group->args, SUBPROCESSMANAGER_WORKERMARK, member, group->args + n);
+   link = newLink(args, false);
+   free(args);
+
+   if(link != NULL)
+      joinGroup(link, group, member);
+
+   return link;
+}
+
+/* SubProcess_Manager::pick: choose running worker of group for a request with args, with registry locked, NULL if none */
+SubProcess_Link *SubProcess_Manager::pick(SubProcess_Group *group, const char *args)
+{
+   int i, x = 0, num = 0;
+   unsigned long load, min = 0;
+   SubProcess_Link *members[SUBPROCESSOPTION_MAXWORKERS], *link;
+
+   for(i = 0; m_snapshot != NULL && i < m_snapshot->num && num < SUBPROCESSOPTION_MAXWORKERS; i++) {
+      link = m_snapshot->procs[i];
+      if(link->group == group && link->proc.isStandby() == false && link->proc.isRunning() == true)
+         members[num++] = link;
+   }
+   if(num == 0)
+      return NULL;
+
+   if(group->balance == SUBPROCESSOPTION_BALANCE_KEY)
+      return members[ownerOf(members, num, keyHash(args, MMDAgent_strlen(args), group->key))];
+
+   /* requests of other balances go to worker with fewest bytes not yet read */
+   for(i = 0; i < num; i++) {
+      glfwLockMutex(members[i]->mutex);
+      load = members[i]->proc.getOutstanding();
+      glfwUnlockMutex(members[i]->mutex);
+      if(i == 0 || load < min) {
+         min = load;
+         x = i;
+      }
+   }
+
+   return members[x];
+}
+
+/* SubProcess_Manager::insert: register subprocess replacing one of the same alias, with registry locked, return old snapshot and replaced one */
+SubProcess_Snapshot *SubProcess_Manager::insert(SubProcess_Link *link, SubProcess_Link **replaced)
+{
+   SubProcess_Link *prev;
+
+   prev = findLink(link->proc.getName(), link->hash);
+   if(prev != NULL) {
+      dropStandbys(prev);
+      removeLink(prev);
+   }
+   link->shard = (link->group != NULL) ? link->group->shard : chooseShard();
+   link->next = m_table[link->hash % SUBPROCESSMANAGER_BUCKETS];
+   m_table[link->hash % SUBPROCESSMANAGER_BUCKETS] = link;
+
+   /* launch standbys in background */
+   if(link->replicas > 0 && m_standbyCond != NULL)
+      glfwSignalCond(m_standbyCond);
+
+   *replaced = prev;
+   return rebuild(link, prev);
+}
+
+/* SubProcess_Manager::findGroup: find group by alias, with registry locked */
+SubProcess_Group *SubProcess_Manager::findGroup(const char *name, unsigned long hash)
+{
+   SubProcess_Group *group;
+
+   for(group = m_groups; group != NULL; group = group->next)
+      if(group->hash == hash && MMDAgent_strequal(group->name, name))
+         return group;
+
+   return NULL;
+}
+
+/* SubProcess_Manager::removeGroup: remove group and its workers from registry, with registry locked, return workers to be released */
+int SubProcess_Manager::removeGroup(SubProcess_Group *group, SubProcess_Link **links, bool notify)
+{
+   int i, num = 0;
+   SubProcess_Link *link;
+   SubProcess_Group **p;
+
+   for(p = &m_groups; *p != NULL; p = &(*p)->next) {
+      if(*p == group) {
+         *p = group->next;
+         group->next = NULL;
+         break;
+      }
+   }
+
+   for(i = 0; i < SUBPROCESSMANAGER_BUCKETS; i++)
+      for(link = m_table[i]; link != NULL && num < SUBPROCESSOPTION_MAXWORKERS; link = link->next)
+         if(link->group == group)
+            links[num++] = link;
+
+   for(i = 0; i < num; i++) {
+      dropStandbys(links[i]);
+      removeLink(links[i]);
+      links[i]->notify = notify;
+      /* workers are still referenced by caller, so that nothing is freed with registry locked */
+      releaseSnapshot(rebuild(NULL, links[i]));
+   }
+
+   return num;
+}
+
+/* SubProcess_Manager::gather: get references of subprocess by "alias|...", or of workers if alias is a group, return number of them */
+int SubProcess_Manager::gather(const char *str, SubProcess_Link **links)
+{
+   int i, num = 0;
+   char name[MMDAGENT_MAXBUFLEN];
+   unsigned long hash;
+   SubProcess_Link *link;
+   SubProcess_Group *group;
+
+   SubProcess_Thread::getAlias(str, name);
+   hash = SubProcess_Filter::hash(name, MMDAgent_strlen(name));
+
+   glfwLockMutex(m_mutex);
+   link = findLink(name, hash);
+   if(link != NULL) {
+      links[num++] = link;
+   } else if((group = findGroup(name, hash)) != NULL) {
+      for(i = 0; i < SUBPROCESSMANAGER_BUCKETS; i++)
+         for(link = m_table[i]; link != NULL && num < SUBPROCESSOPTION_MAXWORKERS; link = link->next)
+            if(link->group == group)
+               links[num++] = link;
+   }
+   for(i = 0; i < num; i++)
+      __atomic_add_fetch(&links[i]->refs, 1, __ATOMIC_RELAXED);
+   glfwUnlockMutex(m_mutex);
+
+   return num;
+}
+
+/* SubProcess_Manager::findLink: find registered subprocess by alias, with registry locked */
+SubProcess_Link *SubProcess_Manager::findLink(const char *name, unsigned long hash)
+{
+   SubProcess_Link *link;
+
+   for(link = m_table[hash % SUBPROCESSMANAGER_BUCKETS]; link != NULL; link = link->next)
+      if(link->hash == hash && MMDAgent_strequal(link->proc.getName(), name))
+         return link;
+
+   return NULL;
+}
+
+/* SubProcess_Manager::removeLink: remove subprocess from registry, with registry locked */
+void SubProcess_Manager::removeLink(SubProcess_Link *link)
+{
+   SubProcess_Link **p;
+
+   for(p = &m_table[link->hash % SUBPROCESSMANAGER_BUCKETS]; *p != NULL; p = &(*p)->next) {
+      if(*p == link) {
+         *p = link->next;
+         link->next = NULL;
+         break;
+      }
+   }
+}
+
+/* SubProcess_Manager::rebuild: replace snapshot with a copy where link is added, or replaced or removed, with registry locked, and return old one */
+SubProcess_Snapshot *SubProcess_Manager::rebuild(SubProcess_Link *add, SubProcess_Link *remove)
+{
+   int i, num = 0, size;
+   SubProcess_Snapshot *old = m_snapshot, *snapshot;
+
+   size = ((old != NULL) ? old->num : 0) + 1;
+   snapshot = (SubProcess_Snapshot *) malloc(sizeof(SubProcess_Snapshot) + sizeof(SubProcess_Link *) * size);
+   snapshot->procs = (SubProcess_Link **) (snapshot + 1);
+
+   /* replaced subprocess keeps its place */
+   for(i = 0; old != NULL && i < old->num; i++) {
+      if(old->procs[i] == remove) {
+         if(add != NULL) {
+            snapshot->procs[num++] = add;
+            add = NULL;
+         }
+      } else {
+         snapshot->procs[num++] = old->procs[i];
+      }
+   }
+   if(add != NULL)
+      snapshot->procs[num++] = add;
+
+   for(i = 0; i < num; i++)
+      __atomic_add_fetch(&snapshot->procs[i]->refs, 1, __ATOMIC_RELAXED);
+   snapshot->num = num;
+   snapshot->refs = 1;
+
+   if(num == 0) {
+      free(snapshot);
+      snapshot = NULL;
+   }
+
+   m_snapshot = snapshot;
+   return old;
+}
+
+/* SubProcess_Manager::acquire: get reference of current snapshot */
+SubProcess_Snapshot *SubProcess_Manager::acquire()
+{
+   SubProcess_Snapshot *snapshot;
+
+   glfwLockMutex(m_mutex);
+   snapshot = m_snapshot;
+   if(snapshot != NULL)
+      __atomic_add_fetch(&snapshot->refs, 1, __ATOMIC_RELAXED);
+   glfwUnlockMutex(m_mutex);
+
+   return snapshot;
+}
+
+/* SubProcess_Manager::reference: get reference of registered subprocess by "alias|..." */
+SubProcess_Link *SubProcess_Manager::reference(const char *str)
+{
+   char name[MMDAGENT_MAXBUFLEN];
+   SubProcess_Link *link;
+
+   SubProcess_Thread::getAlias(str, name);
+
+   glfwLockMutex(m_mutex);
+   link = findLink(name, SubProcess_Filter::hash(name, MMDAgent_strlen(name)));
+   if(link != NULL)
+      __atomic_add_fetch(&link->refs, 1, __ATOMIC_RELAXED);
+   glfwUnlockMutex(m_mutex);
+
+   return link;
+}
+
+/* SubProcess_Manager::discard: remove subprocess not running from registry */
+void SubProcess_Manager::discard(SubProcess_Link *link)
+{
+   SubProcess_Snapshot *old = NULL;
+
+   /* standby takes over, or is replaced */
+   if(failover(link) == true)
+      return;
+
+   glfwLockMutex(m_mutex);
+   /* it may have been replaced or stopped already */
+   if(findLink(link->proc.getName(), link->hash) == link) {
+      dropStandbys(link);
+      removeLink(link);
+      old = rebuild(NULL, link);
+   } else {
+      link = NULL;
+   }
+   glfwUnlockMutex(m_mutex);
+
+   releaseSnapshot(old);
+   if(link != NULL)
+      releaseLink(link);
+}
+
+/* SubProcess_Manager::releaseSnapshot: release reference of snapshot */
+void SubProcess_Manager::releaseSnapshot(SubProcess_Snapshot *snapshot)
+{
+   int i;
+
+   if(snapshot == NULL || __atomic_sub_fetch(&snapshot->refs, 1, __ATOMIC_ACQ_REL) > 0)
+      return;
+
+   for(i = 0; i < snapshot->num; i++)
+      releaseLink(snapshot->procs[i]);
+   free(snapshot);
+}
+
+/* SubProcess_Manager::releaseLink: release reference of subprocess, stopping it at last */
+void SubProcess_Manager::releaseLink(SubProcess_Link *link)
+{
+   if(link == NULL || __atomic_sub_fetch(&link->refs, 1, __ATOMIC_ACQ_REL) > 0)
+      return;
+
+   /* each standby references next one */
+   releaseLink(link->standby);
+   free(link->args);
+   free(link->subscription);
+   free(link->coalesce);
+   free(link->standbyTypes);
+   free(link->points);
+   releaseGroup(link->group);
+
+   /* subprocess is stopped in background, and link is freed after it exited */
+   link->manager->m_reaper.add(&link->proc, link->notify, freeLink, link);
+}
+
+/* SubProcess_Manager::unwatchLink: release reference of subprocess held while reaper waited for its exit after hang-up */
+void SubProcess_Manager::unwatchLink(void *param)
+{
+   releaseLink((SubProcess_Link *) param);
+}
+
+/* SubProcess_Manager::releaseGroup: release reference of group */
+void SubProcess_Manager::releaseGroup(SubProcess_Group *group)
+{
+   if(group == NULL || __atomic_sub_fetch(&group->refs, 1, __ATOMIC_ACQ_REL) > 0)
+      return;
+
+   free(group->name);
+   free(group->args);
+   free(group->assign);
+   free(group);
+}
+
+/* SubProcess_Manager::startGroup: start group of workers by "alias,workers=N,options|command", replacing subprocess or group of the alias */
+void SubProcess_Manager::startGroup(const char *str, SubProcess_Option *option)
+{
+   int i, num = 0;
+   bool missing = false;
+   SubProcess_Group *group, *prev;
+   SubProcess_Link *link, *links[SUBPROCESSOPTION_MAXWORKERS], *replaced[SUBPROCESSOPTION_MAXWORKERS];
+
+   group = (SubProcess_Group *) calloc(1, sizeof(SubProcess_Group));
+   group->name = MMDAgent_strdup(option->getName());
+   group->hash = SubProcess_Filter::hash(group->name, MMDAgent_strlen(group->name));
+   group->args = MMDAgent_strdup(str);
+   group->refs = 1;
+   group->workers = option->getWorkers();
+   group->balance = option->getBalance();
+   group->key = option->getKey();
+
+   /* launch without lock */
+   for(i = 0; i < group->workers; i++) {
+      links[i] = newWorker(group, i);
+      if(links[i] == NULL)
+         missing = true;
+   }
+
+   glfwLockMutex(m_mutex);
+
+   /* replace subprocess or group of the alias, keeping their references until lock is released */
+   link = findLink(group->name, group->hash);
+   if(link != NULL) {
+      dropStandbys(link);
+      removeLink(link);
+      releaseSnapshot(rebuild(NULL, link));
+   }
+   prev = findGroup(group->name, group->hash);
+   if(prev != NULL)
+      num = removeGroup(prev, replaced, false);
+
+   group->shard = chooseShard();
+   group->next = m_groups;
+   m_groups = group;
+   for(i = 0; i < group->workers; i++)
+      if(links[i] != NULL)
+         releaseSnapshot(insert(links[i], &links[i])); /* registry takes reference, replaced one is kept instead */
+   /* failed workers are launched again after a while */
+   if(missing == true) {
+      group->respawn = glfwGetTime() + SUBPROCESSMANAGER_STANDBYRETRY;
+      if(m_standbyCond != NULL)
+         glfwSignalCond(m_standbyCond);
+   }
+
+   glfwUnlockMutex(m_mutex);
+
+   releaseLink(link);
+   for(i = 0; i < group->workers; i++)
+      releaseLink(links[i]);
+   for(i = 0; i < num; i++)
+      releaseLink(replaced[i]);
+   releaseGroup(prev);
+}
+
+/* SubProcess_Manager::startProcess: start subprocess by creating socketpair, or group of workers with workers option */
+void SubProcess_Manager::startProcess(const char *str)
+{
+   int i, num = 0;
+   char *buff, *p;
+   SubProcess_Option option;
+   SubProcess_Link *newlink, *link, *links[SUBPROCESSOPTION_MAXWORKERS];
+   SubProcess_Group *group = NULL;
+   SubProcess_Snapshot *old;
+
+   /* options of alias field */
+   buff = MMDAgent_strdup(str);
+   if(buff != NULL && (p = strchr(buff, SUBPROCESSTHREAD_SEPARATOR)) != NULL)
+      *p = '\0';
+   if(option.parse(buff) == true && option.getWorkers() > 0) {
+      free(buff);
+      startGroup(str, &option);
+      return;
+   }
+   free(buff);
+
+   newlink = newLink(str, false);
+   if(newlink == NULL)
+      return;
+
+   glfwLockMutex(m_mutex);
+
+   /* replace existing thread if name is already used */
+   group = findGroup(newlink->proc.getName(), newlink->hash);
+   if(group != NULL)
+      num = removeGroup(group, links, false);
+   old = insert(newlink, &link);
+
+   glfwUnlockMutex(m_mutex);
+
+   /* replaced thread is freed when dispatcher no longer uses it */
+   releaseSnapshot(old);
+   releaseLink(link);
+   for(i = 0; i < num; i++)
+      releaseLink(links[i]);
+   releaseGroup(group);
+}
+
+/* SubProcess_Manager::stopProcess: stop subprocess and close socketpair, or all workers of group */
+void SubProcess_Manager::stopProcess(const char *str)
+{
+   int i, num = 0;
+   char name[MMDAGENT_MAXBUFLEN];
+   unsigned long hash;
+   SubProcess_Link *link, *links[SUBPROCESSOPTION_MAXWORKERS];
+   SubProcess_Group *group = NULL;
+   SubProcess_Snapshot *old = NULL;
+
+   SubProcess_Thread::getAlias(str, name);
+   hash = SubProcess_Filter::hash(name, MMDAgent_strlen(name));
+
+   glfwLockMutex(m_mutex);
+
+   link = findLink(name, hash);
+   if(link != NULL) {
+      dropStandbys(link);
+      removeLink(link);
+      link->notify = true;
+      old = rebuild(NULL, link);
+   } else {
+      group = findGroup(name, hash);
+      if(group != NULL)
+         num = removeGroup(group, links, true);
+   }
+
+   glfwUnlockMutex(m_mutex);
+
+   /* stopped now, or when dispatcher no longer uses it */
+   releaseSnapshot(old);
+   releaseLink(link);
+   for(i = 0; i < num; i++)
+      releaseLink(links[i]);
+   releaseGroup(group);
+}
+
+/* SubProcess_Manager::prewarmProcess: keep idle subprocesses launched in advance */
+void SubProcess_Manager::prewarmProcess(const char *str)
+{
+   m_pool.configure(str);
+}
+
+/* SubProcess_Manager::subscribeProcess: set message types to be sent to subprocess, or to workers of group */
+void SubProcess_Manager::subscribeProcess(const char *str)
+{
+   int i, num;
+   SubProcess_Link *links[SUBPROCESSOPTION_MAXWORKERS], *link, *standby;
+
+   num = gather(str, links);
+   for(i = 0; i < num; i++) {
+      link = links[i];
+
+      glfwLockMutex(link->mutex);
+      link->proc.subscribe(str);
+      glfwUnlockMutex(link->mutex);
+
+      /* standbys receive the same input unless subset is given */
+      glfwLockMutex(m_mutex);
+      free(link->subscription);
+      link->subscription = MMDAgent_strdup(str);
+      for(standby = link->standby; standby != NULL; standby = standby->standby)
+         configure(standby, link, false);
+      glfwUnlockMutex(m_mutex);
+
+      releaseLink(link);
+   }
+}
+
+/* SubProcess_Manager::registerProcess: register "alias,options|patterns|command" to be started by first message of patterns, and stopped after idle option, or remove registration of "alias" */
+void SubProcess_Manager::registerProcess(const char *str)
+{
+   char *buff, *patterns = NULL, *command = NULL;
+   SubProcess_Option option;
+   SubProcess_Registration *reg = NULL, *head, *prev, **p;
+
+   buff = MMDAgent_strdup(str);
+   if(buff != NULL && (patterns = strchr(buff, SUBPROCESSTHREAD_SEPARATOR)) != NULL) {
+      *patterns++ = '\0';
+      command = strchr(patterns, SUBPROCESSTHREAD_SEPARATOR);
+      if(command != NULL)
+         *command++ = '\0';
+   }
+   if(option.parse(buff) == false) {
+      free(buff);
+      return;
+   }
+
+   /* subprocess is launched with its alias field and subscribes to the patterns */
+   if(MMDAgent_strlen(patterns) > 0 && MMDAgent_strlen(command) > 0) {
+      reg = new SubProcess_Registration;
+      reg->name = MMDAgent_strdup(option.getName());
+      reg->hash = SubProcess_Filter::hash(reg->name, MMDAgent_strlen(reg->name));
+      reg->args = (char *) malloc(sizeof(char) * (strlen(buff) + strlen(command) + 2));
+      sprintf(reg->args, "%s%c%s", buff, SUBPROCESSTHREAD_SEPARATOR, command);
+      reg->subscription = (char *) malloc(sizeof(char) * (strlen(reg->name) + strlen(patterns) + 2));
+      sprintf(reg->subscription, "%s%c%s", reg->name, SUBPROCESSTHREAD_SEPARATOR, patterns);
+      reg->patterns.addList(patterns, 0);
+      reg->idleTimeout = option.getIdleTimeout() / 1000.0;
+      reg->lastUsed = glfwGetTime();
+      reg->respawn = 0.0;
+      reg->pending = (SubProcess_Message **) malloc(sizeof(SubProcess_Message *) * SUBPROCESSMANAGER_MAXPENDING);
+      reg->numPending = 0;
+   }
+
+   /* replace registration of the alias, keeping subprocess launched by it */
+   glfwLockMutex(m_mutex);
+   head = m_registered;
+   for(p = &head; *p != NULL && MMDAgent_strequal((*p)->name, option.getName()) == false; p = &(*p)->next);
+   prev = *p;
+   if(prev != NULL)
+      *p = prev->next;
+   if(reg != NULL) {
+      reg->next = head;
+      head = reg;
+   }
+   /* head is read without lock to skip matching when nothing is registered */
+   __atomic_store_n(&m_registered, head, __ATOMIC_RELAXED);
+   glfwUnlockMutex(m_mutex);
+
+   if(prev != NULL)
+      freeRegistration(prev);
+   free(buff);
+}
+
+/* SubProcess_Manager::coalesceProcess: set message types of which only latest pending value is sent to subprocess, or to workers of group */
+void SubProcess_Manager::coalesceProcess(const char *str)
+{
+   int i, num, len;
+   const char *patterns;
+   char *coalesce;
+   SubProcess_Link *links[SUBPROCESSOPTION_MAXWORKERS], *link, *standby;
+
+   num = gather(str, links);
+   for(i = 0; i < num; i++) {
+      link = links[i];
+
+      glfwLockMutex(link->mutex);
+      link->proc.coalesce(str);
+      glfwUnlockMutex(link->mutex);
+
+      /* rules are kept for standbys since last clear */
+      patterns = strchr(str, SUBPROCESSTHREAD_SEPARATOR);
+      glfwLockMutex(m_mutex);
+      if(patterns == NULL || patterns[1] == '\0' || patterns[1] == SUBPROCESSTHREAD_SEPARATOR) {
+         free(link->coalesce);
+         link->coalesce = NULL;
+      } else if(link->coalesce == NULL) {
+         link->coalesce = MMDAgent_strdup(str);
+      } else {
+         len = MMDAgent_strlen(link->coalesce);
+         coalesce = (char *) malloc(sizeof(char) * (len + MMDAgent_strlen(str) + 2));
+         sprintf(coalesce, "%s\n%s", link->coalesce, str);
+         free(link->coalesce);
+         link->coalesce = coalesce;
+      }
+      for(standby = link->standby; standby != NULL; standby = standby->standby) {
+         glfwLockMutex(standby->mutex);
+         standby->proc.coalesce(str);
+         glfwUnlockMutex(standby->mutex);
+      }
+      glfwUnlockMutex(m_mutex);
+
+      releaseLink(link);
+   }
+}
+
+/* SubProcess_Manager::standbyProcess: set message types to be sent to hot-standby replicas of subprocess, or of workers of group */
+void SubProcess_Manager::standbyProcess(const char *str)
+{
+   int i, num;
+   const char *patterns;
+   SubProcess_Link *links[SUBPROCESSOPTION_MAXWORKERS], *link, *standby;
+
+   /* "alias|patterns", empty list sends the same input as primary */
+   patterns = strchr(str, SUBPROCESSTHREAD_SEPARATOR);
+
+   num = gather(str, links);
+   for(i = 0; i < num; i++) {
+      link = links[i];
+
+      glfwLockMutex(m_mutex);
+      free(link->standbyTypes);
+      link->standbyTypes = (patterns != NULL && patterns[1] != '\0') ? MMDAgent_strdup(str) : NULL;
+      for(standby = link->standby; standby != NULL; standby = standby->standby)
+         configure(standby, link, false);
+      glfwUnlockMutex(m_mutex);
+
+      releaseLink(link);
+   }
+}
+
+/* SubProcess_Manager::callProcess: send request to subprocess, or to a worker of group, by "alias,timeout=msec|reqtype|args" with optional timeout, and report its reply or timeout */
+void SubProcess_Manager::callProcess(const char *str)
+{
+   unsigned long id = 0;
+   const char *name;
+   char *buff, *reqtype, *args, *line;
+   SubProcess_Link *link;
+   SubProcess_Group *group;
+   SubProcess_Message *msg;
+   SubProcess_Option option;
+
+   if(MMDAgent_strlen(str) == 0)
+      return;
+
+   buff = MMDAgent_strdup(str);
+   reqtype = strchr(buff, '|');
+   if(reqtype == NULL) {
+      free(buff);
+      return;
+   }
+   *reqtype++ = '\0';
+
+   /* timeout is an option of alias, so that args are passed as they are */
+   if(option.parse(buff) == false) {
+      free(buff);
+      return;
+   }
+   name = option.getName();
+   args = strchr(reqtype, '|');
+   if(args != NULL)
+      *args++ = '\0';
+   else
+      args = reqtype + strlen(reqtype);
+
+   link = reference(name);
+   if(link == NULL) {
+      /* request to group goes to one of its workers, which replies by its alias */
+      glfwLockMutex(m_mutex);
+      group = findGroup(name, SubProcess_Filter::hash(name, MMDAgent_strlen(name)));
+      if(group != NULL && (link = pick(group, args)) != NULL)
+         __atomic_add_fetch(&link->refs, 1, __ATOMIC_RELAXED);
+      glfwUnlockMutex(m_mutex);
+   }
+   if(link != NULL)
+      id = link->proc.call(reqtype, option.getCallTimeout());
+   if(id == 0) {
+      /* nothing to wait for */
+      m_mmdagent->sendMessage(SUBPROCESSTHREAD_EVENTTIMEOUT, "%s|0|%s", name, reqtype);
+      if(link != NULL)
+         releaseLink(link);
+      free(buff);
+      return;
+   }
+   m_mmdagent->sendMessage(SUBPROCESSMANAGER_EVENTCALL, "%s|%lu|%s", link->proc.getName(), id, reqtype);
+
+   /* "id|reqtype|args" goes through lanes to the subprocess only, so that it keeps order with other messages */
+   line = (char *) malloc(sizeof(char) * (strlen(reqtype) + strlen(args) + 24));
+   sprintf(line, "%lu|%s|%s", id, reqtype, args);
+   msg = m_slab.create(SUBPROCESSTHREAD_REQUEST, line, glfwGetTime(), link->proc.getName());
+   if(msg != NULL)
+      push(msg);
+   free(line);
+
+   releaseLink(link);
+   free(buff);
+}
+
+/* SubProcess_Manager::reportStats: send summary of statistics of plugin, or of subprocess if alias is given */
+void SubProcess_Manager::reportStats(const char *str)
+{
+   int i, n;
+   char buff[MMDAGENT_MAXBUFLEN];
+   SubProcStats_Segment *seg = m_stats.getSegment();
+   SubProcStats_Proc *stats;
+   SubProcess_Link *link;
+   uint64_t enqueued, dequeued;
+
+   if(seg == NULL)
+      return;
+
+   /* plugin: "*|enqueued|depth|batches|wakeups|allocs", "depth|p99" of lanes with wait in usec, and "failovers|p99" in usec */
+   if(MMDAgent_strlen(str) == 0) {
+      /* enqueue is counted after it is visible to dispatcher */
+      dequeued = subprocstats_get(&seg->dequeued);
+      enqueued = subprocstats_get(&seg->enqueued);
+      n = snprintf(buff, sizeof(buff), "*|%llu|%llu|%llu|%llu|%llu",
+                   (unsigned long long) enqueued,
+                   (unsigned long long) ((enqueued > dequeued) ? enqueued - dequeued : 0),
+                   (unsigned long long) subprocstats_get(&seg->batches),
+                   (unsigned long long) subprocstats_get(&seg->wakeups),
+                   m_slab.getAllocs());
+      for(i = 0; i < SUBPROCESSMANAGER_LANES && n < (int) sizeof(buff); i++) {
+         dequeued = subprocstats_get(&seg->laneDequeued[i]);
+         enqueued = subprocstats_get(&seg->laneEnqueued[i]);
+         n += snprintf(buff + n, sizeof(buff) - n, "|%llu|%llu",
+                       (unsigned long long) ((enqueued > dequeued) ? enqueued - dequeued : 0),
+                       (unsigned long long) subprocstats_percentile(&seg->laneWait[i], 99.0));
+      }
+      if(n < (int) sizeof(buff))
+         snprintf(buff + n, sizeof(buff) - n, "|%llu|%llu", (unsigned long long) subprocstats_get(&seg->failovers),
+                  (unsigned long long) subprocstats_percentile(&seg->failover, 99.0));
+      m_mmdagent->sendMessage(SUBPROCESSMANAGER_EVENTSTATS, "%s", buff);
+      return;
+   }
+
+   /* subprocess: "alias|out|in|dropped|coalesced|pending|p50|p99|calls|timeouts|p99" with latency of dispatch and of calls in usec */
+   link = reference(str);
+   if(link == NULL) {
+      reportGroup(str);
+      return;
+   }
+
+   stats = link->proc.getStats();
+   if(stats != NULL)
+      m_mmdagent->sendMessage(SUBPROCESSMANAGER_EVENTSTATS, "%s|%llu|%llu|%llu|%llu|%llu|%llu|%llu|%llu|%llu|%llu", link->proc.getName(),
+                              (unsigned long long) subprocstats_get(&stats->msgsOut),
+                              (unsigned long long) subprocstats_get(&stats->msgsIn),
+                              (unsigned long long) subprocstats_get(&stats->dropped),
+                              (unsigned long long) subprocstats_get(&stats->coalesced),
+                              (unsigned long long) subprocstats_get(&stats->pendingMsgs),
+                              (unsigned long long) subprocstats_percentile(&stats->dispatch, 50.0),
+                              (unsigned long long) subprocstats_percentile(&stats->dispatch, 99.0),
+                              (unsigned long long) subprocstats_get(&stats->calls),
+                              (unsigned long long) subprocstats_get(&stats->callTimeouts),
+                              (unsigned long long) subprocstats_percentile(&stats->call, 99.0));
+
+   releaseLink(link);
+}
+
+/* SubProcess_Manager::reportGroup: send summary of statistics of group of workers */
+void SubProcess_Manager::reportGroup(const char *str)
+{
+   int i, n, workers = 0, running = 0;
+   char name[MMDAGENT_MAXBUFLEN], buff[MMDAGENT_MAXBUFLEN];
+   uint64_t out[SUBPROCESSOPTION_MAXWORKERS], pending[SUBPROCESSOPTION_MAXWORKERS], in = 0, sum = 0, depth = 0, max = 0;
+   SubProcess_Link *link;
+   SubProcess_Group *group;
+   SubProcStats_Proc *stats;
+
+   SubProcess_Thread::getAlias(str, name);
+   memset(out, 0, sizeof(out));
+   memset(pending, 0, sizeof(pending));
+
+   glfwLockMutex(m_mutex);
+   group = findGroup(name, SubProcess_Filter::hash(name, MMDAgent_strlen(name)));
+   if(group != NULL) {
+      workers = group->workers;
+      for(i = 0; m_snapshot != NULL && i < m_snapshot->num; i++) {
+         link = m_snapshot->procs[i];
+         stats = link->proc.getStats();
+         if(link->group != group || link->proc.isStandby() == true || stats == NULL)
+            continue;
+         out[link->member] = subprocstats_get(&stats->msgsOut);
+         pending[link->member] = subprocstats_get(&stats->pendingMsgs);
+         in += subprocstats_get(&stats->msgsIn);
+         running++;
+      }
+   }
+   glfwUnlockMutex(m_mutex);
+
+   if(group == NULL)
+      return;
+
+   for(i = 0; i < workers; i++) {
+      sum += out[i];
+      depth += pending[i];
+      if(out[i] > max)
+         max = out[i];
+   }
+
+   /* "alias|running|out|in|pending|imbalance" with busiest worker in percent of mean, then "out|pending" of workers, to find hot keys */
+   n = snprintf(buff, sizeof(buff), "%d|%llu|%llu|%llu|%llu", running, (unsigned long long) sum, (unsigned long long) in,
+                (unsigned long long) depth, (unsigned long long) ((sum > 0) ? max * 100 * workers / sum : 0));
+   for(i = 0; i < workers && n < (int) sizeof(buff); i++)
+      n += snprintf(buff + n, sizeof(buff) - n, "|%llu|%llu", (unsigned long long) out[i], (unsigned long long) pending[i]);
+   m_mmdagent->sendMessage(SUBPROCESSMANAGER_EVENTSTATS, "%s|%s", name, buff);
+}
+
+/* SubProcess_Manager::hold: keep message for registered subprocesses of its type not running, to be launched by standby thread, and return time of message ordered against their registration */
+double SubProcess_Manager::hold(const char *type, const char *args)
+{
+   double time;
+   bool wake = false;
+   SubProcess_Registration *reg;
+   SubProcess_Message *msg;
+
+   glfwLockMutex(m_mutex);
+
+   /* taken with registry locked, so that a message not kept is later than registration of subprocess */
+   time = glfwGetTime();
+   for(reg = m_registered; reg != NULL; reg = reg->next) {
+      if(reg->patterns.match(type) < 0)
+         continue;
+      reg->lastUsed = time;
+      if(findLink(reg->name, reg->hash) != NULL || findGroup(reg->name, reg->hash) != NULL)
+         continue;
+      if(reg->numPending < SUBPROCESSMANAGER_MAXPENDING && (msg = m_slab.create(type, args, time, reg->name)) != NULL)
+         reg->pending[reg->numPending++] = msg;
+      wake = true;
+   }
+   if(wake == true && m_standbyCond != NULL)
+      glfwSignalCond(m_standbyCond);
+
+   glfwUnlockMutex(m_mutex);
+
+   return time;
+}
+
+/* SubProcess_Manager::launch: launch registered subprocess and pass its kept messages to it, with registry locked, which is released meanwhile */
+void SubProcess_Manager::launch(SubProcess_Registration *reg)
+{
+   int i;
+   unsigned long hash = reg->hash;
+   char *args, *subscription, name[MMDAGENT_MAXBUFLEN];
+   SubProcess_Link *link, *replaced;
+   SubProcess_Snapshot *old;
+
+   strncpy(name, reg->name, MMDAGENT_MAXBUFLEN - 1);
+   name[MMDAGENT_MAXBUFLEN - 1] = '\0';
+   args = MMDAgent_strdup(reg->args);
+   subscription = MMDAgent_strdup(reg->subscription);
+   reg->respawn = glfwGetTime() + SUBPROCESSMANAGER_STANDBYRETRY;
+   glfwUnlockMutex(m_mutex);
+
+   /* launch without lock, subscribed before it is found by dispatcher */
+   link = newLink(args, false);
+   if(link != NULL) {
+      link->proc.subscribe(subscription);
+      link->subscription = subscription;
+      link->registered = true;
+      subscription = NULL;
+   }
+   free(args);
+   free(subscription);
+
+   glfwLockMutex(m_mutex);
+   if(link == NULL)
+      return; /* launched again after a while */
+
+   /* registration may have been removed, or alias started by SUBPROC_START meanwhile */
+   for(reg = m_registered; reg != NULL && (reg->hash != hash || MMDAgent_strequal(reg->name, name) == false); reg = reg->next);
+   if(reg == NULL || findLink(name, hash) != NULL || findGroup(name, hash) != NULL) {
+      link->next = m_retired;
+      m_retired = link;
+      return;
+   }
+
+   /* kept messages are queued before later ones, which find it registered */
+   link->since = glfwGetTime();
+   old = insert(link, &replaced);
+   reg->lastUsed = link->since;
+   for(i = 0; i < reg->numPending; i++)
+      push(reg->pending[i]);
+   reg->numPending = 0;
+
+   glfwUnlockMutex(m_mutex);
+   releaseSnapshot(old);
+   glfwLockMutex(m_mutex);
+}
+
+/* SubProcess_Manager::enqueueBuffer: enqueue buffer to send */
+void SubProcess_Manager::enqueueBuffer(const char *type, const char *args)
+{
+   double time = glfwGetTime();
+   SubProcess_Message *msg;
+
+   m_recorder.record(SUBPROCRECORD_ENQUEUE, NULL, type, args, time);
+
+   /* registered subprocesses not running are launched in background with the message kept for them */
+   if(__atomic_load_n(&m_registered, __ATOMIC_RELAXED) != NULL)
+      time = hold(type, args);
+
+   /* format once, then enqueue and wake up message dispatcher thread if sleeping */
+   msg = m_slab.create(type, args, time);
+   if(msg != NULL)
+      push(msg);
 }
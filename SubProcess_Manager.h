@@ -33,12 +33,133 @@
 /* POSSIBILITY OF SUCH DAMAGE.                                       */
 /* ----------------------------------------------------------------- */
 
-/* SubProcess_Link: cell of subprocess list */
+/* definitions */
+
+#define SUBPROCESSMANAGER_EVENTSTATS "SUBPROC_EVENT_STATS"
+#define SUBPROCESSMANAGER_EVENTCALL  "SUBPROC_EVENT_CALL" /* "SUBPROC_EVENT_CALL|alias|id|reqtype" when request is issued */
+#define SUBPROCESSMANAGER_EVENTFAILOVER "SUBPROC_EVENT_FAILOVER" /* "SUBPROC_EVENT_FAILOVER|alias|usec|standbys" when standby is promoted */
+#define SUBPROCESSMANAGER_EVENTSTANDBY  "SUBPROC_EVENT_STANDBY"  /* "SUBPROC_EVENT_STANDBY|alias|standbys" when standby is ready */
+#define SUBPROCESSMANAGER_BUCKETS    256 /* buckets of subprocess registry */
+#define SUBPROCESSMANAGER_ENVDISPATCHERS "SUBPROC_DISPATCHERS" /* number of dispatcher threads writing to subprocesses */
+#define SUBPROCESSMANAGER_MAXBATCHES     64 /* batches queued per dispatcher thread before manager thread waits */
+#define SUBPROCESSMANAGER_LANES          SUBPROCSTATS_LANES /* priority lanes of input messages, 0 first */
+#define SUBPROCESSMANAGER_ENVLANES       "SUBPROC_LANES" /* "patterns|patterns" of lanes but last, which takes the others */
+#define SUBPROCESSMANAGER_DEFAULTLANES   "SUBPROC_*,PLUGIN_*|RECOG_EVENT_*" /* control commands, then recognition results */
+#define SUBPROCESSMANAGER_ENVWEIGHTS     "SUBPROC_LANEWEIGHTS" /* "w0,w1,..." messages taken from lanes in turn, unset means strict priority */
+#define SUBPROCESSMANAGER_MAXDRAIN       256 /* messages in a batch, so that urgent ones need not wait for a long backlog */
+#define SUBPROCESSMANAGER_STANDBYRETRY   1.0 /* sec, interval to launch standby or worker again after it failed or stopped */
+#define SUBPROCESSMANAGER_WORKERMARK     '#' /* separator of alias of group and index of worker, as "alias#0" */
+#define SUBPROCESSMANAGER_VNODES         64  /* points of a worker on consistent-hash ring */
+#define SUBPROCESSMANAGER_MAXPENDING     256 /* messages kept for registered subprocess until it is launched, later ones are not given to it */
+
+class SubProcess_Manager;
+
+/* SubProcess_Group: workers "alias#0", "alias#1", ... of which each message is written to one, freed when last reference is released */
+typedef struct _SubProcess_Group {
+   char *name;           /* alias of group */
+   unsigned long hash;
+   char *args;           /* "alias,options|command" to launch workers */
+   int refs;             /* references from registry and workers */
+   int workers;          /* workers to be kept */
+   int balance;          /* choice of worker */
+   int key;              /* field of args hashed in key balance, from 1 */
+   int shard;            /* dispatcher thread writing to all workers, so that each message is given once */
+   double respawn;       /* time when missing workers may be launched, with registry locked */
+
+   /* used only by dispatcher of shard */
+   unsigned long round;  /* dispatch in which messages were given to workers */
+   unsigned long cursor; /* next worker in round-robin */
+   int *assign;          /* index of worker given each message of batch, -1 for none */
+   int size;
+   struct _SubProcess_Link *members[SUBPROCESSOPTION_MAXWORKERS]; /* running workers in dispatch */
+   unsigned long loads[SUBPROCESSOPTION_MAXWORKERS];             /* outstanding bytes of them */
+
+   struct _SubProcess_Group *next; /* next group in registry */
+} SubProcess_Group;
+
+/* SubProcess_Link: subprocess in registry, freed when last reference is released */
 typedef struct _SubProcess_Link {
    SubProcess_Thread proc;
-   struct _SubProcess_Link *next;
+   SubProcess_Manager *manager;
+   unsigned long hash;            /* hash of alias */
+   int refs;                      /* references from registry, primary and snapshots */
+   int shard;                     /* dispatcher thread writing to subprocess */
+   bool notify;                   /* send stop event when freed */
+   GLFWmutex mutex;               /* settings of subprocess against dispatcher */
+   struct _SubProcess_Link *next; /* next link in bucket */
+
+   /* launched by SUBPROC_REGISTER, fixed while referenced */
+   bool registered; /* stopped after idle period of registration */
+   double since;    /* time of registration, earlier messages were kept and given to it by target */
+
+   /* hot-standby replicas, with registry locked */
+   char *args;                       /* "alias,options|command" to launch standbys, NULL if none */
+   int replicas;                     /* standbys to be kept */
+   double respawn;                   /* time when standby may be launched again */
+   char *subscription;               /* SUBPROC_SUBSCRIBE of primary, NULL means all */
+   char *coalesce;                   /* SUBPROC_COALESCE of primary since rules were cleared, separated by newlines */
+   char *standbyTypes;               /* SUBPROC_STANDBY subset sent to standbys, NULL means same as primary */
+   struct _SubProcess_Link *primary; /* subprocess replicated by this standby, NULL if not a standby */
+   struct _SubProcess_Link *standby; /* first standby of primary, or next one of standby, in order of promotion and referenced */
+
+   /* worker of group, fixed while referenced */
+   SubProcess_Group *group; /* group referenced by worker and its standbys, NULL if not a worker */
+   int member;              /* index of worker in group */
+   unsigned long *points;   /* sorted points of worker on consistent-hash ring */
 } SubProcess_Link;
 
+/* SubProcess_Registration: command registered by SUBPROC_REGISTER, launched by standby thread when a message of its types arrives */
+typedef struct _SubProcess_Registration {
+   char *name;                  /* alias */
+   unsigned long hash;
+   char *args;                  /* "alias,options|command" to launch subprocess */
+   char *subscription;          /* "alias|patterns" given to subprocess */
+   SubProcess_Filter patterns;  /* message types launching subprocess */
+   double idleTimeout;          /* sec, stopped when no message of its types arrived for this period (0 means never) */
+   double lastUsed;             /* time of registration, launch or last message of its types */
+   double respawn;              /* time when subprocess may be launched again after failure */
+   SubProcess_Message **pending; /* messages to subprocess, by target, kept until it is launched */
+   int numPending;
+   struct _SubProcess_Registration *next; /* next registration */
+} SubProcess_Registration;
+
+/* SubProcess_Snapshot: immutable array of registered subprocesses, iterated by dispatcher without lock */
+typedef struct _SubProcess_Snapshot {
+   int refs;                /* references from registry and dispatcher */
+   int num;
+   SubProcess_Link **procs; /* in order of registration */
+} SubProcess_Snapshot;
+
+/* SubProcess_Batch: messages dequeued at once, shared by dispatcher threads */
+typedef struct _SubProcess_Batch {
+   int refs;                       /* references from dispatcher threads */
+   SubProcess_Message **msgs;      /* references of messages, formatted once for all subprocesses */
+   int size;
+   int num;
+   SubProcess_Snapshot *snapshot;  /* subprocesses at time of dequeue */
+   struct _SubProcess_Batch *next; /* next released batch */
+} SubProcess_Batch;
+
+/* SubProcess_Writer: dispatcher thread writing batches to its shard of subprocesses */
+typedef struct _SubProcess_Writer {
+   SubProcess_Manager *manager;
+   int index;              /* shard */
+   GLFWthread thread;
+   GLFWmutex mutex;        /* mutual exclusion for queue */
+   GLFWcond cond;          /* room in queue */
+   int eventfd;            /* wakes up thread sleeping in poll */
+   bool waiting;
+   bool kill;
+   unsigned long round;    /* dispatches, so that messages are given to workers of a group once in each */
+   SubProcess_Batch *batches[SUBPROCESSMANAGER_MAXBATCHES]; /* circular queue, a batch is queued to all dispatcher threads */
+   int first;
+   int numBatches;
+   SubProcess_Message **msgs; /* messages to be written to a subprocess */
+   int size;
+   struct pollfd *pfd;        /* descriptors to wait for */
+   int pfdSize;
+} SubProcess_Writer;
+
 /* SubProcess_Manager: multi thread manager for subprocesses */
 class SubProcess_Manager
 {
@@ -46,15 +167,43 @@ private:
 
    MMDAgent *m_mmdagent;
 
-   GLFWmutex m_mutex;  /* mutual exclusion for message queue */
-   GLFWmutex m_mutex2; /* mutual exclusion for sub-thread list */
-   GLFWcond m_cond;
+   GLFWmutex m_mutex; /* mutual exclusion for registry, never held during I/O */
    GLFWthread m_thread;
 
    bool m_kill;
 
-   SubProcess_Queue m_queue; /* queue of input message */
-   SubProcess_Link *m_procs; /* list of subprocesses */
+   SubProcess_Slab m_slab; /* pool of messages */
+   SubProcess_Ring m_rings[SUBPROCESSMANAGER_LANES]; /* lock-free queues of input message by priority */
+   SubProcess_Filter m_lanes;                        /* lane of message types, fixed while running */
+   int m_weights[SUBPROCESSMANAGER_LANES];           /* messages taken from lanes in turn, 0 for strict priority */
+
+   SubProcess_Link *m_table[SUBPROCESSMANAGER_BUCKETS]; /* registry of subprocesses by alias */
+   SubProcess_Snapshot *m_snapshot;                      /* current subprocesses, NULL if none */
+   SubProcess_Group *m_groups;                           /* registry of groups of workers */
+   SubProcess_Registration *m_registered;               /* commands launched on demand, with registry locked */
+
+   SubProcess_Table m_procs; /* running subprocesses by handle */
+
+   SubProcess_Pool m_pool; /* idle subprocesses launched in advance */
+
+   SubProcess_Reaper m_reaper; /* stops subprocesses in background */
+
+   SubProcess_Stats m_stats; /* statistics published in shared memory */
+
+   SubProcess_Recorder m_recorder; /* traffic recorded for replay, if requested */
+
+   SubProcess_Reactor *m_reactors; /* reactor threads in epoll mode (NULL means thread mode) */
+   int m_numReactors;
+
+   SubProcess_Batch *m_spare; /* released batches kept for reuse, pushed by any dispatcher */
+
+   GLFWthread m_standbyThread; /* launches hot-standby replicas, frees subprocesses given up by failover and stops idle registered ones */
+   GLFWcond m_standbyCond;     /* wakes up standby thread, with registry locked */
+   SubProcess_Link *m_retired; /* subprocesses given up by failover, freed by standby thread */
+
+   SubProcess_Writer m_writer;   /* manager thread itself with a single dispatcher */
+   SubProcess_Writer *m_writers; /* dispatcher threads (NULL means manager thread writes) */
+   int m_numWriters;
 
    /* initialize: initialize thread */
    void initialize();
@@ -62,6 +211,120 @@ private:
    /* clear: free thread */
    void clear();
 
+   /* wait: sleep until message arrives or pending output of shard of writer can be written (NULL means no shard) */
+   void wait(SubProcess_Writer *writer);
+
+   /* setupLanes: map message types to lanes and set draining from environment */
+   void setupLanes();
+
+   /* isIdle: check if all lanes are empty */
+   bool isIdle();
+
+   /* take: move up to max messages of lane into batch, return number of them */
+   int take(SubProcess_Batch *batch, int lane, int max);
+
+   /* drain: move queued messages into a batch, higher lanes first or by weights */
+   SubProcess_Batch *drain();
+
+   /* releaseBatch: release reference of batch and its messages, keeping it for reuse at last */
+   void releaseBatch(SubProcess_Batch *batch);
+
+   /* distribute: choose worker of group for each message of batch, from running workers in snapshot */
+   void distribute(SubProcess_Group *group, SubProcess_Batch *batch);
+
+   /* dispatch: write batch to subprocesses of shard of writer */
+   void dispatch(SubProcess_Writer *writer, SubProcess_Batch *batch);
+
+   /* queue: pass batch to dispatcher thread, waiting while its queue is full */
+   void queue(SubProcess_Writer *writer, SubProcess_Batch *batch);
+
+   /* startWriters: start dispatcher threads */
+   bool startWriters(int num);
+
+   /* stopWriters: stop dispatcher threads and release their queues */
+   void stopWriters();
+
+   /* push: enqueue formatted message to its lane and wake up manager thread, releasing it on failure */
+   bool push(SubProcess_Message *msg);
+
+   /* chooseShard: choose dispatcher thread with fewest subprocesses, with registry locked */
+   int chooseShard();
+
+   /* newLink: start subprocess by "alias,options|command", as hot-standby replica if standby is true, NULL on failure */
+   SubProcess_Link *newLink(const char *str, bool standby);
+
+   /* configure: give filter of primary, or subset for standbys unless promoted, to standby, with registry locked */
+   void configure(SubProcess_Link *standby, SubProcess_Link *primary, bool promoted);
+
+   /* adopt: give filter and coalesce rules of subprocess to its standby, or to another worker of its group, with registry locked */
+   void adopt(SubProcess_Link *link, SubProcess_Link *from, bool standby);
+
+   /* retire: pass reference of subprocess to standby thread to be freed there, after its snapshots are released */
+   void retire(SubProcess_Link *link);
+
+   /* startGroup: start group of workers by "alias,workers=N,options|command", replacing subprocess or group of the alias */
+   void startGroup(const char *str, SubProcess_Option *option);
+
+   /* newWorker: start worker of group by index, NULL on failure */
+   SubProcess_Link *newWorker(SubProcess_Group *group, int member);
+
+   /* pick: choose running worker of group for a request with args, with registry locked, NULL if none */
+   SubProcess_Link *pick(SubProcess_Group *group, const char *args);
+
+   /* insert: register subprocess replacing one of the same alias, with registry locked, return old snapshot and replaced one */
+   SubProcess_Snapshot *insert(SubProcess_Link *link, SubProcess_Link **replaced);
+
+   /* findGroup: find group by alias, with registry locked */
+   SubProcess_Group *findGroup(const char *name, unsigned long hash);
+
+   /* removeGroup: remove group and its workers from registry, with registry locked, return workers to be released */
+   int removeGroup(SubProcess_Group *group, SubProcess_Link **links, bool notify);
+
+   /* gather: get references of subprocess by "alias|...", or of workers if alias is a group, return number of them */
+   int gather(const char *str, SubProcess_Link **links);
+
+   /* dropStandbys: remove standbys of primary from snapshot, leaving them to be freed with it, with registry locked */
+   void dropStandbys(SubProcess_Link *link);
+
+   /* findLink: find registered subprocess by alias, with registry locked */
+   SubProcess_Link *findLink(const char *name, unsigned long hash);
+
+   /* removeLink: remove subprocess from registry, with registry locked */
+   void removeLink(SubProcess_Link *link);
+
+   /* rebuild: replace snapshot with a copy where link is added, or replaced or removed, with registry locked, and return old one */
+   SubProcess_Snapshot *rebuild(SubProcess_Link *add, SubProcess_Link *remove);
+
+   /* acquire: get reference of current snapshot */
+   SubProcess_Snapshot *acquire();
+
+   /* reference: get reference of registered subprocess by "alias|..." */
+   SubProcess_Link *reference(const char *str);
+
+   /* discard: remove subprocess not running from registry */
+   void discard(SubProcess_Link *link);
+
+   /* hold: keep message for registered subprocesses of its type not running, to be launched by standby thread, and return time of message ordered against their registration */
+   double hold(const char *type, const char *args);
+
+   /* launch: launch registered subprocess and pass its kept messages to it, with registry locked, which is released meanwhile */
+   void launch(SubProcess_Registration *reg);
+
+   /* reportGroup: send summary of statistics of group of workers */
+   void reportGroup(const char *str);
+
+   /* releaseSnapshot: release reference of snapshot */
+   static void releaseSnapshot(SubProcess_Snapshot *snapshot);
+
+   /* releaseLink: release reference of subprocess, stopping it at last */
+   static void releaseLink(SubProcess_Link *link);
+
+   /* unwatchLink: release reference of subprocess held while reaper waited for its exit after hang-up */
+   static void unwatchLink(void *param);
+
+   /* releaseGroup: release reference of group */
+   static void releaseGroup(SubProcess_Group *group);
+
 public:
 
    /* SubProcess_Manager: thread constructor */
@@ -79,15 +342,48 @@ public:
    /* run: main loop */
    void run();
 
+   /* runWriter: main loop of dispatcher thread */
+   void runWriter(SubProcess_Writer *writer);
+
+   /* runStandby: main loop of standby thread */
+   void runStandby();
+
+   /* failover: handle hang-up of subprocess, promoting its standby, return true if stop event is taken over */
+   bool failover(SubProcess_Link *link);
+
+   /* watchExit: let reaper send stop event when subprocess which hung up exits, return true if stop event is taken over */
+   bool watchExit(SubProcess_Link *link);
+
    /* isRunning: check running */
    bool isRunning();
 
-   /* startProcess: start subprocess by creating socketpair */
+   /* startProcess: start subprocess by creating socketpair, or group of workers with workers option */
    void startProcess(const char *str);
 
-   /* stopProcess: stop subprocess and close socketpair */
+   /* stopProcess: stop subprocess and close socketpair, or all workers of group */
    void stopProcess(const char *str);
 
+   /* prewarmProcess: keep idle subprocesses launched in advance */
+   void prewarmProcess(const char *str);
+
+   /* subscribeProcess: set message types to be sent to subprocess, or to workers of group */
+   void subscribeProcess(const char *str);
+
+   /* registerProcess: register "alias,options|patterns|command" to be started by first message of patterns, and stopped after idle option, or remove registration of "alias" */
+   void registerProcess(const char *str);
+
+   /* coalesceProcess: set message types of which only latest pending value is sent to subprocess, or to workers of group */
+   void coalesceProcess(const char *str);
+
+   /* standbyProcess: set message types to be sent to hot-standby replicas of subprocess, or of workers of group */
+   void standbyProcess(const char *str);
+
+   /* callProcess: send request to subprocess, or to a worker of group, by "alias|reqtype|args|timeout" with optional timeout, and report its reply or timeout */
+   void callProcess(const char *str);
+
+   /* reportStats: send summary of statistics of plugin, or of subprocess if alias is given */
+   void reportStats(const char *str);
+
    /* enqueueBuffer: enqueue buffer to send */
    void enqueueBuffer(const char *type, const char *args);
 };
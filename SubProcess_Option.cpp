@@ -0,0 +1,453 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* headers */
+
+#include "MMDAgent.h"
+
+#include "SubProcess_Option.h"
+
+/* SubProcess_Option::initialize: initialize option */
+void SubProcess_Option::initialize()
+{
+   m_name = NULL;
+
+   m_policy = SUBPROCESSOPTION_DEFAULT_POLICY;
+   m_maxBytes = SUBPROCESSOPTION_DEFAULT_MAXBYTES;
+   m_maxMessages = SUBPROCESSOPTION_DEFAULT_MAXMESSAGES;
+   m_deadline = SUBPROCESSOPTION_DEFAULT_DEADLINE;
+   m_idleTimeout = 0;
+   m_flushWindow = 0.0;
+   m_protocol = SUBPROCESSOPTION_PROTOCOL_LINE;
+   m_maxFrame = SUBPROCESSOPTION_DEFAULT_MAXFRAME;
+   m_transport = SUBPROCESSOPTION_TRANSPORT_SOCKET;
+   m_shmSize = SUBPROCESSOPTION_DEFAULT_SHMSIZE;
+   m_standbys = 0;
+   m_workers = 0;
+   m_balance = SUBPROCESSOPTION_BALANCE_LEAST;
+   m_key = 1;
+   m_drain = SUBPROCESSOPTION_DEFAULT_DRAIN;
+   m_hupWait = SUBPROCESSOPTION_DEFAULT_HUPWAIT;
+   m_termWait = SUBPROCESSOPTION_DEFAULT_TERMWAIT;
+   m_callTimeout = 0.0;
+
+   memset(&m_limits, 0, sizeof(SubProcess_Limits));
+   m_limits.nice = SUBPROCESSOPTION_NICE_INHERIT;
+   m_limits.sched = SUBPROCESSOPTION_SCHED_INHERIT;
+   m_limits.ioClass = SUBPROCESSOPTION_IOCLASS_INHERIT;
+   m_limits.cgroup = NULL;
+   m_limited = false;
+}
+
+/* SubProcess_Option::set: set an option */
+void SubProcess_Option::set(const char *key, const char *value)
+{
+   if(MMDAgent_strequal(key, "policy")) {
+      if(MMDAgent_strequal(value, "drop-newest"))
+         m_policy = SUBPROCESSOPTION_POLICY_DROPNEWEST;
+      else if(MMDAgent_strequal(value, "drop-oldest"))
+         m_policy = SUBPROCESSOPTION_POLICY_DROPOLDEST;
+      else if(MMDAgent_strequal(value, "block"))
+         m_policy = SUBPROCESSOPTION_POLICY_BLOCK;
+      else if(MMDAgent_strequal(value, "disconnect"))
+         m_policy = SUBPROCESSOPTION_POLICY_DISCONNECT;
+   } else if(MMDAgent_strequal(key, "maxbytes")) {
+      if(MMDAgent_str2int(value) > 0)
+         m_maxBytes = MMDAgent_str2int(value);
+   } else if(MMDAgent_strequal(key, "maxmsgs")) {
+      if(MMDAgent_str2int(value) > 0)
+         m_maxMessages = MMDAgent_str2int(value);
+   } else if(MMDAgent_strequal(key, "deadline")) {
+      if(MMDAgent_str2int(value) >= 0)
+         m_deadline = MMDAgent_str2int(value);
+   } else if(MMDAgent_strequal(key, "idle")) {
+      if(MMDAgent_str2int(value) >= 0)
+         m_idleTimeout = MMDAgent_str2int(value);
+   } else if(MMDAgent_strequal(key, "flush")) {
+      if(MMDAgent_str2float(value) >= 0.0f)
+         m_flushWindow = MMDAgent_str2float(value);
+   } else if(MMDAgent_strequal(key, "proto")) {
+      if(MMDAgent_strequal(value, "line"))
+         m_protocol = SUBPROCESSOPTION_PROTOCOL_LINE;
+      else if(MMDAgent_strequal(value, "frame"))
+         m_protocol = SUBPROCESSOPTION_PROTOCOL_FRAME;
+   } else if(MMDAgent_strequal(key, "maxframe")) {
+      if(MMDAgent_str2int(value) > 0)
+         m_maxFrame = MMDAgent_str2int(value);
+   } else if(MMDAgent_strequal(key, "transport")) {
+      if(MMDAgent_strequal(value, "socket"))
+         m_transport = SUBPROCESSOPTION_TRANSPORT_SOCKET;
+      else if(MMDAgent_strequal(value, "shm"))
+         m_transport = SUBPROCESSOPTION_TRANSPORT_SHM;
+   } else if(MMDAgent_strequal(key, "shmsize")) {
+      if(MMDAgent_str2int(value) >= 4096) {
+         /* round up to power of two */
+         for(m_shmSize = 4096; m_shmSize < MMDAgent_str2int(value) && m_shmSize < 0x40000000; m_shmSize <<= 1);
+      }
+   } else if(MMDAgent_strequal(key, "standby")) {
+      if(MMDAgent_str2int(value) >= 0 && MMDAgent_str2int(value) <= SUBPROCESSOPTION_MAXSTANDBYS)
+         m_standbys = MMDAgent_str2int(value);
+   } else if(MMDAgent_strequal(key, "workers")) {
+      if(MMDAgent_str2int(value) >= 0 && MMDAgent_str2int(value) <= SUBPROCESSOPTION_MAXWORKERS)
+         m_workers = MMDAgent_str2int(value);
+   } else if(MMDAgent_strequal(key, "balance")) {
+      if(MMDAgent_strequal(value, "least"))
+         m_balance = SUBPROCESSOPTION_BALANCE_LEAST;
+      else if(MMDAgent_strequal(value, "round-robin"))
+         m_balance = SUBPROCESSOPTION_BALANCE_ROUNDROBIN;
+      else if(MMDAgent_strequal(value, "key"))
+         m_balance = SUBPROCESSOPTION_BALANCE_KEY;
+   } else if(MMDAgent_strequal(key, "key")) {
+      if(MMDAgent_str2int(value) > 0)
+         m_key = MMDAgent_str2int(value);
+   } else if(MMDAgent_strequal(key, "drain")) {
+      if(MMDAgent_str2int(value) >= 0)
+         m_drain = MMDAgent_str2int(value);
+   } else if(MMDAgent_strequal(key, "hupwait")) {
+      if(MMDAgent_str2int(value) >= 0)
+         m_hupWait = MMDAgent_str2int(value);
+   } else if(MMDAgent_strequal(key, "termwait")) {
+      if(MMDAgent_str2int(value) >= 0)
+         m_termWait = MMDAgent_str2int(value);
+   } else if(MMDAgent_strequal(key, "timeout")) {
+      if(MMDAgent_str2float(value) > 0.0f)
+         m_callTimeout = MMDAgent_str2float(value);
+   } else if(MMDAgent_strequal(key, "cpus")) {
+      if(parseCpus(value, m_limits.cpus) == true)
+         m_limited = true;
+   } else if(MMDAgent_strequal(key, "nice")) {
+      if(MMDAgent_strlen(value) > 0 && MMDAgent_str2int(value) >= -20 && MMDAgent_str2int(value) <= 19) {
+         m_limits.nice = MMDAgent_str2int(value);
+         m_limited = true;
+      }
+   } else if(MMDAgent_strequal(key, "sched")) {
+      if(MMDAgent_strequal(value, "other"))
+         m_limits.sched = SUBPROCESSOPTION_SCHED_OTHER;
+      else if(MMDAgent_strequal(value, "batch"))
+         m_limits.sched = SUBPROCESSOPTION_SCHED_BATCH;
+      else if(MMDAgent_strequal(value, "idle"))
+         m_limits.sched = SUBPROCESSOPTION_SCHED_IDLE;
+      if(m_limits.sched != SUBPROCESSOPTION_SCHED_INHERIT)
+         m_limited = true;
+   } else if(MMDAgent_strequal(key, "ioprio")) {
+      /* "idle", or "be" and "rt" with optional level as "be:7" */
+      if(MMDAgent_strequal(value, "idle")) {
+         m_limits.ioClass = SUBPROCESSOPTION_IOCLASS_IDLE;
+         m_limits.ioLevel = 0;
+      } else if(MMDAgent_strlen(value) >= 2 && (strncmp(value, "be", 2) == 0 || strncmp(value, "rt", 2) == 0)) {
+         m_limits.ioClass = (value[0] == 'b') ? SUBPROCESSOPTION_IOCLASS_BE : SUBPROCESSOPTION_IOCLASS_RT;
+         m_limits.ioLevel = (value[2] == ':') ? MMDAgent_str2int(&value[3]) : 4;
+         if(m_limits.ioLevel < 0 || m_limits.ioLevel > 7 || (value[2] != ':' && value[2] != '\0'))
+            m_limits.ioClass = SUBPROCESSOPTION_IOCLASS_INHERIT;
+      }
+      if(m_limits.ioClass != SUBPROCESSOPTION_IOCLASS_INHERIT)
+         m_limited = true;
+   } else if(MMDAgent_strequal(key, "memlimit")) {
+      if(parseSize(value) > 0) {
+         m_limits.memory = parseSize(value);
+         m_limited = true;
+      }
+   } else if(MMDAgent_strequal(key, "cpulimit")) {
+      if(MMDAgent_str2int(value) > 0) {
+         m_limits.cpuTime = MMDAgent_str2int(value);
+         m_limited = true;
+      }
+   } else if(MMDAgent_strequal(key, "cgroup")) {
+      if(MMDAgent_strlen(value) > 0) {
+         free(m_limits.cgroup);
+         m_limits.cgroup = MMDAgent_strdup(value);
+         m_limited = true;
+      }
+   } else if(MMDAgent_strequal(key, "cgcpu")) {
+      if(MMDAgent_str2int(value) > 0)
+         m_limits.cgroupCpu = MMDAgent_str2int(value);
+   } else if(MMDAgent_strequal(key, "cgmem")) {
+      if(parseSize(value) > 0)
+         m_limits.cgroupMemory = parseSize(value);
+   }
+}
+
+/* SubProcess_Option::parseSize: parse bytes with optional suffix k, m or g, -1 on error */
+long long SubProcess_Option::parseSize(const char *str)
+{
+   char *end;
+   long long size;
+
+   if(MMDAgent_strlen(str) == 0)
+      return -1;
+
+   size = strtoll(str, &end, 10);
+   if(end == str || size < 0)
+      return -1;
+   switch(*end) {
+   case 'k':
+   case 'K':
+      size <<= 10;
+      end++;
+      break;
+   case 'm':
+   case 'M':
+      size <<= 20;
+      end++;
+      break;
+   case 'g':
+   case 'G':
+      size <<= 30;
+      end++;
+      break;
+   }
+
+   return (*end == '\0') ? size : -1;
+}
+
+/* SubProcess_Option::SubProcess_Option: option constructor */
+SubProcess_Option::SubProcess_Option()
+{
+   initialize();
+}
+
+/* SubProcess_Option::~SubProcess_Option: option destructor */
+SubProcess_Option::~SubProcess_Option()
+{
+   clear();
+}
+
+/* SubProcess_Option::clear: free option */
+void SubProcess_Option::clear()
+{
+   free(m_name);
+   free(m_limits.cgroup);
+
+   initialize();
+}
+
+/* SubProcess_Option::parse: parse alias field with options */
+bool SubProcess_Option::parse(const char *str)
+{
+   char *buff, *p, *q, *value;
+   bool last = false;
+
+   clear();
+
+   if(MMDAgent_strlen(str) == 0)
+      return false;
+
+   buff = MMDAgent_strdup(str);
+
+   /* alias */
+   for(p = buff; *p != SUBPROCESSOPTION_SEPARATOR && *p != '\0'; p++);
+   if(*p == '\0')
+      last = true;
+   *p = '\0';
+   m_name = MMDAgent_strdup(buff);
+
+   /* key=value pairs */
+   while(last == false) {
+      for(q = ++p; *p != SUBPROCESSOPTION_SEPARATOR && *p != '\0'; p++);
+      if(*p == '\0')
+         last = true;
+      *p = '\0';
+      value = strchr(q, SUBPROCESSOPTION_ASSIGN);
+      if(value != NULL) {
+         *value = '\0';
+         set(q, value + 1);
+      } else {
+         set(q, "");
+      }
+   }
+
+   free(buff);
+
+   return (MMDAgent_strlen(m_name) > 0) ? true : false;
+}
+
+/* SubProcess_Option::getName: get alias */
+const char *SubProcess_Option::getName()
+{
+   return m_name;
+}
+
+/* SubProcess_Option::getPolicy: get overflow policy */
+int SubProcess_Option::getPolicy()
+{
+   return m_policy;
+}
+
+/* SubProcess_Option::getMaxBytes: get capacity in bytes */
+int SubProcess_Option::getMaxBytes()
+{
+   return m_maxBytes;
+}
+
+/* SubProcess_Option::getMaxMessages: get capacity in messages */
+int SubProcess_Option::getMaxMessages()
+{
+   return m_maxMessages;
+}
+
+/* SubProcess_Option::getDeadline: get deadline of block policy */
+int SubProcess_Option::getDeadline()
+{
+   return m_deadline;
+}
+
+/* SubProcess_Option::getIdleTimeout: get idle period before stop */
+int SubProcess_Option::getIdleTimeout()
+{
+   return m_idleTimeout;
+}
+
+/* SubProcess_Option::getFlushWindow: get msec to hold messages */
+double SubProcess_Option::getFlushWindow()
+{
+   return m_flushWindow;
+}
+
+/* SubProcess_Option::getProtocol: get framing of messages */
+int SubProcess_Option::getProtocol()
+{
+   return m_protocol;
+}
+
+/* SubProcess_Option::getMaxFrame: get maximum size of received frame */
+int SubProcess_Option::getMaxFrame()
+{
+   return m_maxFrame;
+}
+
+/* SubProcess_Option::getTransport: get channel of messages */
+int SubProcess_Option::getTransport()
+{
+   return m_transport;
+}
+
+/* SubProcess_Option::getShmSize: get bytes of each shared-memory ring */
+int SubProcess_Option::getShmSize()
+{
+   return m_shmSize;
+}
+
+/* SubProcess_Option::getStandbys: get number of hot-standby replicas */
+int SubProcess_Option::getStandbys()
+{
+   return m_standbys;
+}
+
+/* SubProcess_Option::getWorkers: get number of workers of group */
+int SubProcess_Option::getWorkers()
+{
+   return m_workers;
+}
+
+/* SubProcess_Option::getBalance: get choice of worker */
+int SubProcess_Option::getBalance()
+{
+   return m_balance;
+}
+
+/* SubProcess_Option::getKey: get field of args hashed to choose worker */
+int SubProcess_Option::getKey()
+{
+   return m_key;
+}
+
+/* SubProcess_Option::getDrain: get msec to write pending messages when stopped */
+int SubProcess_Option::getDrain()
+{
+   return m_drain;
+}
+
+/* SubProcess_Option::getHupWait: get msec after SIGHUP before SIGTERM */
+int SubProcess_Option::getHupWait()
+{
+   return m_hupWait;
+}
+
+/* SubProcess_Option::getTermWait: get msec after SIGTERM before SIGKILL */
+int SubProcess_Option::getTermWait()
+{
+   return m_termWait;
+}
+
+/* SubProcess_Option::getCallTimeout: get msec to wait for reply of request, 0 for default */
+double SubProcess_Option::getCallTimeout()
+{
+   return m_callTimeout;
+}
+
+/* SubProcess_Option::getLimits: get placement and resource limits, NULL if none is given */
+const SubProcess_Limits *SubProcess_Option::getLimits()
+{
+   return (m_limited == true) ? &m_limits : NULL;
+}
+
+/* SubProcess_Option::parseCpus: parse list of CPUs such as "0-3:6" into mask, false on error */
+bool SubProcess_Option::parseCpus(const char *str, unsigned long long *mask)
+{
+   int first, last, i;
+   const char *p = str;
+   char *end;
+   unsigned long long buff[SUBPROCESSOPTION_CPUWORDS];
+
+   if(MMDAgent_strlen(str) == 0)
+      return false;
+
+   /* items are separated by ':' in option and may be by ',' in environment */
+   memset(buff, 0, sizeof(buff));
+   while(true) {
+      first = last = (int) strtol(p, &end, 10);
+      if(end == p)
+         return false;
+      p = end;
+      if(*p == '-') {
+         last = (int) strtol(++p, &end, 10);
+         if(end == p)
+            return false;
+         p = end;
+      }
+      if(first < 0 || last < first || last >= SUBPROCESSOPTION_MAXCPUS)
+         return false;
+      for(i = first; i <= last; i++)
+         buff[i / 64] |= 1ULL << (i % 64);
+      if(*p == '\0')
+         break;
+      if(*p != ':' && *p != ',')
+         return false;
+      p++;
+   }
+
+   memcpy(mask, buff, sizeof(buff));
+   return true;
+}
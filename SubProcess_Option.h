@@ -0,0 +1,209 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* definitions */
+
+#define SUBPROCESSOPTION_SEPARATOR ','
+#define SUBPROCESSOPTION_ASSIGN    '='
+
+#define SUBPROCESSOPTION_POLICY_DROPNEWEST 0 /* discard message which does not fit */
+#define SUBPROCESSOPTION_POLICY_DROPOLDEST 1 /* discard oldest pending messages to make room */
+#define SUBPROCESSOPTION_POLICY_BLOCK      2 /* wait for room until deadline, then discard */
+#define SUBPROCESSOPTION_POLICY_DISCONNECT 3 /* stop subprocess */
+
+#define SUBPROCESSOPTION_PROTOCOL_LINE  0 /* "type|args" terminated by newline */
+#define SUBPROCESSOPTION_PROTOCOL_FRAME 1 /* length-prefixed frames */
+
+#define SUBPROCESSOPTION_TRANSPORT_SOCKET 0 /* messages are carried by socketpair */
+#define SUBPROCESSOPTION_TRANSPORT_SHM    1 /* messages are carried by shared-memory rings */
+
+#define SUBPROCESSOPTION_BALANCE_LEAST      0 /* worker with fewest bytes not yet read */
+#define SUBPROCESSOPTION_BALANCE_ROUNDROBIN 1 /* workers in turn */
+#define SUBPROCESSOPTION_BALANCE_KEY        2 /* worker owning a field of args on consistent-hash ring */
+
+#define SUBPROCESSOPTION_SCHED_INHERIT 0 /* scheduling policy of plugin */
+#define SUBPROCESSOPTION_SCHED_OTHER   1 /* SCHED_OTHER */
+#define SUBPROCESSOPTION_SCHED_BATCH   2 /* SCHED_BATCH, CPU-bound without preemption of interactive tasks */
+#define SUBPROCESSOPTION_SCHED_IDLE    3 /* SCHED_IDLE, only when CPU is otherwise idle */
+
+#define SUBPROCESSOPTION_IOCLASS_INHERIT 0 /* I/O priority of plugin */
+#define SUBPROCESSOPTION_IOCLASS_RT      1 /* IOPRIO_CLASS_RT */
+#define SUBPROCESSOPTION_IOCLASS_BE      2 /* IOPRIO_CLASS_BE */
+#define SUBPROCESSOPTION_IOCLASS_IDLE    3 /* IOPRIO_CLASS_IDLE */
+
+#define SUBPROCESSOPTION_NICE_INHERIT 20 /* outside -20..19 */
+#define SUBPROCESSOPTION_MAXCPUS      1024
+#define SUBPROCESSOPTION_CPUWORDS     (SUBPROCESSOPTION_MAXCPUS / 64)
+
+#define SUBPROCESSOPTION_DEFAULT_POLICY      SUBPROCESSOPTION_POLICY_DROPNEWEST
+#define SUBPROCESSOPTION_DEFAULT_MAXBYTES    1048576
+#define SUBPROCESSOPTION_DEFAULT_MAXMESSAGES 4096
+#define SUBPROCESSOPTION_DEFAULT_DEADLINE    10 /* msec */
+#define SUBPROCESSOPTION_DEFAULT_MAXFRAME    16777216
+#define SUBPROCESSOPTION_DEFAULT_SHMSIZE     1048576
+#define SUBPROCESSOPTION_DEFAULT_DRAIN       100  /* msec */
+#define SUBPROCESSOPTION_DEFAULT_HUPWAIT     1000 /* msec */
+#define SUBPROCESSOPTION_DEFAULT_TERMWAIT    1000 /* msec */
+#define SUBPROCESSOPTION_MAXSTANDBYS         8
+#define SUBPROCESSOPTION_MAXWORKERS          64
+
+/* SubProcess_Limits: placement and resource limits applied to subprocess before exec */
+typedef struct _SubProcess_Limits {
+   unsigned long long cpus[SUBPROCESSOPTION_CPUWORDS]; /* mask of allowed CPUs, empty means inherited */
+   int nice;               /* nice value, SUBPROCESSOPTION_NICE_INHERIT if not given */
+   int sched;              /* scheduling policy */
+   int ioClass;            /* I/O scheduling class */
+   int ioLevel;            /* priority in I/O scheduling class, 0 (highest) to 7 */
+   long long memory;       /* RLIMIT_AS in bytes (0 means inherited) */
+   int cpuTime;            /* RLIMIT_CPU in sec (0 means inherited) */
+   char *cgroup;           /* cgroup-v2 directory where directory of subprocess is made (NULL means none) */
+   int cgroupCpu;          /* cpu.max of cgroup in percent of one CPU (0 means no cap) */
+   long long cgroupMemory; /* memory.max of cgroup in bytes (0 means no cap) */
+} SubProcess_Limits;
+
+/* SubProcess_Option: options given after alias as "alias,key=value,key=value" */
+class SubProcess_Option
+{
+private:
+
+   char *m_name; /* alias without options */
+
+   int m_policy;      /* overflow policy of outbound buffer */
+   int m_maxBytes;    /* capacity of outbound buffer in bytes */
+   int m_maxMessages; /* capacity of outbound buffer in messages */
+   int m_deadline;    /* deadline of block policy in msec */
+   int m_idleTimeout; /* idle period in msec before idle subprocesses are stopped (0 means never) */
+   double m_flushWindow; /* msec to hold messages to write them together (0 means write at once) */
+   int m_protocol;    /* framing of messages */
+   int m_maxFrame;    /* maximum size of received frame */
+   int m_transport;   /* channel of messages */
+   int m_shmSize;     /* bytes of each shared-memory ring (power of two) */
+   int m_standbys;    /* hot-standby replicas receiving the same input with output suppressed */
+   int m_workers;     /* workers of group sharing input, each message sent to one (0 means single subprocess) */
+   int m_balance;     /* choice of worker for a message */
+   int m_key;         /* field of args hashed to choose worker, from 1 */
+   int m_drain;       /* msec to write pending messages when stopped */
+   int m_hupWait;     /* msec after SIGHUP before SIGTERM */
+   int m_termWait;    /* msec after SIGTERM before SIGKILL */
+   double m_callTimeout; /* msec to wait for reply of SUBPROC_CALL (0 means SUBPROCESSCALL_TIMEOUT) */
+   SubProcess_Limits m_limits; /* placement and resource limits of subprocess */
+   bool m_limited;    /* true if any of limits is given */
+
+   /* initialize: initialize option */
+   void initialize();
+
+   /* set: set an option */
+   void set(const char *key, const char *value);
+
+public:
+
+   /* SubProcess_Option: option constructor */
+   SubProcess_Option();
+
+   /* ~SubProcess_Option: option destructor */
+   ~SubProcess_Option();
+
+   /* clear: free option */
+   void clear();
+
+   /* parse: parse alias field with options */
+   bool parse(const char *str);
+
+   /* getName: get alias */
+   const char *getName();
+
+   /* getPolicy: get overflow policy */
+   int getPolicy();
+
+   /* getMaxBytes: get capacity in bytes */
+   int getMaxBytes();
+
+   /* getMaxMessages: get capacity in messages */
+   int getMaxMessages();
+
+   /* getDeadline: get deadline of block policy */
+   int getDeadline();
+
+   /* getIdleTimeout: get idle period before stop */
+   int getIdleTimeout();
+
+   /* getFlushWindow: get msec to hold messages */
+   double getFlushWindow();
+
+   /* getProtocol: get framing of messages */
+   int getProtocol();
+
+   /* getMaxFrame: get maximum size of received frame */
+   int getMaxFrame();
+
+   /* getTransport: get channel of messages */
+   int getTransport();
+
+   /* getShmSize: get bytes of each shared-memory ring */
+   int getShmSize();
+
+   /* getStandbys: get number of hot-standby replicas */
+   int getStandbys();
+
+   /* getWorkers: get number of workers of group */
+   int getWorkers();
+
+   /* getBalance: get choice of worker */
+   int getBalance();
+
+   /* getKey: get field of args hashed to choose worker */
+   int getKey();
+
+   /* getDrain: get msec to write pending messages when stopped */
+   int getDrain();
+
+   /* getHupWait: get msec after SIGHUP before SIGTERM */
+   int getHupWait();
+
+   /* getTermWait: get msec after SIGTERM before SIGKILL */
+   int getTermWait();
+
+   /* getCallTimeout: get msec to wait for reply of request, 0 for default */
+   double getCallTimeout();
+
+   /* getLimits: get placement and resource limits, NULL if none is given */
+   const SubProcess_Limits *getLimits();
+
+   /* parseSize: parse bytes with optional suffix k, m or g, -1 on error */
+   static long long parseSize(const char *str);
+
+   /* parseCpus: parse list of CPUs such as "0-3:6" into mask, false on error */
+   static bool parseCpus(const char *str, unsigned long long *mask);
+};
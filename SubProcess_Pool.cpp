@@ -0,0 +1,374 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* headers */
+
+#include "MMDAgent.h"
+#include <sys/uio.h>
+#include <signal.h>
+
+#include "SubProcess_Stats.h"
+#include "SubProcess_Reactor.h"
+#include "SubProcess_Filter.h"
+#include "SubProcess_Option.h"
+#include "SubProcess_Slab.h"
+#include "SubProcess_Buffer.h"
+#include "SubProcess_Call.h"
+#include "SubProcess_Thread.h"
+#include "SubProcess_Table.h"
+#include "SubProcess_Pool.h"
+
+/* mainThread: main thread */
+static void mainThread(void *param)
+{
+   SubProcess_Pool *subprocess_pool = (SubProcess_Pool *) param;
+   subprocess_pool->run();
+}
+
+/* closeHandles: stop subprocesses */
+static void closeHandles(SubProcess_Table *table, int *handles, int num)
+{
+   int i;
+
+   for(i = 0; i < num; i++) {
+      table->signal(handles[i], SIGHUP);
+      table->close(handles[i]);
+   }
+}
+
+/* SubProcess_Pool::initialize: initialize pools */
+void SubProcess_Pool::initialize()
+{
+   m_mmdagent = NULL;
+   m_table = NULL;
+
+   m_mutex = NULL;
+   m_cond = NULL;
+   m_thread = -1;
+
+   m_kill = false;
+
+   m_pools = NULL;
+}
+
+/* SubProcess_Pool::clear: free pools */
+void SubProcess_Pool::clear()
+{
+   Pool *pool, *next;
+
+   m_kill = true;
+
+   /* stop thread */
+   if(m_cond != NULL)
+      glfwSignalCond(m_cond);
+   if(m_thread >= 0) {
+      glfwWaitThread(m_thread, GLFW_WAIT);
+      glfwDestroyThread(m_thread);
+   }
+   if(m_cond != NULL)
+      glfwDestroyCond(m_cond);
+   if(m_mutex != NULL)
+      glfwDestroyMutex(m_mutex);
+
+   for(pool = m_pools; pool != NULL; pool = next) {
+      next = pool->next;
+      freePool(pool);
+   }
+
+   initialize();
+}
+
+/* SubProcess_Pool::freePool: stop idle subprocesses and free pool */
+void SubProcess_Pool::freePool(Pool *pool)
+{
+   closeHandles(m_table, pool->handles, pool->numHandles);
+
+   free(pool->name);
+   free(pool->commandLine);
+   free(pool->handles);
+   delete pool;
+}
+
+/* SubProcess_Pool::report: send statistics of pool (mutex must be held) */
+void SubProcess_Pool::report(Pool *pool)
+{
+   m_mmdagent->sendMessage(SUBPROCESSPOOL_EVENTPOOL, "%s|%d|%lu|%lu", pool->name, pool->numHandles, pool->hits, pool->misses);
+}
+
+/* SubProcess_Pool::SubProcess_Pool: pool constructor */
+SubProcess_Pool::SubProcess_Pool()
+{
+   initialize();
+}
+
+/* SubProcess_Pool::~SubProcess_Pool: pool destructor */
+SubProcess_Pool::~SubProcess_Pool()
+{
+   clear();
+}
+
+/* SubProcess_Pool::start: start thread to fill pools, registering subprocesses to table */
+bool SubProcess_Pool::start(MMDAgent *mmdagent, SubProcess_Table *table)
+{
+   clear();
+
+   if(table == NULL)
+      return false;
+
+   m_mmdagent = mmdagent;
+   m_table = table;
+
+   m_mutex = glfwCreateMutex();
+   m_cond = glfwCreateCond();
+   m_thread = glfwCreateThread(mainThread, this);
+   if(m_mutex == NULL || m_cond == NULL || m_thread < 0) {
+      clear();
+      return false;
+   }
+
+   return true;
+}
+
+/* SubProcess_Pool::stop: stop thread and idle subprocesses */
+void SubProcess_Pool::stop()
+{
+   clear();
+}
+
+/* SubProcess_Pool::run: main loop */
+void SubProcess_Pool::run()
+{
+   int num, handle, *expired;
+   char *name, *commandLine;
+   double now;
+   Pool *pool;
+
+   glfwLockMutex(m_mutex);
+
+   while(m_kill == false) {
+      /* launch a subprocess for a pool which is not full */
+      for(pool = m_pools; pool != NULL; pool = pool->next)
+         if(pool->dormant == false && pool->numHandles + pool->numSpawning < pool->size)
+            break;
+
+      if(pool != NULL) {
+         pool->numSpawning++;
+         name = MMDAgent_strdup(pool->name);
+         commandLine = MMDAgent_strdup(pool->commandLine);
+         glfwUnlockMutex(m_mutex);
+
+         handle = m_table->open(commandLine, SUBPROCESSTABLE_STATE_IDLE);
+
+         /* pool may have been reconfigured meanwhile */
+         glfwLockMutex(m_mutex);
+         for(pool = m_pools; pool != NULL; pool = pool->next)
+            if(MMDAgent_strequal(pool->name, name) && MMDAgent_strequal(pool->commandLine, commandLine))
+               break;
+         if(pool != NULL) {
+            pool->numSpawning--;
+            if(handle >= 0 && pool->numHandles < pool->size) {
+               pool->handles[pool->numHandles++] = handle;
+               handle = -1;
+            } else if(handle < 0) {
+               /* give up until next claim not to retry failing command */
+               pool->dormant = true;
+            }
+         }
+         free(name);
+         free(commandLine);
+
+         if(handle >= 0) {
+            glfwUnlockMutex(m_mutex);
+            closeHandles(m_table, &handle, 1);
+            glfwLockMutex(m_mutex);
+         }
+         continue;
+      }
+
+      /* stop idle subprocesses of pools not claimed for a while */
+      now = glfwGetTime();
+      for(pool = m_pools; pool != NULL; pool = pool->next)
+         if(pool->idleTimeout > 0.0 && pool->dormant == false && pool->numHandles > 0 && now - pool->lastClaimed > pool->idleTimeout)
+            break;
+
+      if(pool != NULL) {
+         pool->dormant = true;
+         expired = pool->handles;
+         num = pool->numHandles;
+         pool->handles = (int *) malloc(sizeof(int) * pool->size);
+         pool->numHandles = 0;
+         report(pool);
+         glfwUnlockMutex(m_mutex);
+
+         closeHandles(m_table, expired, num);
+         free(expired);
+
+         glfwLockMutex(m_mutex);
+         continue;
+      }
+
+      glfwWaitCond(m_cond, m_mutex, SUBPROCESSPOOL_INTERVAL);
+   }
+
+   glfwUnlockMutex(m_mutex);
+}
+
+/* SubProcess_Pool::configure: set pool from "name|count|command", count of 0 removes it */
+void SubProcess_Pool::configure(const char *args)
+{
+   int size;
+   char *buff, *p, *q;
+   SubProcess_Option option;
+   Pool *pool, *prev = NULL, *removed = NULL;
+
+   if(m_mutex == NULL || MMDAgent_strlen(args) == 0)
+      return;
+
+   buff = MMDAgent_strdup(args);
+
+   /* name with options */
+   p = strchr(buff, SUBPROCESSTHREAD_SEPARATOR);
+   if(p == NULL) {
+      free(buff);
+      return;
+   }
+   *p++ = '\0';
+   if(option.parse(buff) == false) {
+      free(buff);
+      return;
+   }
+
+   /* count */
+   q = strchr(p, SUBPROCESSTHREAD_SEPARATOR);
+   if(q != NULL)
+      *q++ = '\0';
+   size = MMDAgent_str2int(p);
+   if(size < 0)
+      size = 0;
+
+   glfwLockMutex(m_mutex);
+
+   /* remove old pool of the name */
+   for(pool = m_pools; pool != NULL; pool = pool->next) {
+      if(MMDAgent_strequal(pool->name, option.getName())) {
+         if(prev == NULL)
+            m_pools = pool->next;
+         else
+            prev->next = pool->next;
+         removed = pool;
+         break;
+      }
+      prev = pool;
+   }
+
+   /* add new pool */
+   if(size > 0 && q != NULL) {
+      pool = new Pool;
+      pool->name = MMDAgent_strdup(option.getName());
+      pool->commandLine = SubProcess_Thread::getCommandLine(q);
+      pool->size = size;
+      pool->idleTimeout = option.getIdleTimeout() / 1000.0;
+      pool->handles = (int *) malloc(sizeof(int) * size);
+      pool->numHandles = 0;
+      pool->numSpawning = 0;
+      pool->lastClaimed = glfwGetTime();
+      pool->dormant = false;
+      pool->hits = (removed != NULL) ? removed->hits : 0;
+      pool->misses = (removed != NULL) ? removed->misses : 0;
+      pool->next = m_pools;
+      if(pool->commandLine == NULL) {
+         free(pool->name);
+         free(pool->handles);
+         delete pool;
+      } else {
+         /* keep idle subprocesses of the same command line */
+         if(removed != NULL && MMDAgent_strequal(removed->commandLine, pool->commandLine)) {
+            while(removed->numHandles > 0 && pool->numHandles < pool->size)
+               pool->handles[pool->numHandles++] = removed->handles[--removed->numHandles];
+         }
+         m_pools = pool;
+         report(pool);
+      }
+   }
+
+   glfwSignalCond(m_cond);
+   glfwUnlockMutex(m_mutex);
+
+   if(removed != NULL)
+      freePool(removed);
+
+   free(buff);
+}
+
+/* SubProcess_Pool::claim: take an idle subprocess of command line, return its handle or -1 if none */
+int SubProcess_Pool::claim(const char *commandLine)
+{
+   int i, handle = -1;
+   Pool *pool;
+
+   if(m_mutex == NULL || commandLine == NULL)
+      return -1;
+
+   glfwLockMutex(m_mutex);
+
+   for(pool = m_pools; pool != NULL; pool = pool->next)
+      if(MMDAgent_strequal(pool->commandLine, commandLine))
+         break;
+
+   if(pool != NULL) {
+      if(pool->numHandles > 0) {
+         /* take the oldest one */
+         handle = pool->handles[0];
+         for(i = 1; i < pool->numHandles; i++)
+            pool->handles[i - 1] = pool->handles[i];
+         pool->numHandles--;
+         pool->hits++;
+      } else {
+         pool->misses++;
+      }
+      pool->lastClaimed = glfwGetTime();
+      pool->dormant = false;
+      report(pool);
+
+      /* launch replacement */
+      glfwSignalCond(m_cond);
+   }
+
+   glfwUnlockMutex(m_mutex);
+
+   m_table->setState(handle, SUBPROCESSTABLE_STATE_RUNNING);
+
+   return handle;
+}
@@ -0,0 +1,107 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* definitions */
+
+#define SUBPROCESSPOOL_EVENTPOOL "SUBPROC_EVENT_POOL"
+#define SUBPROCESSPOOL_INTERVAL  1.0 /* sec, interval to check idle timeout */
+
+/* SubProcess_Pool: pools of pre-launched idle subprocesses claimed by SUBPROC_START */
+class SubProcess_Pool
+{
+private:
+
+   /* Pool: idle subprocesses of a command line */
+   typedef struct _Pool {
+      char *name;
+      char *commandLine;
+      int size;             /* number of idle subprocesses to be kept */
+      double idleTimeout;   /* sec, idle subprocesses are stopped when not claimed for this period (0 means never) */
+      int *handles;         /* idle subprocesses in process table */
+      int numHandles;
+      int numSpawning;      /* subprocesses being launched by thread */
+      double lastClaimed;
+      bool dormant;         /* idle timeout expired, refilled on next claim */
+      unsigned long hits;
+      unsigned long misses;
+      struct _Pool *next;
+   } Pool;
+
+   MMDAgent *m_mmdagent;
+   SubProcess_Table *m_table; /* process table where idle subprocesses are registered */
+
+   GLFWmutex m_mutex;
+   GLFWcond m_cond;
+   GLFWthread m_thread;
+
+   bool m_kill;
+
+   Pool *m_pools;
+
+   /* initialize: initialize pools */
+   void initialize();
+
+   /* clear: free pools */
+   void clear();
+
+   /* freePool: stop idle subprocesses and free pool */
+   void freePool(Pool *pool);
+
+   /* report: send statistics of pool (mutex must be held) */
+   void report(Pool *pool);
+
+public:
+
+   /* SubProcess_Pool: pool constructor */
+   SubProcess_Pool();
+
+   /* ~SubProcess_Pool: pool destructor */
+   ~SubProcess_Pool();
+
+   /* start: start thread to fill pools, registering subprocesses to table */
+   bool start(MMDAgent *mmdagent, SubProcess_Table *table);
+
+   /* stop: stop thread and idle subprocesses */
+   void stop();
+
+   /* run: main loop */
+   void run();
+
+   /* configure: set pool from "name|count|command", count of 0 removes it */
+   void configure(const char *args);
+
+   /* claim: take an idle subprocess of command line, return its handle or -1 if none */
+   int claim(const char *commandLine);
+};
@@ -0,0 +1,282 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* headers */
+
+#include "MMDAgent.h"
+#include <sys/uio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "SubProcess_Stats.h"
+#include "SubProcess_Reactor.h"
+#include "SubProcess_Filter.h"
+#include "SubProcess_Option.h"
+#include "SubProcess_Slab.h"
+#include "SubProcess_Buffer.h"
+#include "SubProcess_Call.h"
+#include "SubProcess_Thread.h"
+
+/* mainThread: main thread */
+static void mainThread(void *param)
+{
+   SubProcess_Reactor *subprocess_reactor = (SubProcess_Reactor *) param;
+   sppin();
+   subprocess_reactor->run();
+}
+
+/* SubProcess_Reactor::initialize: initialize reactor */
+void SubProcess_Reactor::initialize()
+{
+   m_mutex = NULL;
+   m_thread = -1;
+
+   m_epollfd = -1;
+   m_eventfd = -1;
+
+   m_slots = NULL;
+   m_numSlots = 0;
+   m_numProcs = 0;
+
+   m_kill = false;
+}
+
+/* SubProcess_Reactor::clear: free reactor */
+void SubProcess_Reactor::clear()
+{
+   m_kill = true;
+
+   /* wake up and stop thread */
+   if(m_eventfd >= 0)
+      eventfd_write(m_eventfd, 1);
+   if(m_thread >= 0) {
+      glfwWaitThread(m_thread, GLFW_WAIT);
+      glfwDestroyThread(m_thread);
+   }
+
+   if(m_mutex != NULL)
+      glfwDestroyMutex(m_mutex);
+   if(m_epollfd >= 0)
+      close(m_epollfd);
+   if(m_eventfd >= 0)
+      close(m_eventfd);
+   free(m_slots);
+
+   initialize();
+}
+
+/* SubProcess_Reactor::release: unregister slot (mutex must be held) */
+void SubProcess_Reactor::release(int index)
+{
+   Slot *slot = &m_slots[index];
+
+   if(slot->proc == NULL)
+      return;
+
+   epoll_ctl(m_epollfd, EPOLL_CTL_DEL, slot->fd, NULL);
+   slot->proc = NULL;
+   slot->fd = -1;
+   slot->generation++;
+   m_numProcs--;
+}
+
+/* SubProcess_Reactor::releaseAll: unregister all slots of subprocess (mutex must be held) */
+void SubProcess_Reactor::releaseAll(SubProcess_Thread *proc)
+{
+   int i;
+
+   for(i = 0; i < m_numSlots; i++)
+      if(m_slots[i].proc == proc)
+         release(i);
+}
+
+/* SubProcess_Reactor::SubProcess_Reactor: reactor constructor */
+SubProcess_Reactor::SubProcess_Reactor()
+{
+   initialize();
+}
+
+/* SubProcess_Reactor::~SubProcess_Reactor: reactor destructor */
+SubProcess_Reactor::~SubProcess_Reactor()
+{
+   clear();
+}
+
+/* SubProcess_Reactor::start: create epoll instance and start thread */
+bool SubProcess_Reactor::start()
+{
+   struct epoll_event ev;
+
+   clear();
+
+   m_epollfd = epoll_create1(EPOLL_CLOEXEC);
+   m_eventfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+   if(m_epollfd < 0 || m_eventfd < 0) {
+      clear();
+      return false;
+   }
+
+   /* stop request is delivered with data of -1 */
+   ev.events = EPOLLIN;
+   ev.data.u64 = (unsigned long long) -1;
+   if(epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_eventfd, &ev) < 0) {
+      clear();
+      return false;
+   }
+
+   m_mutex = glfwCreateMutex();
+   m_thread = glfwCreateThread(mainThread, this);
+   if(m_mutex == NULL || m_thread < 0) {
+      clear();
+      return false;
+   }
+
+   return true;
+}
+
+/* SubProcess_Reactor::stop: stop thread and release */
+void SubProcess_Reactor::stop()
+{
+   clear();
+}
+
+/* SubProcess_Reactor::run: main loop */
+void SubProcess_Reactor::run()
+{
+   int i, n, index;
+   unsigned int generation;
+   struct epoll_event events[SUBPROCESSREACTOR_MAXEVENTS];
+   Slot *slot;
+   SubProcess_Thread *proc;
+
+   while(m_kill == false) {
+      n = epoll_wait(m_epollfd, events, SUBPROCESSREACTOR_MAXEVENTS, -1);
+      if(n < 0) {
+         if(errno == EINTR)
+            continue;
+         break;
+      }
+
+      glfwLockMutex(m_mutex);
+
+      for(i = 0; i < n && m_kill == false; i++) {
+         if(events[i].data.u64 == (unsigned long long) -1)
+            continue;
+
+         /* skip events of slots unregistered after epoll_wait */
+         index = (int) (events[i].data.u64 & 0xffffffffULL);
+         generation = (unsigned int) (events[i].data.u64 >> 32);
+         if(index >= m_numSlots)
+            continue;
+         slot = &m_slots[index];
+         if(slot->proc == NULL || slot->generation != generation)
+            continue;
+
+         if(events[i].events & EPOLLIN) {
+            /* receive messages, remaining data is reported again */
+            if(slot->proc->receive() == true)
+               continue;
+         } else if(!(events[i].events & (EPOLLHUP | EPOLLERR))) {
+            continue;
+         }
+
+         /* subprocess stopped */
+         proc = slot->proc;
+         proc->hangup();
+         releaseAll(proc);
+      }
+
+      glfwUnlockMutex(m_mutex);
+   }
+}
+
+/* SubProcess_Reactor::add: register descriptor of subprocess, a subprocess may have more than one */
+bool SubProcess_Reactor::add(SubProcess_Thread *proc, int fd)
+{
+   int i;
+   struct epoll_event ev;
+   Slot *slot;
+
+   if(m_mutex == NULL || proc == NULL || fd < 0)
+      return false;
+
+   glfwLockMutex(m_mutex);
+
+   for(i = 0; i < m_numSlots; i++)
+      if(m_slots[i].proc == NULL)
+         break;
+
+   if(i == m_numSlots) {
+      m_slots = (Slot *) realloc(m_slots, sizeof(Slot) * (m_numSlots + 1));
+      m_slots[i].proc = NULL;
+      m_slots[i].fd = -1;
+      m_slots[i].generation = 0;
+      m_numSlots++;
+   }
+
+   slot = &m_slots[i];
+   ev.events = EPOLLIN | EPOLLRDHUP;
+   ev.data.u64 = ((unsigned long long) slot->generation << 32) | (unsigned long long) i;
+   if(epoll_ctl(m_epollfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      glfwUnlockMutex(m_mutex);
+      return false;
+   }
+   slot->proc = proc;
+   slot->fd = fd;
+   m_numProcs++;
+
+   glfwUnlockMutex(m_mutex);
+
+   return true;
+}
+
+/* SubProcess_Reactor::remove: unregister all descriptors of subprocess, no event is handled for it after return */
+void SubProcess_Reactor::remove(SubProcess_Thread *proc)
+{
+   if(m_mutex == NULL)
+      return;
+
+   glfwLockMutex(m_mutex);
+   releaseAll(proc);
+   glfwUnlockMutex(m_mutex);
+}
+
+/* SubProcess_Reactor::getNumProcs: get number of registered subprocesses */
+int SubProcess_Reactor::getNumProcs()
+{
+   return m_numProcs;
+}
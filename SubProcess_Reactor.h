@@ -0,0 +1,105 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* definitions */
+
+#define SUBPROCESSREACTOR_ENVENGINE   "SUBPROC_IOENGINE"  /* "thread" (default) or "epoll" */
+#define SUBPROCESSREACTOR_ENVREACTORS "SUBPROC_REACTORS"  /* number of reactor threads in epoll mode */
+#define SUBPROCESSREACTOR_MAXEVENTS   64
+
+class SubProcess_Thread;
+
+/* SubProcess_Reactor: thread watching sockets of many subprocesses with epoll */
+class SubProcess_Reactor
+{
+private:
+
+   /* Slot: registered subprocess */
+   typedef struct _Slot {
+      SubProcess_Thread *proc; /* NULL means free */
+      int fd;
+      unsigned int generation; /* incremented on reuse not to deliver stale events */
+   } Slot;
+
+   GLFWmutex m_mutex; /* mutual exclusion for slots, held while handling events */
+   GLFWthread m_thread;
+
+   int m_epollfd;
+   int m_eventfd; /* eventfd to stop thread */
+
+   Slot *m_slots;
+   int m_numSlots;
+   int m_numProcs;
+
+   bool m_kill;
+
+   /* initialize: initialize reactor */
+   void initialize();
+
+   /* clear: free reactor */
+   void clear();
+
+   /* release: unregister slot (mutex must be held) */
+   void release(int index);
+
+   /* releaseAll: unregister all slots of subprocess (mutex must be held) */
+   void releaseAll(SubProcess_Thread *proc);
+
+public:
+
+   /* SubProcess_Reactor: reactor constructor */
+   SubProcess_Reactor();
+
+   /* ~SubProcess_Reactor: reactor destructor */
+   ~SubProcess_Reactor();
+
+   /* start: create epoll instance and start thread */
+   bool start();
+
+   /* stop: stop thread and release */
+   void stop();
+
+   /* run: main loop */
+   void run();
+
+   /* add: register descriptor of subprocess, a subprocess may have more than one */
+   bool add(SubProcess_Thread *proc, int fd);
+
+   /* remove: unregister all descriptors of subprocess, no event is handled for it after return */
+   void remove(SubProcess_Thread *proc);
+
+   /* getNumProcs: get number of registered subprocesses */
+   int getNumProcs();
+};
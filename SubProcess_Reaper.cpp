@@ -0,0 +1,382 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* headers */
+
+#include "MMDAgent.h"
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#include "SubProcess_Stats.h"
+#include "SubProcess_Reactor.h"
+#include "SubProcess_Filter.h"
+#include "SubProcess_Option.h"
+#include "SubProcess_Slab.h"
+#include "SubProcess_Buffer.h"
+#include "SubProcess_Call.h"
+#include "SubProcess_Thread.h"
+#include "SubProcess_Table.h"
+#include "SubProcess_Reaper.h"
+
+/* mainThread: main thread */
+static void mainThread(void *param)
+{
+   SubProcess_Reaper *subprocess_reaper = (SubProcess_Reaper *) param;
+   subprocess_reaper->run();
+}
+
+/* SubProcess_Reaper::initialize: initialize reaper */
+void SubProcess_Reaper::initialize()
+{
+   m_table = NULL;
+
+   m_mutex = NULL;
+   m_thread = -1;
+
+   m_eventfd = -1;
+   m_running = false;
+   m_kill = false;
+
+   m_added = NULL;
+   m_entries = NULL;
+
+   m_pfd = NULL;
+   m_pfdSize = 0;
+}
+
+/* SubProcess_Reaper::clear: free reaper */
+void SubProcess_Reaper::clear()
+{
+   Entry *entry;
+
+   /* wake up and stop thread after remaining subprocesses */
+   if(m_mutex != NULL) {
+      glfwLockMutex(m_mutex);
+      m_kill = true;
+      glfwUnlockMutex(m_mutex);
+   }
+   if(m_eventfd >= 0)
+      eventfd_write(m_eventfd, 1);
+   if(m_thread >= 0) {
+      glfwWaitThread(m_thread, GLFW_WAIT);
+      glfwDestroyThread(m_thread);
+   }
+
+   /* entries added while thread was starting */
+   while((entry = m_added) != NULL) {
+      m_added = entry->next;
+      reap(entry);
+   }
+
+   if(m_mutex != NULL)
+      glfwDestroyMutex(m_mutex);
+   if(m_eventfd >= 0)
+      close(m_eventfd);
+   free(m_pfd);
+
+   initialize();
+}
+
+/* SubProcess_Reaper::advance: escalate stage of entry as it drains or times out, return true when subprocess exited */
+bool SubProcess_Reaper::advance(Entry *entry, double now)
+{
+   if(entry->handle < 0)
+      return true;
+
+   /* exited, left for process table to collect */
+   if(m_table->hasExited(entry->handle, &entry->status) == true)
+      return true;
+
+   switch(entry->stage) {
+   case SUBPROCESSREAPER_STAGE_WATCH:
+      if(now < entry->deadline)
+         break;
+      /* stream was closed but subprocess keeps running, it is not signaled as nobody asked to stop it */
+      entry->status = SUBPROCESSTHREAD_STATUSUNKNOWN;
+      return true;
+   case SUBPROCESSREAPER_STAGE_DRAIN:
+      if(entry->proc->flush() == 0 && entry->proc->hasPending() == true && now < entry->deadline)
+         break;
+      /* end of input lets subprocess finish what it has read, then hang-up as before */
+      shutdown(entry->proc->getFd(), SHUT_WR);
+      m_table->signal(entry->handle, SIGHUP);
+      entry->stage = SUBPROCESSREAPER_STAGE_HUP;
+      entry->deadline = now + entry->hupWait;
+      break;
+   case SUBPROCESSREAPER_STAGE_HUP:
+      if(now < entry->deadline)
+         break;
+      m_table->signal(entry->handle, SIGTERM);
+      entry->stage = SUBPROCESSREAPER_STAGE_TERM;
+      entry->deadline = now + entry->termWait;
+      break;
+   case SUBPROCESSREAPER_STAGE_TERM:
+      if(now < entry->deadline)
+         break;
+      m_table->signal(entry->handle, SIGKILL);
+      entry->stage = SUBPROCESSREAPER_STAGE_KILL;
+      break;
+   }
+
+   return false;
+}
+
+/* SubProcess_Reaper::getTimeout: get msec until entry needs to be advanced, -1 for none */
+int SubProcess_Reaper::getTimeout(Entry *entry, double now)
+{
+   double sec;
+
+   if(entry->stage == SUBPROCESSREAPER_STAGE_KILL)
+      sec = -1.0;
+   else
+      sec = (entry->deadline > now) ? entry->deadline - now : 0.0;
+
+   /* pending messages and exit without pidfd are checked at interval */
+   if((entry->stage == SUBPROCESSREAPER_STAGE_DRAIN || entry->pidfd < 0) && (sec < 0.0 || sec > SUBPROCESSREAPER_INTERVAL))
+      sec = SUBPROCESSREAPER_INTERVAL;
+
+   return (sec < 0.0) ? -1 : (int) (sec * 1000.0 + 0.999);
+}
+
+/* SubProcess_Reaper::finish: release torn-down subprocess and free entry */
+void SubProcess_Reaper::finish(Entry *entry)
+{
+   double msec = (entry->status == SUBPROCESSTHREAD_STATUSUNKNOWN) ? -1.0 : (glfwGetTime() - entry->start) * 1000.0;
+
+   /* watched subprocess is still owned by caller */
+   if(entry->notify == true && entry->stage == SUBPROCESSREAPER_STAGE_WATCH)
+      entry->proc->exited(entry->status, msec);
+   else if(entry->notify == true)
+      entry->proc->stopAndRelease(entry->status, msec);
+   if(entry->func != NULL)
+      entry->func(entry->param);
+
+   free(entry);
+}
+
+/* SubProcess_Reaper::reap: tear down entry in calling thread, when thread is not running */
+void SubProcess_Reaper::reap(Entry *entry)
+{
+   int timeout;
+   struct pollfd pfd;
+
+   /* caller of watch is reader of subprocess, which must not wait for its exit */
+   if(entry->stage == SUBPROCESSREAPER_STAGE_WATCH)
+      entry->deadline = entry->start;
+
+   while(advance(entry, glfwGetTime()) == false) {
+      timeout = getTimeout(entry, glfwGetTime());
+      if(entry->pidfd >= 0) {
+         pfd.fd = entry->pidfd;
+         pfd.events = POLLIN;
+         poll(&pfd, 1, timeout);
+      } else {
+         poll(NULL, 0, timeout);
+      }
+   }
+
+   finish(entry);
+}
+
+/* SubProcess_Reaper::newEntry: allocate entry of subprocess at first stage */
+SubProcess_Reaper::Entry *SubProcess_Reaper::newEntry(SubProcess_Thread *proc, bool notify, int stage, double wait, SubProcess_ReapFunc func, void *param)
+{
+   Entry *entry = (Entry *) malloc(sizeof(Entry));
+
+   entry->proc = proc;
+   entry->notify = notify;
+   entry->func = func;
+   entry->param = param;
+   entry->handle = (m_table != NULL) ? proc->getHandle() : -1;
+   entry->pidfd = (entry->handle >= 0) ? m_table->getPidfd(entry->handle) : -1;
+   entry->status = 0;
+   entry->stage = stage;
+   entry->start = glfwGetTime();
+   entry->deadline = entry->start + wait;
+   entry->hupWait = proc->getHupWait() / 1000.0;
+   entry->termWait = proc->getTermWait() / 1000.0;
+   entry->next = NULL;
+
+   return entry;
+}
+
+/* SubProcess_Reaper::push: pass entry to thread, or tear it down in calling thread when thread is not running */
+void SubProcess_Reaper::push(Entry *entry)
+{
+   if(m_mutex != NULL) {
+      glfwLockMutex(m_mutex);
+      if(m_running == true) {
+         entry->next = m_added;
+         m_added = entry;
+         entry = NULL;
+         eventfd_write(m_eventfd, 1);
+      }
+      glfwUnlockMutex(m_mutex);
+   }
+   if(entry != NULL)
+      reap(entry);
+}
+
+/* SubProcess_Reaper::SubProcess_Reaper: reaper constructor */
+SubProcess_Reaper::SubProcess_Reaper()
+{
+   initialize();
+}
+
+/* SubProcess_Reaper::~SubProcess_Reaper: reaper destructor */
+SubProcess_Reaper::~SubProcess_Reaper()
+{
+   clear();
+}
+
+/* SubProcess_Reaper::start: start thread for subprocesses registered to table */
+bool SubProcess_Reaper::start(SubProcess_Table *table)
+{
+   clear();
+
+   if(table == NULL)
+      return false;
+   m_table = table;
+
+   m_eventfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+   m_mutex = glfwCreateMutex();
+   if(m_eventfd < 0 || m_mutex == NULL) {
+      clear();
+      return false;
+   }
+
+   m_running = true;
+   m_thread = glfwCreateThread(mainThread, this);
+   if(m_thread < 0) {
+      clear();
+      return false;
+   }
+
+   return true;
+}
+
+/* SubProcess_Reaper::stop: wait until all subprocesses are torn down and stop thread */
+void SubProcess_Reaper::stop()
+{
+   clear();
+}
+
+/* SubProcess_Reaper::run: main loop */
+void SubProcess_Reaper::run()
+{
+   int n, timeout, t;
+   double now;
+   bool finished;
+   eventfd_t value;
+   Entry *entry, **p;
+
+   while(true) {
+      /* take added entries, or finish when all are torn down after stop request */
+      glfwLockMutex(m_mutex);
+      while((entry = m_added) != NULL) {
+         m_added = entry->next;
+         entry->next = m_entries;
+         m_entries = entry;
+      }
+      if(m_entries == NULL && m_kill == true) {
+         m_running = false;
+         glfwUnlockMutex(m_mutex);
+         break;
+      }
+      glfwUnlockMutex(m_mutex);
+
+      /* room for eventfd and pidfd of each entry */
+      for(n = 1, entry = m_entries; entry != NULL; entry = entry->next, n++);
+      if(n > m_pfdSize) {
+         m_pfdSize = n * 2;
+         m_pfd = (struct pollfd *) realloc(m_pfd, sizeof(struct pollfd) * m_pfdSize);
+      }
+
+      now = glfwGetTime();
+      timeout = -1;
+      n = 0;
+      m_pfd[n].fd = m_eventfd;
+      m_pfd[n++].events = POLLIN;
+      finished = false;
+      for(p = &m_entries; (entry = *p) != NULL;) {
+         if(advance(entry, now) == true) {
+            *p = entry->next;
+            finish(entry);
+            finished = true;
+            continue;
+         }
+         t = getTimeout(entry, now);
+         if(t >= 0 && (timeout < 0 || t < timeout))
+            timeout = t;
+         if(entry->pidfd >= 0) {
+            m_pfd[n].fd = entry->pidfd;
+            m_pfd[n++].events = POLLIN;
+         }
+         p = &entry->next;
+      }
+
+      /* stop request may have come while last one was torn down */
+      if(finished == true)
+         continue;
+
+      if(poll(m_pfd, n, timeout) > 0 && (m_pfd[0].revents & POLLIN))
+         eventfd_read(m_eventfd, &value);
+   }
+}
+
+/* SubProcess_Reaper::add: take over stopping subprocess, calling func with param after it exited and was released */
+void SubProcess_Reaper::add(SubProcess_Thread *proc, bool notify, SubProcess_ReapFunc func, void *param)
+{
+   Entry *entry;
+
+   /* hang-up from now on is on purpose */
+   proc->stopping();
+
+   entry = newEntry(proc, notify, SUBPROCESSREAPER_STAGE_DRAIN, proc->getDrain() / 1000.0, func, param);
+   if(entry->handle >= 0)
+      m_table->setState(entry->handle, SUBPROCESSTABLE_STATE_STOPPING);
+
+   /* subprocess is torn down here if thread has stopped */
+   push(entry);
+}
+
+/* SubProcess_Reaper::watch: wait for exit of subprocess which hung up by itself, sending stop event and calling func with param, without releasing it */
+void SubProcess_Reaper::watch(SubProcess_Thread *proc, SubProcess_ReapFunc func, void *param)
+{
+   push(newEntry(proc, true, SUBPROCESSREAPER_STAGE_WATCH, SUBPROCESSREAPER_HANGUPWAIT, func, param));
+}
@@ -0,0 +1,133 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* definitions */
+
+#define SUBPROCESSREAPER_INTERVAL   0.01 /* sec, interval to check pending messages, and exit when pidfd is not available */
+#define SUBPROCESSREAPER_HANGUPWAIT 1.0  /* sec to wait for exit of subprocess which hung up by itself */
+
+#define SUBPROCESSREAPER_STAGE_DRAIN 0 /* writing pending messages */
+#define SUBPROCESSREAPER_STAGE_HUP   1 /* input closed and SIGHUP sent */
+#define SUBPROCESSREAPER_STAGE_TERM  2 /* SIGTERM sent */
+#define SUBPROCESSREAPER_STAGE_KILL  3 /* SIGKILL sent */
+#define SUBPROCESSREAPER_STAGE_WATCH 4 /* hung up by itself, waiting for exit without signals */
+
+/* SubProcess_ReapFunc: handler called by reaper after subprocess is torn down, to free its owner */
+typedef void (*SubProcess_ReapFunc)(void *param);
+
+/* SubProcess_Reaper: thread tearing down stopped subprocesses, so that no caller waits for their exit */
+class SubProcess_Reaper
+{
+private:
+
+   /* Entry: subprocess being torn down */
+   typedef struct _Entry {
+      SubProcess_Thread *proc;
+      bool notify;              /* send stop event with exit status, on release or, when watched, on exit */
+      SubProcess_ReapFunc func; /* called at last, NULL if none */
+      void *param;
+      int handle;               /* handle of subprocess in process table, -1 if not running */
+      int pidfd;                /* readable on exit, owned by process table, -1 if not supported */
+      int status;               /* exit code or negative signal */
+      int stage;
+      double start;             /* time when stop was requested or hang-up was seen */
+      double deadline;          /* time when stage escalates */
+      double hupWait;           /* sec after SIGHUP before SIGTERM */
+      double termWait;          /* sec after SIGTERM before SIGKILL */
+      struct _Entry *next;
+   } Entry;
+
+   SubProcess_Table *m_table; /* process table where subprocesses are registered */
+
+   GLFWmutex m_mutex; /* mutual exclusion for added entries */
+   GLFWthread m_thread;
+
+   int m_eventfd;     /* wakes up thread when entry is added */
+   bool m_running;    /* thread takes added entries, with mutex */
+   bool m_kill;       /* thread stops after all entries are torn down */
+
+   Entry *m_added;    /* entries added by other threads, with mutex */
+   Entry *m_entries;  /* entries being torn down by thread */
+
+   struct pollfd *m_pfd; /* descriptors to wait for */
+   int m_pfdSize;
+
+   /* initialize: initialize reaper */
+   void initialize();
+
+   /* clear: free reaper */
+   void clear();
+
+   /* advance: escalate stage of entry as it drains or times out, return true when subprocess exited */
+   bool advance(Entry *entry, double now);
+
+   /* getTimeout: get msec until entry needs to be advanced, -1 for none */
+   int getTimeout(Entry *entry, double now);
+
+   /* finish: release torn-down subprocess and free entry */
+   void finish(Entry *entry);
+
+   /* reap: tear down entry in calling thread, when thread is not running */
+   void reap(Entry *entry);
+
+   /* newEntry: allocate entry of subprocess at first stage */
+   Entry *newEntry(SubProcess_Thread *proc, bool notify, int stage, double wait, SubProcess_ReapFunc func, void *param);
+
+   /* push: pass entry to thread, or tear it down in calling thread when thread is not running */
+   void push(Entry *entry);
+
+public:
+
+   /* SubProcess_Reaper: reaper constructor */
+   SubProcess_Reaper();
+
+   /* ~SubProcess_Reaper: reaper destructor */
+   ~SubProcess_Reaper();
+
+   /* start: start thread for subprocesses registered to table */
+   bool start(SubProcess_Table *table);
+
+   /* stop: wait until all subprocesses are torn down and stop thread */
+   void stop();
+
+   /* run: main loop */
+   void run();
+
+   /* add: take over stopping subprocess, calling func with param after it exited and was released */
+   void add(SubProcess_Thread *proc, bool notify, SubProcess_ReapFunc func, void *param);
+
+   /* watch: wait for exit of subprocess which hung up by itself, sending stop event and calling func with param, without releasing it */
+   void watch(SubProcess_Thread *proc, SubProcess_ReapFunc func, void *param);
+};
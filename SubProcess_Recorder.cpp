@@ -0,0 +1,270 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* headers */
+
+#include "MMDAgent.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "SubProcess_Option.h"
+#include "SubProcess_Recorder.h"
+
+/* echoHash: hash of message type and args (FNV-1a), never 0 */
+static unsigned long echoHash(const char *type, const char *args)
+{
+   const char *p;
+   unsigned long h = 2166136261UL;
+
+   for(p = type; *p != '\0'; p++) {
+      h ^= (unsigned char) *p;
+      h *= 16777619UL;
+   }
+   h ^= (unsigned char) '|';
+   h *= 16777619UL;
+   for(p = args; *p != '\0'; p++) {
+      h ^= (unsigned char) *p;
+      h *= 16777619UL;
+   }
+
+   return (h != 0) ? h : 1;
+}
+
+/* SubProcess_Recorder::initialize: initialize recorder */
+void SubProcess_Recorder::initialize()
+{
+   m_file = NULL;
+   m_size = 0;
+   m_used = 0;
+   m_fd = -1;
+   m_start = 0.0;
+
+   m_mutex = NULL;
+   m_echoHead = 0;
+   m_echoNum = 0;
+}
+
+/* SubProcess_Recorder::echo: find and forget forwarded message echoed by main program, copying its alias into buff, return false if none */
+bool SubProcess_Recorder::echo(const char *type, const char *args, char *buff)
+{
+   int i, j;
+   unsigned long h;
+   bool found = false;
+
+   /* most messages of main program are not echoes */
+   if(__atomic_load_n(&m_echoNum, __ATOMIC_RELAXED) == 0)
+      return false;
+
+   h = echoHash(type, args);
+   glfwLockMutex(m_mutex);
+   for(i = 0; i < m_echoNum; i++) {
+      j = (m_echoHead + i) % SUBPROCESSRECORDER_ECHOES;
+      if(m_echoes[j].hash == h) {
+         strcpy(buff, m_echoes[j].alias);
+         m_echoes[j].hash = 0;
+         found = true;
+         break;
+      }
+   }
+   /* drop echoed ones from oldest side */
+   while(m_echoNum > 0 && m_echoes[m_echoHead].hash == 0) {
+      m_echoHead = (m_echoHead + 1) % SUBPROCESSRECORDER_ECHOES;
+      __atomic_store_n(&m_echoNum, m_echoNum - 1, __ATOMIC_RELAXED);
+   }
+   glfwUnlockMutex(m_mutex);
+
+   return found;
+}
+
+/* SubProcess_Recorder::SubProcess_Recorder: recorder constructor */
+SubProcess_Recorder::SubProcess_Recorder()
+{
+   initialize();
+}
+
+/* SubProcess_Recorder::~SubProcess_Recorder: recorder destructor */
+SubProcess_Recorder::~SubProcess_Recorder()
+{
+   clear();
+}
+
+/* SubProcess_Recorder::setup: start recording if file is given */
+bool SubProcess_Recorder::setup()
+{
+   long long size = SUBPROCRECORD_SIZE;
+   const char *path = getenv(SUBPROCRECORD_ENV);
+   const char *env = getenv(SUBPROCRECORD_ENVSIZE);
+   SubProcRecord_Header *header;
+   void *p;
+
+   clear();
+
+   if(MMDAgent_strlen(path) == 0)
+      return false;
+   if(env != NULL && SubProcess_Option::parseSize(env) > (long long) sizeof(SubProcRecord_Header))
+      size = SubProcess_Option::parseSize(env);
+
+   /* sparse file, pages are allocated as records are appended */
+   m_fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   if(m_fd < 0 || ftruncate(m_fd, size) < 0) {
+      clear();
+      return false;
+   }
+   p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+   if(p == MAP_FAILED) {
+      clear();
+      return false;
+   }
+
+   m_file = (char *) p;
+   m_size = size;
+   m_used = sizeof(SubProcRecord_Header);
+   m_start = glfwGetTime();
+   m_mutex = glfwCreateMutex();
+
+   header = (SubProcRecord_Header *) m_file;
+   header->version = SUBPROCRECORD_VERSION;
+   header->pid = (int32_t) getpid();
+   header->align = SUBPROCRECORD_ALIGN;
+   __atomic_store_n(&header->magic, SUBPROCRECORD_MAGIC, __ATOMIC_RELEASE);
+
+   return true;
+}
+
+/* SubProcess_Recorder::clear: truncate file to recorded length and close it */
+void SubProcess_Recorder::clear()
+{
+   uint64_t used = 0;
+
+   if(m_file != NULL) {
+      used = (m_used < m_size) ? m_used : m_size;
+      ((SubProcRecord_Header *) m_file)->used = used;
+      munmap(m_file, m_size);
+   }
+   if(m_fd >= 0) {
+      /* file keeps its mapped size on failure, readers stop at first incomplete record */
+      if(used > 0 && ftruncate(m_fd, used) < 0)
+         used = 0;
+      close(m_fd);
+   }
+   if(m_mutex != NULL)
+      glfwDestroyMutex(m_mutex);
+
+   initialize();
+}
+
+/* SubProcess_Recorder::record: append message of time with alias of subprocess, NULL for main program (any thread) */
+void SubProcess_Recorder::record(int kind, const char *alias, const char *type, const char *args, double time)
+{
+   uint64_t aliaslen, typelen, argslen, size, offset;
+   double usec;
+   char *p;
+   SubProcRecord_Entry *entry;
+   char buff[SUBPROCESSRECORDER_ALIASLEN];
+
+   if(m_file == NULL)
+      return;
+
+   if(args == NULL)
+      args = "";
+   if(kind == SUBPROCRECORD_ENQUEUE && alias == NULL && MMDAgent_strlen(type) > 0 && echo(type, args, buff) == true)
+      alias = buff;
+   if(alias == NULL)
+      alias = "";
+   aliaslen = strlen(alias);
+   typelen = MMDAgent_strlen(type);
+   argslen = strlen(args);
+   if(aliaslen > 0xffff || typelen == 0)
+      return;
+   size = (sizeof(SubProcRecord_Entry) + aliaslen + typelen + argslen + 3 + SUBPROCRECORD_ALIGN - 1) & ~((uint64_t) SUBPROCRECORD_ALIGN - 1);
+   if(size > 0xffffffffULL)
+      return;
+
+   /* reserve room, threads never write the same bytes */
+   offset = __atomic_fetch_add(&m_used, size, __ATOMIC_RELAXED);
+   if(offset + size > m_size) {
+      __atomic_fetch_add(&((SubProcRecord_Header *) m_file)->dropped, 1, __ATOMIC_RELAXED);
+      return;
+   }
+
+   entry = (SubProcRecord_Entry *) (m_file + offset);
+   entry->kind = (uint16_t) kind;
+   entry->aliaslen = (uint16_t) aliaslen;
+   entry->typelen = (uint32_t) typelen;
+   entry->argslen = (uint32_t) argslen;
+   usec = (time - m_start) * 1000000.0;
+   entry->usec = (usec > 0.0) ? (uint64_t) usec : 0;
+
+   p = (char *) (entry + 1);
+   memcpy(p, alias, aliaslen + 1);
+   p += aliaslen + 1;
+   memcpy(p, type, typelen + 1);
+   p += typelen + 1;
+   memcpy(p, args, argslen + 1);
+
+   /* complete */
+   __atomic_store_n(&entry->size, (uint32_t) size, __ATOMIC_RELEASE);
+}
+
+/* SubProcess_Recorder::expect: note message forwarded to main program from subprocess of alias, so that its echo is recorded with alias (any thread) */
+void SubProcess_Recorder::expect(const char *alias, const char *type, const char *args)
+{
+   int j;
+
+   if(m_file == NULL || MMDAgent_strlen(alias) == 0 || MMDAgent_strlen(type) == 0)
+      return;
+   if(args == NULL)
+      args = "";
+
+   glfwLockMutex(m_mutex);
+   if(m_echoNum >= SUBPROCESSRECORDER_ECHOES) {
+      /* main program never echoed oldest one */
+      m_echoHead = (m_echoHead + 1) % SUBPROCESSRECORDER_ECHOES;
+      m_echoNum--;
+   }
+   j = (m_echoHead + m_echoNum) % SUBPROCESSRECORDER_ECHOES;
+   m_echoes[j].hash = echoHash(type, args);
+   strncpy(m_echoes[j].alias, alias, SUBPROCESSRECORDER_ALIASLEN - 1);
+   m_echoes[j].alias[SUBPROCESSRECORDER_ALIASLEN - 1] = '\0';
+   __atomic_store_n(&m_echoNum, m_echoNum + 1, __ATOMIC_RELAXED);
+   glfwUnlockMutex(m_mutex);
+}
+
+/* SubProcess_Recorder::isRecording: check if recording */
+bool SubProcess_Recorder::isRecording()
+{
+   return m_file != NULL;
+}
@@ -0,0 +1,184 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* SubProcess_Recorder.h: binary log of traffic recorded by plugin (C and C++)
+
+   The plugin records into the file given by environment variable SUBPROC_RECORD,
+   nothing is recorded if it is not set. The file is mapped in memory and grows up to
+   SUBPROC_RECORDSIZE bytes (suffix k, m or g), later records are counted as dropped.
+   It is truncated to the recorded length when the plugin stops.
+
+   The file starts with SubProcRecord_Header, followed by records aligned to 8 bytes:
+   SubProcRecord_Entry, then alias, type and args, each terminated by '\0'.
+   Alias is empty for messages enqueued by main program, except for those which echo
+   a message read from a subprocess and forwarded to main program, carrying its alias.
+   A record is complete when its size is not 0, so the file of a crashed process can
+   be read up to there. */
+
+#ifndef SUBPROCESS_RECORDER_H
+#define SUBPROCESS_RECORDER_H
+
+#include <stdint.h>
+
+#define SUBPROCRECORD_ENV     "SUBPROC_RECORD"
+#define SUBPROCRECORD_ENVSIZE "SUBPROC_RECORDSIZE"
+#define SUBPROCRECORD_MAGIC   0x53505243U /* "SPRC" */
+#define SUBPROCRECORD_VERSION 2
+#define SUBPROCRECORD_SIZE    (256LL << 20) /* default of maximum bytes of file */
+#define SUBPROCRECORD_ALIGN   8
+
+#define SUBPROCRECORD_ENQUEUE 1 /* message enqueued by main program, with alias if it is an echo of READ */
+#define SUBPROCRECORD_READ    2 /* message read from subprocess */
+
+/* SubProcRecord_Header: header of file */
+typedef struct {
+   uint32_t magic;
+   uint32_t version;
+   int32_t pid;
+   uint32_t align;
+   uint64_t used;    /* bytes of header and records, 0 while recording */
+   uint64_t dropped; /* records not written since file was full */
+} SubProcRecord_Header;
+
+/* SubProcRecord_Entry: header of record */
+typedef struct {
+   uint32_t size;     /* bytes of record with padding, 0 until complete */
+   uint16_t kind;
+   uint16_t aliaslen;
+   uint32_t typelen;
+   uint32_t argslen;
+   uint64_t usec;     /* since recording started */
+} SubProcRecord_Entry;
+
+/* subprocrecord_alias: get alias of record */
+static inline const char *subprocrecord_alias(const SubProcRecord_Entry *entry)
+{
+   return (const char *) (entry + 1);
+}
+
+/* subprocrecord_type: get message type of record */
+static inline const char *subprocrecord_type(const SubProcRecord_Entry *entry)
+{
+   return subprocrecord_alias(entry) + entry->aliaslen + 1;
+}
+
+/* subprocrecord_args: get message args of record */
+static inline const char *subprocrecord_args(const SubProcRecord_Entry *entry)
+{
+   return subprocrecord_type(entry) + entry->typelen + 1;
+}
+
+/* subprocrecord_next: get record after entry (first one if NULL) in file of length bytes, NULL at end */
+static inline const SubProcRecord_Entry *subprocrecord_next(const void *file, uint64_t length, const SubProcRecord_Entry *entry)
+{
+   uint64_t offset;
+   const SubProcRecord_Entry *next;
+
+   if(entry == NULL)
+      offset = sizeof(SubProcRecord_Header);
+   else
+      offset = (uint64_t) ((const char *) entry - (const char *) file) + entry->size;
+   if(offset + sizeof(SubProcRecord_Entry) > length)
+      return NULL;
+
+   next = (const SubProcRecord_Entry *) ((const char *) file + offset);
+   if(next->size < sizeof(SubProcRecord_Entry) + 3 || offset + next->size > length)
+      return NULL;
+   if(sizeof(SubProcRecord_Entry) + (uint64_t) next->aliaslen + next->typelen + next->argslen + 3 > next->size)
+      return NULL;
+
+   return next;
+}
+
+#ifdef __cplusplus
+
+#define SUBPROCESSRECORDER_ECHOES   256 /* forwarded messages waiting for their echoes, oldest one is forgotten beyond it */
+#define SUBPROCESSRECORDER_ALIASLEN 128 /* bytes of alias kept for echo, longer one is cut */
+
+/* SubProcess_Recorder: owner of recording file */
+class SubProcess_Recorder
+{
+private:
+
+   /* Echo: message forwarded to main program, which is going to be enqueued back */
+   typedef struct _Echo {
+      unsigned long hash; /* hash of type and args, 0 after echo */
+      char alias[SUBPROCESSRECORDER_ALIASLEN];
+   } Echo;
+
+   char *m_file;    /* mapped file, NULL if not recording */
+   uint64_t m_size; /* bytes mapped */
+   uint64_t m_used; /* bytes reserved by records, may exceed m_size when full */
+   int m_fd;
+   double m_start;  /* time when recording started */
+
+   GLFWmutex m_mutex; /* mutual exclusion for echoes */
+   Echo m_echoes[SUBPROCESSRECORDER_ECHOES]; /* ring of forwarded messages in order */
+   int m_echoHead;  /* oldest one */
+   int m_echoNum;   /* forwarded messages in ring, including echoed ones behind oldest */
+
+   /* initialize: initialize recorder */
+   void initialize();
+
+   /* echo: find and forget forwarded message echoed by main program, copying its alias into buff, return false if none */
+   bool echo(const char *type, const char *args, char *buff);
+
+public:
+
+   /* SubProcess_Recorder: recorder constructor */
+   SubProcess_Recorder();
+
+   /* ~SubProcess_Recorder: recorder destructor */
+   ~SubProcess_Recorder();
+
+   /* setup: start recording if file is given */
+   bool setup();
+
+   /* clear: truncate file to recorded length and close it */
+   void clear();
+
+   /* record: append message of time with alias of subprocess, NULL for main program (any thread) */
+   void record(int kind, const char *alias, const char *type, const char *args, double time);
+
+   /* expect: note message forwarded to main program from subprocess of alias, so that its echo is recorded with alias (any thread) */
+   void expect(const char *alias, const char *type, const char *args);
+
+   /* isRecording: check if recording */
+   bool isRecording();
+};
+
+#endif /* __cplusplus */
+
+#endif /* SUBPROCESS_RECORDER_H */
@@ -0,0 +1,327 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* headers */
+
+#include "MMDAgent.h"
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "SubProcess_Slab.h"
+#include "SubProcess_Ring.h"
+
+/* SubProcess_Ring::initialize: initialize ring */
+void SubProcess_Ring::initialize()
+{
+   memset(&m_ring, 0, sizeof(Slots));
+   memset(&m_overflow, 0, sizeof(Slots));
+   m_spilled = 0;
+   m_overflows = 0;
+   m_drops = 0;
+   m_front = false;
+
+   m_waiting = 0;
+   m_closed = false;
+   m_eventfd = -1;
+}
+
+/* SubProcess_Ring::allocSlots: allocate slots of array, n is power of two */
+bool SubProcess_Ring::allocSlots(Slots *a, unsigned long n)
+{
+   unsigned long i;
+
+   a->slots = (Slot *) malloc(sizeof(Slot) * n);
+   if(a->slots == NULL)
+      return false;
+
+   for(i = 0; i < n; i++) {
+      a->slots[i].seq = i;
+      a->slots[i].msg = NULL;
+   }
+   a->mask = n - 1;
+   a->head = 0;
+   a->tail = 0;
+
+   return true;
+}
+
+/* SubProcess_Ring::put: put message into free slot of array, return false if full (any thread) */
+bool SubProcess_Ring::put(Slots *a, SubProcess_Message *msg)
+{
+   unsigned long pos, seq;
+   long diff;
+   Slot *slot;
+
+   pos = __atomic_load_n(&a->head, __ATOMIC_RELAXED);
+   for(;;) {
+      slot = &a->slots[pos & a->mask];
+      seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+      diff = (long) seq - (long) pos;
+      if(diff == 0) {
+         if(__atomic_compare_exchange_n(&a->head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+      } else if(diff < 0) {
+         /* full */
+         return false;
+      } else {
+         pos = __atomic_load_n(&a->head, __ATOMIC_RELAXED);
+      }
+   }
+
+   slot->msg = msg;
+
+   /* publish */
+   __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+   return true;
+}
+
+/* SubProcess_Ring::peek: get message of oldest slot of array, return false if empty (consumer thread) */
+bool SubProcess_Ring::peek(Slots *a, SubProcess_Message **msg)
+{
+   Slot *slot = &a->slots[a->tail & a->mask];
+
+   if(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != a->tail + 1)
+      return false;
+
+   *msg = slot->msg;
+   return true;
+}
+
+/* SubProcess_Ring::remove: hand oldest slot of array back to producers (consumer thread) */
+void SubProcess_Ring::remove(Slots *a)
+{
+   Slot *slot = &a->slots[a->tail & a->mask];
+
+   slot->msg = NULL;
+   __atomic_store_n(&slot->seq, a->tail + a->mask + 1, __ATOMIC_RELEASE);
+   a->tail++;
+}
+
+/* SubProcess_Ring::SubProcess_Ring: ring constructor */
+SubProcess_Ring::SubProcess_Ring()
+{
+   initialize();
+}
+
+/* SubProcess_Ring::~SubProcess_Ring: ring destructor */
+SubProcess_Ring::~SubProcess_Ring()
+{
+   clear();
+}
+
+/* SubProcess_Ring::setup: allocate slots and eventfd */
+bool SubProcess_Ring::setup(int size)
+{
+   unsigned long n;
+
+   clear();
+
+   /* round up to power of two */
+   for(n = 2; n < (unsigned long) size; n <<= 1);
+
+   m_eventfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+   if(allocSlots(&m_ring, n) == false || allocSlots(&m_overflow, SUBPROCESSRING_OVERFLOW) == false || m_eventfd < 0) {
+      clear();
+      return false;
+   }
+
+   return true;
+}
+
+/* SubProcess_Ring::clear: free ring */
+void SubProcess_Ring::clear()
+{
+   SubProcess_Message *msg;
+
+   if(m_ring.slots != NULL && m_overflow.slots != NULL) {
+      while(front(&msg) == true) {
+         SubProcess_Slab::release(msg);
+         pop();
+      }
+   }
+   free(m_ring.slots);
+   free(m_overflow.slots);
+   if(m_eventfd >= 0)
+      ::close(m_eventfd);
+
+   initialize();
+}
+
+/* SubProcess_Ring::close: refuse producers and wake up consumer */
+void SubProcess_Ring::close()
+{
+   __atomic_store_n(&m_closed, true, __ATOMIC_SEQ_CST);
+   wakeup();
+}
+
+/* SubProcess_Ring::enqueue: enqueue reference of message, spilling it into overflow array when ring is full, return false if dropped (any thread) */
+bool SubProcess_Ring::enqueue(SubProcess_Message *msg)
+{
+   if(m_ring.slots == NULL || msg == NULL || __atomic_load_n(&m_closed, __ATOMIC_ACQUIRE) == true)
+      return false;
+
+   /* ring unless earlier messages have spilled */
+   if(__atomic_load_n(&m_spilled, __ATOMIC_ACQUIRE) != 0 || put(&m_ring, msg) == false) {
+      /* spill, counted first so that later messages of this producer follow it */
+      __atomic_add_fetch(&m_spilled, 1, __ATOMIC_SEQ_CST);
+      if(put(&m_overflow, msg) == false) {
+         __atomic_sub_fetch(&m_spilled, 1, __ATOMIC_RELEASE);
+         __atomic_add_fetch(&m_drops, 1, __ATOMIC_RELAXED);
+         return false;
+      }
+      __atomic_add_fetch(&m_overflows, 1, __ATOMIC_RELAXED);
+   }
+
+   /* wake up consumer only when it sleeps */
+   if(__atomic_exchange_n(&m_waiting, 0, __ATOMIC_SEQ_CST) != 0)
+      wakeup();
+
+   return true;
+}
+
+/* SubProcess_Ring::front: get top element without removing it (consumer thread) */
+bool SubProcess_Ring::front(SubProcess_Message **msg)
+{
+   if(m_ring.slots == NULL)
+      return false;
+
+   /* ring holds older messages than overflow array */
+   if(peek(&m_ring, msg) == true) {
+      m_front = false;
+      return true;
+   }
+   if(peek(&m_overflow, msg) == true) {
+      m_front = true;
+      return true;
+   }
+
+   return false;
+}
+
+/* SubProcess_Ring::pop: remove top element given by front, of which reference is taken by consumer (consumer thread) */
+void SubProcess_Ring::pop()
+{
+   SubProcess_Message *msg;
+
+   if(m_front == true) {
+      remove(&m_overflow);
+      m_front = false;
+
+      /* producers return to ring when all spilled messages are taken */
+      __atomic_sub_fetch(&m_spilled, 1, __ATOMIC_RELEASE);
+      return;
+   }
+
+   if(m_ring.slots != NULL && peek(&m_ring, &msg) == true)
+      remove(&m_ring);
+}
+
+/* SubProcess_Ring::isEmpty: check empty, including overflow array (consumer thread) */
+bool SubProcess_Ring::isEmpty()
+{
+   SubProcess_Message *msg;
+
+   if(m_ring.slots == NULL)
+      return true;
+
+   return (peek(&m_ring, &msg) == false && peek(&m_overflow, &msg) == false) ? true : false;
+}
+
+/* SubProcess_Ring::getOverflows: get number of messages spilled since setup */
+unsigned long SubProcess_Ring::getOverflows()
+{
+   return __atomic_load_n(&m_overflows, __ATOMIC_RELAXED);
+}
+
+/* SubProcess_Ring::getDrops: get number of messages dropped since setup */
+unsigned long SubProcess_Ring::getDrops()
+{
+   return __atomic_load_n(&m_drops, __ATOMIC_RELAXED);
+}
+
+/* SubProcess_Ring::prepareWait: announce sleep, return false if ring is not empty (consumer thread) */
+bool SubProcess_Ring::prepareWait()
+{
+   if(m_eventfd < 0)
+      return false;
+
+   /* announce sleep, then check again not to miss a message enqueued meanwhile */
+   __atomic_store_n(&m_waiting, 1, __ATOMIC_SEQ_CST);
+   if(isEmpty() == false || __atomic_load_n(&m_closed, __ATOMIC_SEQ_CST) == true) {
+      finishWait();
+      return false;
+   }
+
+   return true;
+}
+
+/* SubProcess_Ring::finishWait: clear sleep announcement after waking up (consumer thread) */
+void SubProcess_Ring::finishWait()
+{
+   eventfd_t value;
+
+   __atomic_store_n(&m_waiting, 0, __ATOMIC_SEQ_CST);
+   eventfd_read(m_eventfd, &value);
+}
+
+/* SubProcess_Ring::getWakeupFd: get eventfd to be polled while sleeping */
+int SubProcess_Ring::getWakeupFd()
+{
+   return m_eventfd;
+}
+
+/* SubProcess_Ring::wait: sleep until ring is not empty or wakeup is called (consumer thread) */
+void SubProcess_Ring::wait()
+{
+   pollfd pfd;
+
+   if(prepareWait() == false)
+      return;
+
+   pfd.fd = m_eventfd;
+   pfd.events = POLLIN;
+   while(poll(&pfd, 1, -1) < 0 && errno == EINTR);
+
+   finishWait();
+}
+
+/* SubProcess_Ring::wakeup: wake up consumer */
+void SubProcess_Ring::wakeup()
+{
+   if(m_eventfd >= 0)
+      eventfd_write(m_eventfd, 1);
+}
@@ -0,0 +1,137 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* definitions */
+
+#define SUBPROCESSRING_SIZE     4096  /* number of slots (power of two) */
+#define SUBPROCESSRING_OVERFLOW 16384 /* number of slots of overflow array (power of two) */
+
+/* SubProcess_Ring: lock-free multi-producer/single-consumer queue of events/commands */
+/* producers never wait: when ring is full, messages spill into a preallocated overflow array, to which all producers turn */
+/* until consumer has taken it, so that order of each producer is kept; when it is also full, message is dropped and counted */
+class SubProcess_Ring
+{
+private:
+
+   /* Slot: slot of ring */
+   typedef struct _Slot {
+      unsigned long seq; /* sequence number to hand over slot between producers and consumer */
+      SubProcess_Message *msg;
+   } Slot;
+
+   /* Slots: bounded array of slots, written by producers and read by consumer in order */
+   typedef struct _Slots {
+      Slot *slots;
+      unsigned long mask;
+      unsigned long head; /* next position to be written by producers */
+      unsigned long tail; /* next position to be read by consumer */
+   } Slots;
+
+   Slots m_ring;              /* messages in order of enqueue */
+   Slots m_overflow;          /* messages spilled while ring is full or earlier ones are spilled */
+   unsigned long m_spilled;   /* spilled messages not yet removed, producers spill while not zero */
+   unsigned long m_overflows; /* messages spilled since setup */
+   unsigned long m_drops;     /* messages dropped since setup, as overflow array was also full */
+   bool m_front;              /* message of front is in m_overflow (consumer thread) */
+
+   int m_waiting; /* consumer is going to sleep */
+   bool m_closed; /* producers are refused */
+   int m_eventfd; /* eventfd to wake up consumer */
+
+   /* initialize: initialize ring */
+   void initialize();
+
+   /* allocSlots: allocate slots of array, n is power of two */
+   static bool allocSlots(Slots *a, unsigned long n);
+
+   /* put: put message into free slot of array, return false if full (any thread) */
+   static bool put(Slots *a, SubProcess_Message *msg);
+
+   /* peek: get message of oldest slot of array, return false if empty (consumer thread) */
+   static bool peek(Slots *a, SubProcess_Message **msg);
+
+   /* remove: hand oldest slot of array back to producers (consumer thread) */
+   static void remove(Slots *a);
+
+public:
+
+   /* SubProcess_Ring: ring constructor */
+   SubProcess_Ring();
+
+   /* ~SubProcess_Ring: ring destructor */
+   ~SubProcess_Ring();
+
+   /* setup: allocate slots and eventfd */
+   bool setup(int size);
+
+   /* clear: free ring */
+   void clear();
+
+   /* close: refuse producers and wake up consumer */
+   void close();
+
+   /* enqueue: enqueue reference of message, spilling it into overflow array when ring is full, return false if dropped (any thread) */
+   bool enqueue(SubProcess_Message *msg);
+
+   /* front: get top element without removing it (consumer thread) */
+   bool front(SubProcess_Message **msg);
+
+   /* pop: remove top element given by front, of which reference is taken by consumer (consumer thread) */
+   void pop();
+
+   /* isEmpty: check empty, including overflow array (consumer thread) */
+   bool isEmpty();
+
+   /* getOverflows: get number of messages spilled since setup */
+   unsigned long getOverflows();
+
+   /* getDrops: get number of messages dropped since setup */
+   unsigned long getDrops();
+
+   /* prepareWait: announce sleep, return false if ring is not empty (consumer thread) */
+   bool prepareWait();
+
+   /* finishWait: clear sleep announcement after waking up (consumer thread) */
+   void finishWait();
+
+   /* getWakeupFd: get eventfd to be polled while sleeping */
+   int getWakeupFd();
+
+   /* wait: sleep until ring is not empty or wakeup is called (consumer thread) */
+   void wait();
+
+   /* wakeup: wake up consumer */
+   void wakeup();
+};
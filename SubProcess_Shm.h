@@ -0,0 +1,317 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* SubProcess_Shm.h: shared-memory transport between plugin and subprocess (C and C++)
+
+   A subprocess started with the transport=shm option inherits three descriptors
+   whose numbers are given in environment variable SUBPROC_SHM as "memfd,in,out":
+     memfd : segment holding two single-producer/single-consumer rings
+     in    : eventfd signaled by plugin when it writes to the inbound ring while subprocess sleeps
+     out   : eventfd to be signaled by subprocess when it writes to the outbound ring while plugin sleeps
+   Records in the rings are frames of the proto=frame option:
+     uint32 length of the rest, uint32 length of type, type, args (integers are big-endian)
+   stdin and stdout remain connected to the plugin as usual.
+
+   usage in subprocess:
+     SubProcShm shm;
+     char buf[SUBPROCSHM_MAXRECORD];
+     unsigned int len;
+     if(subprocshm_attach(&shm) == 0) {
+        while(subprocshm_wait(shm.in, shm.infd, -1) >= 0) {
+           while(subprocshm_read(shm.in, buf, sizeof(buf), &len) > 0) {
+              ...
+              subprocshm_write(shm.out, "TYPE", 4, "args", 4);
+           }
+           subprocshm_notify(shm.out, shm.outfd);
+        }
+     } */
+
+#ifndef SUBPROCESS_SHM_H
+#define SUBPROCESS_SHM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+#define SUBPROCSHM_ENV        "SUBPROC_SHM"
+#define SUBPROCSHM_MAGIC      0x53505348U /* "SPSH" */
+#define SUBPROCSHM_HEADER     8           /* frame header */
+#define SUBPROCSHM_MAXRECORD  65536       /* suggested size of read buffer of subprocess */
+#define SUBPROCSHM_CACHELINE  64
+
+/* SubProcShm_Ring: control block of ring, followed by data */
+typedef struct _SubProcShm_Ring {
+   volatile uint32_t head;    /* written by producer */
+   char pad0[SUBPROCSHM_CACHELINE - sizeof(uint32_t)];
+   volatile uint32_t tail;    /* written by consumer */
+   char pad1[SUBPROCSHM_CACHELINE - sizeof(uint32_t)];
+   volatile uint32_t waiting; /* consumer is going to sleep */
+   char pad2[SUBPROCSHM_CACHELINE - sizeof(uint32_t)];
+   uint32_t size;             /* bytes of data (power of two) */
+   char pad3[SUBPROCSHM_CACHELINE - sizeof(uint32_t)];
+} SubProcShm_Ring;
+
+/* SubProcShm_Segment: head of segment, followed by ring to subprocess and ring from subprocess */
+typedef struct {
+   uint32_t magic;
+   uint32_t size; /* bytes of data of each ring */
+   char pad[SUBPROCSHM_CACHELINE - 2 * sizeof(uint32_t)];
+} SubProcShm_Segment;
+
+/* SubProcShm: view of subprocess */
+typedef struct {
+   void *base;
+   size_t length;
+   SubProcShm_Ring *in;  /* plugin -> subprocess */
+   SubProcShm_Ring *out; /* subprocess -> plugin */
+   int infd;
+   int outfd;
+} SubProcShm;
+
+/* subprocshm_length: bytes of segment for rings of given size */
+static inline size_t subprocshm_length(uint32_t size)
+{
+   return sizeof(SubProcShm_Segment) + 2 * (sizeof(SubProcShm_Ring) + size);
+}
+
+/* subprocshm_ringat: get ring of segment whose rings have given size, 0 is plugin -> subprocess and 1 is subprocess -> plugin */
+static inline SubProcShm_Ring *subprocshm_ringat(void *base, uint32_t size, int dir)
+{
+   return (SubProcShm_Ring *) ((char *) base + sizeof(SubProcShm_Segment) + dir * (sizeof(SubProcShm_Ring) + size));
+}
+
+/* subprocshm_ring: get ring of segment by size written in its head (subprocess side, as the plugin does not trust the segment) */
+static inline SubProcShm_Ring *subprocshm_ring(void *base, int dir)
+{
+   return subprocshm_ringat(base, ((SubProcShm_Segment *) base)->size, dir);
+}
+
+/* subprocshm_init: initialize segment (plugin side) */
+static inline void subprocshm_init(void *base, uint32_t size)
+{
+   int i;
+   SubProcShm_Segment *seg = (SubProcShm_Segment *) base;
+   SubProcShm_Ring *ring;
+
+   seg->size = size;
+   for(i = 0; i < 2; i++) {
+      ring = subprocshm_ringat(base, size, i);
+      ring->head = 0;
+      ring->tail = 0;
+      ring->waiting = 0;
+      ring->size = size;
+   }
+   __atomic_store_n(&seg->magic, SUBPROCSHM_MAGIC, __ATOMIC_RELEASE);
+}
+
+/* subprocshm_copyin: copy bytes into ring of size at position */
+static inline void subprocshm_copyin(SubProcShm_Ring *ring, uint32_t size, uint32_t pos, const void *src, uint32_t len)
+{
+   char *data = (char *) (ring + 1);
+   uint32_t off = pos & (size - 1), first = size - off;
+
+   if(first >= len) {
+      memcpy(data + off, src, len);
+   } else {
+      memcpy(data + off, src, first);
+      memcpy(data, (const char *) src + first, len - first);
+   }
+}
+
+/* subprocshm_copyout: copy bytes out of ring of size at position */
+static inline void subprocshm_copyout(SubProcShm_Ring *ring, uint32_t size, uint32_t pos, void *dst, uint32_t len)
+{
+   const char *data = (const char *) (ring + 1);
+   uint32_t off = pos & (size - 1), first = size - off;
+
+   if(first >= len) {
+      memcpy(dst, data + off, len);
+   } else {
+      memcpy(dst, data + off, first);
+      memcpy((char *) dst + first, data, len - first);
+   }
+}
+
+/* subprocshm_writeraw: write an encoded frame to ring of size, return 1 on success and 0 if ring is full (producer) */
+static inline int subprocshm_writeraw(SubProcShm_Ring *ring, uint32_t size, const void *frame, uint32_t len)
+{
+   uint32_t head = ring->head;
+   uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+   if(head - tail > size || len > size - (head - tail))
+      return 0;
+
+   subprocshm_copyin(ring, size, head, frame, len);
+   __atomic_store_n(&ring->head, head + len, __ATOMIC_RELEASE);
+
+   return 1;
+}
+
+/* subprocshm_write: write type and args as a frame, return 1 on success and 0 if ring is full (producer) */
+static inline int subprocshm_write(SubProcShm_Ring *ring, const char *type, uint32_t typelen, const char *args, uint32_t argslen)
+{
+   uint32_t head = ring->head, len = SUBPROCSHM_HEADER + typelen + argslen;
+   uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+   uint32_t header[2];
+
+   if(len > ring->size - (head - tail))
+      return 0;
+
+   header[0] = htonl(4 + typelen + argslen);
+   header[1] = htonl(typelen);
+   subprocshm_copyin(ring, ring->size, head, header, SUBPROCSHM_HEADER);
+   subprocshm_copyin(ring, ring->size, head + SUBPROCSHM_HEADER, type, typelen);
+   subprocshm_copyin(ring, ring->size, head + SUBPROCSHM_HEADER + typelen, args, argslen);
+   __atomic_store_n(&ring->head, head + len, __ATOMIC_RELEASE);
+
+   return 1;
+}
+
+/* subprocshm_readat: read a frame from ring of size into buf, return 1 on success, 0 if empty, -1 if buf is too small or frame is broken (consumer) */
+static inline int subprocshm_readat(SubProcShm_Ring *ring, uint32_t size, char *buf, uint32_t bufsize, uint32_t *len)
+{
+   uint32_t tail = ring->tail;
+   uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+   uint32_t total;
+
+   if(head - tail > size || bufsize < 4)
+      return -1;
+   if(head - tail < SUBPROCSHM_HEADER)
+      return 0;
+
+   /* lengths are written by producer, so they are compared without overflow */
+   subprocshm_copyout(ring, size, tail, &total, sizeof(total));
+   total = ntohl(total);
+   if(total < 4 || total > head - tail - 4)
+      return -1;
+   if(total > bufsize - 4)
+      return -1;
+
+   subprocshm_copyout(ring, size, tail, buf, 4 + total);
+   __atomic_store_n(&ring->tail, tail + 4 + total, __ATOMIC_RELEASE);
+   *len = 4 + total;
+
+   return 1;
+}
+
+/* subprocshm_read: read a frame into buf, return 1 on success, 0 if empty, -1 if buf is too small or frame is broken (consumer) */
+static inline int subprocshm_read(SubProcShm_Ring *ring, char *buf, uint32_t bufsize, uint32_t *len)
+{
+   return subprocshm_readat(ring, ring->size, buf, bufsize, len);
+}
+
+/* subprocshm_isempty: check if ring has no frame */
+static inline int subprocshm_isempty(SubProcShm_Ring *ring)
+{
+   return (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) ? 1 : 0;
+}
+
+/* subprocshm_notify: wake up consumer if it sleeps (producer, after writing) */
+static inline void subprocshm_notify(SubProcShm_Ring *ring, int efd)
+{
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+   if(__atomic_exchange_n(&ring->waiting, 0, __ATOMIC_SEQ_CST) != 0)
+      eventfd_write(efd, 1);
+}
+
+/* subprocshm_prepare: announce sleep, return 0 if ring is not empty (consumer) */
+static inline int subprocshm_prepare(SubProcShm_Ring *ring)
+{
+   __atomic_store_n(&ring->waiting, 1, __ATOMIC_SEQ_CST);
+   if(subprocshm_isempty(ring) == 0) {
+      __atomic_store_n(&ring->waiting, 0, __ATOMIC_SEQ_CST);
+      return 0;
+   }
+   return 1;
+}
+
+/* subprocshm_wait: sleep until ring is not empty, return -1 on error (consumer) */
+static inline int subprocshm_wait(SubProcShm_Ring *ring, int efd, int timeout)
+{
+   int ret = 0;
+   eventfd_t value;
+   struct pollfd pfd;
+
+   if(subprocshm_prepare(ring) == 1) {
+      pfd.fd = efd;
+      pfd.events = POLLIN;
+      ret = poll(&pfd, 1, timeout);
+      __atomic_store_n(&ring->waiting, 0, __ATOMIC_SEQ_CST);
+      if(ret > 0)
+         eventfd_read(efd, &value);
+   }
+
+   return (ret < 0) ? -1 : 0;
+}
+
+/* subprocshm_attach: map segment given by plugin (subprocess side), return 0 on success */
+static inline int subprocshm_attach(SubProcShm *shm)
+{
+   int fd;
+   const char *env = getenv(SUBPROCSHM_ENV);
+   SubProcShm_Segment *seg;
+
+   if(env == NULL || sscanf(env, "%d,%d,%d", &fd, &shm->infd, &shm->outfd) != 3)
+      return -1;
+
+   /* read size from head, then map whole segment */
+   seg = (SubProcShm_Segment *) mmap(NULL, sizeof(SubProcShm_Segment), PROT_READ, MAP_SHARED, fd, 0);
+   if(seg == MAP_FAILED)
+      return -1;
+   if(__atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) != SUBPROCSHM_MAGIC) {
+      munmap(seg, sizeof(SubProcShm_Segment));
+      return -1;
+   }
+   shm->length = subprocshm_length(seg->size);
+   munmap(seg, sizeof(SubProcShm_Segment));
+
+   shm->base = mmap(NULL, shm->length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   if(shm->base == MAP_FAILED)
+      return -1;
+   close(fd);
+
+   shm->in = subprocshm_ring(shm->base, 0);
+   shm->out = subprocshm_ring(shm->base, 1);
+
+   return 0;
+}
+
+#endif /* SUBPROCESS_SHM_H */
@@ -0,0 +1,287 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* headers */
+
+#include "MMDAgent.h"
+#include <sys/uio.h>
+
+#include "SubProcess_Stats.h"
+#include "SubProcess_Reactor.h"
+#include "SubProcess_Filter.h"
+#include "SubProcess_Option.h"
+#include "SubProcess_Slab.h"
+#include "SubProcess_Buffer.h"
+#include "SubProcess_Call.h"
+#include "SubProcess_Thread.h"
+
+/* SubProcess_Slab::initialize: initialize slab */
+void SubProcess_Slab::initialize()
+{
+   m_classes = NULL;
+
+   m_mutex = NULL;
+   m_allocs = 0;
+}
+
+/* SubProcess_Slab::at: get message of size class by index */
+SubProcess_Message *SubProcess_Slab::at(Class *c, unsigned int index)
+{
+   return (SubProcess_Message *) (c->slabs[index / c->count] + (size_t) (index % c->count) * c->size);
+}
+
+/* SubProcess_Slab::take: pop free message of size class, NULL if none */
+SubProcess_Message *SubProcess_Slab::take(Class *c)
+{
+   unsigned long long head, next;
+   SubProcess_Message *msg;
+
+   /* slabs are never freed while running, so a message popped meanwhile is still readable and the tag fails the exchange */
+   head = __atomic_load_n(&c->head, __ATOMIC_ACQUIRE);
+   while((unsigned int) head != SUBPROCESSSLAB_NIL) {
+      msg = at(c, (unsigned int) head);
+      next = (((head >> 32) + 1) << 32) | __atomic_load_n(&msg->next, __ATOMIC_RELAXED);
+      if(__atomic_compare_exchange_n(&c->head, &head, next, true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE) == true)
+         return msg;
+   }
+
+   return NULL;
+}
+
+/* SubProcess_Slab::put: push free message to its size class */
+void SubProcess_Slab::put(SubProcess_Message *msg)
+{
+   unsigned long long head, next;
+   Class *c = &m_classes[msg->sizeClass];
+
+   head = __atomic_load_n(&c->head, __ATOMIC_RELAXED);
+   do {
+      __atomic_store_n(&msg->next, (unsigned int) head, __ATOMIC_RELAXED);
+      next = (((head >> 32) + 1) << 32) | msg->index;
+   } while(__atomic_compare_exchange_n(&c->head, &head, next, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED) == false);
+}
+
+/* SubProcess_Slab::grow: add a slab to size class, return false if it cannot */
+bool SubProcess_Slab::grow(int sizeClass)
+{
+   int i;
+   char *slab;
+   Class *c = &m_classes[sizeClass];
+   SubProcess_Message *msg;
+
+   glfwLockMutex(m_mutex);
+
+   /* another thread may have grown it meanwhile */
+   if((unsigned int) __atomic_load_n(&c->head, __ATOMIC_ACQUIRE) != SUBPROCESSSLAB_NIL) {
+      glfwUnlockMutex(m_mutex);
+      return true;
+   }
+   if(c->numSlabs >= SUBPROCESSSLAB_MAXSLABS) {
+      glfwUnlockMutex(m_mutex);
+      return false;
+   }
+
+   slab = (char *) malloc((size_t) c->size * c->count);
+   if(slab == NULL) {
+      glfwUnlockMutex(m_mutex);
+      return false;
+   }
+   __atomic_fetch_add(&m_allocs, 1, __ATOMIC_RELAXED);
+   c->slabs[c->numSlabs] = slab;
+
+   /* carve, then publish messages one by one so that readers of the list always see the slab */
+   for(i = 0; i < c->count; i++) {
+      msg = (SubProcess_Message *) (slab + (size_t) i * c->size);
+      msg->slab = this;
+      msg->sizeClass = sizeClass;
+      msg->index = (unsigned int) (c->numSlabs * c->count + i);
+      put(msg);
+   }
+   c->numSlabs++;
+
+   glfwUnlockMutex(m_mutex);
+
+   return true;
+}
+
+/* SubProcess_Slab::SubProcess_Slab: slab constructor */
+SubProcess_Slab::SubProcess_Slab()
+{
+   initialize();
+}
+
+/* SubProcess_Slab::~SubProcess_Slab: slab destructor */
+SubProcess_Slab::~SubProcess_Slab()
+{
+   clear();
+}
+
+/* SubProcess_Slab::setup: prepare size classes */
+bool SubProcess_Slab::setup()
+{
+   int i;
+
+   clear();
+
+   m_classes = (Class *) calloc(SUBPROCESSSLAB_CLASSES, sizeof(Class));
+   m_mutex = glfwCreateMutex();
+   if(m_classes == NULL || m_mutex == NULL) {
+      clear();
+      return false;
+   }
+
+   for(i = 0; i < SUBPROCESSSLAB_CLASSES; i++) {
+      m_classes[i].head = SUBPROCESSSLAB_NIL;
+      m_classes[i].size = SUBPROCESSSLAB_MINSIZE << i;
+      m_classes[i].count = SUBPROCESSSLAB_BYTES / m_classes[i].size;
+      if(m_classes[i].count < SUBPROCESSSLAB_MINCOUNT)
+         m_classes[i].count = SUBPROCESSSLAB_MINCOUNT;
+   }
+
+   return true;
+}
+
+/* SubProcess_Slab::clear: free slabs, with no message referenced */
+void SubProcess_Slab::clear()
+{
+   int i, j;
+
+   if(m_classes != NULL) {
+      for(i = 0; i < SUBPROCESSSLAB_CLASSES; i++)
+         for(j = 0; j < m_classes[i].numSlabs; j++)
+            free(m_classes[i].slabs[j]);
+      free(m_classes);
+   }
+   if(m_mutex != NULL)
+      glfwDestroyMutex(m_mutex);
+
+   initialize();
+}
+
+/* SubProcess_Slab::create: format message with a reference, to a subprocess if target is given, NULL if slab is not set up (any thread) */
+SubProcess_Message *SubProcess_Slab::create(const char *type, const char *args, double time, const char *target)
+{
+   int i, typelen, argslen, len, flen, targetlen;
+   size_t size;
+   SubProcess_Message *msg = NULL;
+
+   if(m_classes == NULL)
+      return NULL;
+
+   if(type == NULL)
+      type = "";
+   if(args == NULL)
+      args = "";
+
+   typelen = MMDAgent_strlen(type);
+   argslen = MMDAgent_strlen(args);
+   len = typelen + ((argslen > 0) ? argslen + 1 : 0) + 1;
+   flen = SUBPROCESSTHREAD_FRAMEHEADER + typelen + argslen;
+   targetlen = (target != NULL) ? MMDAgent_strlen(target) + 1 : 0;
+   size = sizeof(SubProcess_Message) + typelen + 1 + len + flen + targetlen;
+
+   /* smallest size class holding it, or heap */
+   for(i = 0; i < SUBPROCESSSLAB_CLASSES && (size_t) m_classes[i].size < size; i++);
+   if(i < SUBPROCESSSLAB_CLASSES) {
+      while((msg = take(&m_classes[i])) == NULL)
+         if(grow(i) == false)
+            break;
+   }
+   if(msg == NULL) {
+      msg = (SubProcess_Message *) malloc(size);
+      if(msg == NULL)
+         return NULL;
+      __atomic_fetch_add(&m_allocs, 1, __ATOMIC_RELAXED);
+      msg->slab = this;
+      msg->sizeClass = -1;
+   }
+
+   msg->refs = 1;
+   msg->time = time;
+
+   /* type, line and frame follow header */
+   msg->type = (char *) (msg + 1);
+   msg->typelen = typelen;
+   memcpy(msg->type, type, typelen + 1);
+
+   msg->line = msg->type + typelen + 1;
+   msg->len = len;
+   memcpy(msg->line, type, typelen);
+   if(argslen > 0) {
+      msg->line[typelen] = SUBPROCESSTHREAD_SEPARATOR;
+      memcpy(msg->line + typelen + 1, args, argslen);
+   }
+   msg->line[len - 1] = '\n';
+
+   msg->frame = msg->line + len;
+   msg->flen = flen;
+   SubProcess_Thread::putFrameHeader(msg->frame, typelen, argslen);
+   memcpy(msg->frame + SUBPROCESSTHREAD_FRAMEHEADER, type, typelen);
+   memcpy(msg->frame + SUBPROCESSTHREAD_FRAMEHEADER + typelen, args, argslen);
+
+   msg->target = NULL;
+   msg->targetHash = 0;
+   if(target != NULL) {
+      msg->target = msg->frame + flen;
+      memcpy(msg->target, target, targetlen);
+      msg->targetHash = SubProcess_Filter::hash(target, targetlen - 1);
+   }
+
+   return msg;
+}
+
+/* SubProcess_Slab::getAllocs: get number of heap allocations for messages */
+unsigned long long SubProcess_Slab::getAllocs()
+{
+   return __atomic_load_n(&m_allocs, __ATOMIC_RELAXED);
+}
+
+/* SubProcess_Slab::retain: add reference of message */
+void SubProcess_Slab::retain(SubProcess_Message *msg)
+{
+   __atomic_add_fetch(&msg->refs, 1, __ATOMIC_RELAXED);
+}
+
+/* SubProcess_Slab::release: release reference of message, recycling it at last */
+void SubProcess_Slab::release(SubProcess_Message *msg)
+{
+   if(msg == NULL || __atomic_sub_fetch(&msg->refs, 1, __ATOMIC_ACQ_REL) > 0)
+      return;
+
+   if(msg->sizeClass < 0)
+      free(msg);
+   else
+      msg->slab->put(msg);
+}
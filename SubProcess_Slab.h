@@ -0,0 +1,124 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* definitions */
+
+#define SUBPROCESSSLAB_MINSIZE  64    /* bytes of message in smallest size class */
+#define SUBPROCESSSLAB_CLASSES  11    /* size classes doubling up to 64 KiB, larger messages are allocated on heap */
+#define SUBPROCESSSLAB_BYTES    65536 /* bytes of a slab carved into messages of a size class */
+#define SUBPROCESSSLAB_MINCOUNT 16    /* messages in a slab of large size class */
+#define SUBPROCESSSLAB_MAXSLABS 4096  /* slabs of a size class */
+#define SUBPROCESSSLAB_NIL      0xffffffffU
+
+class SubProcess_Slab;
+
+/* SubProcess_Message: message formatted once at enqueue, shared by subprocesses and recycled when last reference is released */
+typedef struct _SubProcess_Message {
+   int refs;
+   SubProcess_Slab *slab;
+   int sizeClass;       /* -1 if allocated on heap */
+   unsigned int index;  /* position in size class */
+   unsigned int next;   /* next free message in size class */
+   double time;         /* time of enqueue */
+   char *type;          /* type terminated by '\0' */
+   int typelen;
+   char *line;          /* "type|args\n" */
+   int len;
+   char *frame;         /* header, type and args */
+   int flen;
+   char *target;        /* alias of only subprocess to receive it, NULL for all */
+   unsigned long targetHash;
+} SubProcess_Message;
+
+/* SubProcess_Slab: lock-free pool of messages in slabs of size classes */
+class SubProcess_Slab
+{
+private:
+
+   /* Class: messages of a size */
+   typedef struct _Class {
+      unsigned long long head; /* free list, tag against ABA in upper and index in lower 32 bits */
+      int size;                /* bytes of a message */
+      int count;               /* messages in a slab */
+      char *slabs[SUBPROCESSSLAB_MAXSLABS];
+      int numSlabs;
+   } Class;
+
+   Class *m_classes;
+
+   GLFWmutex m_mutex;           /* growth of size classes */
+   unsigned long long m_allocs; /* heap allocations for messages */
+
+   /* initialize: initialize slab */
+   void initialize();
+
+   /* at: get message of size class by index */
+   SubProcess_Message *at(Class *c, unsigned int index);
+
+   /* take: pop free message of size class, NULL if none */
+   SubProcess_Message *take(Class *c);
+
+   /* put: push free message to its size class */
+   void put(SubProcess_Message *msg);
+
+   /* grow: add a slab to size class, return false if it cannot */
+   bool grow(int sizeClass);
+
+public:
+
+   /* SubProcess_Slab: slab constructor */
+   SubProcess_Slab();
+
+   /* ~SubProcess_Slab: slab destructor */
+   ~SubProcess_Slab();
+
+   /* setup: prepare size classes */
+   bool setup();
+
+   /* clear: free slabs, with no message referenced */
+   void clear();
+
+   /* create: format message with a reference, to a subprocess if target is given, NULL if slab is not set up (any thread) */
+   SubProcess_Message *create(const char *type, const char *args, double time, const char *target = NULL);
+
+   /* getAllocs: get number of heap allocations for messages */
+   unsigned long long getAllocs();
+
+   /* retain: add reference of message */
+   static void retain(SubProcess_Message *msg);
+
+   /* release: release reference of message, recycling it at last */
+   static void release(SubProcess_Message *msg);
+};
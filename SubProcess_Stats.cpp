@@ -0,0 +1,205 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* headers */
+
+#include "MMDAgent.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "SubProcess_Stats.h"
+
+/* SubProcess_Stats::initialize: initialize statistics */
+void SubProcess_Stats::initialize()
+{
+   m_segment = NULL;
+   m_name = NULL;
+}
+
+/* SubProcess_Stats::create: create shared memory of name, replacing segment left by a dead process, -1 on error */
+int SubProcess_Stats::create(const char *name)
+{
+   int fd;
+   bool stale = false;
+   struct stat st;
+   void *p;
+   const SubProcStats_Segment *seg;
+
+   fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+   if(fd >= 0 || errno != EEXIST)
+      return fd;
+
+   /* existing one is removed only if it is a segment of process which is gone */
+   fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+   if(fd < 0)
+      return -1;
+   if(fstat(fd, &st) == 0 && st.st_size == (off_t) sizeof(SubProcStats_Segment)) {
+      p = mmap(NULL, sizeof(SubProcStats_Segment), PROT_READ, MAP_SHARED, fd, 0);
+      if(p != MAP_FAILED) {
+         seg = (const SubProcStats_Segment *) p;
+         if(__atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) == SUBPROCSTATS_MAGIC && seg->pid > 0 && seg->pid != (int32_t) getpid() && kill(seg->pid, 0) < 0 && errno == ESRCH)
+            stale = true;
+         munmap(p, sizeof(SubProcStats_Segment));
+      }
+   }
+   close(fd);
+   if(stale == false)
+      return -1;
+
+   shm_unlink(name);
+   return shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+}
+
+/* SubProcess_Stats::SubProcess_Stats: statistics constructor */
+SubProcess_Stats::SubProcess_Stats()
+{
+   initialize();
+}
+
+/* SubProcess_Stats::~SubProcess_Stats: statistics destructor */
+SubProcess_Stats::~SubProcess_Stats()
+{
+   clear();
+}
+
+/* SubProcess_Stats::setup: create segment */
+bool SubProcess_Stats::setup()
+{
+   int fd = -1, len;
+   const char *env = getenv(SUBPROCSTATS_ENV);
+   char buff[NAME_MAX + 2];
+   void *p;
+
+   clear();
+
+   /* shared memory named after process unless disabled */
+   if(MMDAgent_strequal(env, "off") == false) {
+      if(MMDAgent_strlen(env) > 0)
+         len = snprintf(buff, sizeof(buff), "%s%s", (env[0] == '/') ? "" : "/", env);
+      else
+         len = snprintf(buff, sizeof(buff), "%s%d", SUBPROCSTATS_PREFIX, (int) getpid());
+      /* name longer than a file name is rejected, not cut into another one */
+      if(len > 0 && len < (int) sizeof(buff) && strchr(buff + 1, '/') == NULL)
+         fd = create(buff);
+      if(fd >= 0 && ftruncate(fd, sizeof(SubProcStats_Segment)) < 0) {
+         close(fd);
+         shm_unlink(buff);
+         fd = -1;
+      }
+      if(fd >= 0)
+         m_name = MMDAgent_strdup(buff);
+   }
+
+   /* counters are kept in private memory if shared memory is not available */
+   if(fd >= 0)
+      p = mmap(NULL, sizeof(SubProcStats_Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   else
+      p = mmap(NULL, sizeof(SubProcStats_Segment), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if(fd >= 0)
+      close(fd);
+   if(p == MAP_FAILED) {
+      clear();
+      return false;
+   }
+
+   m_segment = (SubProcStats_Segment *) p;
+   memset(m_segment, 0, sizeof(SubProcStats_Segment));
+   m_segment->version = SUBPROCSTATS_VERSION;
+   m_segment->maxProcs = SUBPROCSTATS_MAXPROCS;
+   m_segment->pid = (int32_t) getpid();
+   __atomic_store_n(&m_segment->magic, SUBPROCSTATS_MAGIC, __ATOMIC_RELEASE);
+
+   return true;
+}
+
+/* SubProcess_Stats::clear: remove segment */
+void SubProcess_Stats::clear()
+{
+   if(m_segment != NULL)
+      munmap(m_segment, sizeof(SubProcStats_Segment));
+   if(m_name != NULL) {
+      shm_unlink(m_name);
+      free(m_name);
+   }
+
+   initialize();
+}
+
+/* SubProcess_Stats::attach: assign a slot to subprocess, NULL if none is free */
+SubProcStats_Proc *SubProcess_Stats::attach(const char *name, int pid)
+{
+   int i;
+   uint32_t used;
+   SubProcStats_Proc *proc;
+
+   if(m_segment == NULL)
+      return NULL;
+
+   for(i = 0; i < SUBPROCSTATS_MAXPROCS; i++) {
+      proc = &m_segment->procs[i];
+      used = 0;
+      if(__atomic_compare_exchange_n(&proc->used, &used, 2, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) == false)
+         continue;
+
+      /* reset slot while it is marked as being assigned */
+      memset(((char *) proc) + sizeof(proc->used) + sizeof(proc->generation), 0, sizeof(SubProcStats_Proc) - sizeof(proc->used) - sizeof(proc->generation));
+      proc->pid = pid;
+      strncpy(proc->name, name, SUBPROCSTATS_NAMELEN - 1);
+      __atomic_fetch_add(&proc->generation, 1, __ATOMIC_RELAXED);
+      __atomic_store_n(&proc->used, 1, __ATOMIC_RELEASE);
+
+      return proc;
+   }
+
+   return NULL;
+}
+
+/* SubProcess_Stats::detach: release slot of subprocess */
+void SubProcess_Stats::detach(SubProcStats_Proc *proc)
+{
+   if(proc != NULL)
+      __atomic_store_n(&proc->used, 0, __ATOMIC_RELEASE);
+}
+
+/* SubProcess_Stats::getSegment: get segment */
+SubProcStats_Segment *SubProcess_Stats::getSegment()
+{
+   return m_segment;
+}
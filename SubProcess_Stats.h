@@ -0,0 +1,212 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* SubProcess_Stats.h: statistics of plugin published in shared memory (C and C++)
+
+   The plugin creates POSIX shared memory "/subproc-stats-PID" (in /dev/shm),
+   or the name given by environment variable SUBPROC_STATS ("off" keeps it private).
+   An existing one is replaced only if it was left by a process which is gone, and
+   counters are kept private when the name is taken or too long.
+   Counters are updated with relaxed atomic operations and may be read at any time.
+   A slot of subprocess is valid while its used flag is 1, and generation changes
+   whenever it is assigned to another subprocess.
+
+   Latency histograms have logarithmic buckets in microseconds:
+   bucket 0 counts values below 1 usec, bucket i counts values in [2^(i-1), 2^i) usec. */
+
+#ifndef SUBPROCESS_STATS_H
+#define SUBPROCESS_STATS_H
+
+#include <stdint.h>
+
+#define SUBPROCSTATS_ENV      "SUBPROC_STATS"
+#define SUBPROCSTATS_PREFIX   "/subproc-stats-"
+#define SUBPROCSTATS_MAGIC    0x53505354U /* "SPST" */
+#define SUBPROCSTATS_VERSION  7
+#define SUBPROCSTATS_MAXPROCS 256
+#define SUBPROCSTATS_NAMELEN  64
+#define SUBPROCSTATS_BUCKETS  32
+#define SUBPROCSTATS_LANES    3 /* priority lanes of input messages */
+
+/* SubProcStats_Histogram: latency histogram */
+typedef struct {
+   uint64_t count[SUBPROCSTATS_BUCKETS];
+   uint64_t sum; /* usec */
+} SubProcStats_Histogram;
+
+/* SubProcStats_Proc: statistics of a subprocess */
+typedef struct {
+   uint32_t used;
+   uint32_t generation;
+   int32_t pid;
+   uint32_t standby;      /* 1 while hot-standby replica */
+   char name[SUBPROCSTATS_NAMELEN];
+   uint64_t msgsOut;      /* messages handed to subprocess, written or pending */
+   uint64_t bytesOut;
+   uint64_t msgsIn;       /* messages forwarded from subprocess */
+   uint64_t bytesIn;
+   uint64_t dropped;      /* messages discarded by overflow policy */
+   uint64_t coalesced;    /* pending messages replaced by newer ones */
+   uint64_t writeErrors;  /* writes failed because subprocess closed its end */
+   uint64_t pendingBytes; /* bytes waiting in outbound buffer */
+   uint64_t pendingMsgs;
+   uint64_t calls;        /* requests of SUBPROC_CALL */
+   uint64_t callTimeouts; /* requests without reply until deadline */
+   uint64_t suppressed;   /* messages of hot-standby replica not forwarded */
+   SubProcStats_Histogram dispatch; /* enqueue until written to socket or kept in outbound buffer */
+   SubProcStats_Histogram forward;  /* read from socket until sendMessage */
+   SubProcStats_Histogram call;     /* SUBPROC_CALL until reply */
+} SubProcStats_Proc;
+
+/* SubProcStats_Segment: statistics of plugin */
+typedef struct {
+   uint32_t magic;
+   uint32_t version;
+   uint32_t maxProcs;
+   int32_t pid;
+   uint64_t enqueued;  /* messages enqueued by main program */
+   uint64_t dequeued;  /* messages taken by dispatcher */
+   uint64_t batches;   /* batches of dispatcher */
+   uint64_t wakeups;   /* returns of dispatcher from sleep */
+   uint64_t allocs;    /* heap allocations for messages, flat in steady state */
+   uint64_t laneEnqueued[SUBPROCSTATS_LANES];
+   uint64_t laneDequeued[SUBPROCSTATS_LANES];
+   SubProcStats_Histogram laneWait[SUBPROCSTATS_LANES]; /* enqueue until taken by dispatcher */
+   uint64_t laneOverflows[SUBPROCSTATS_LANES];          /* messages dropped as lane and its overflow array were full */
+   uint64_t failovers;     /* promotions of hot-standby replicas */
+   uint64_t standbys;      /* hot-standby replicas launched */
+   SubProcStats_Histogram failover; /* hang-up of primary until standby is promoted */
+   SubProcStats_Proc procs[SUBPROCSTATS_MAXPROCS];
+} SubProcStats_Segment;
+
+/* subprocstats_add: add to counter */
+static inline void subprocstats_add(uint64_t *counter, uint64_t value)
+{
+   __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+/* subprocstats_set: set gauge */
+static inline void subprocstats_set(uint64_t *gauge, uint64_t value)
+{
+   __atomic_store_n(gauge, value, __ATOMIC_RELAXED);
+}
+
+/* subprocstats_get: read counter */
+static inline uint64_t subprocstats_get(const uint64_t *counter)
+{
+   return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+/* subprocstats_record: add latency in usec to histogram */
+static inline void subprocstats_record(SubProcStats_Histogram *hist, double usec)
+{
+   int i = 0;
+   uint64_t value = (usec > 0.0) ? (uint64_t) usec : 0;
+
+   if(value > 0)
+      i = 64 - __builtin_clzll(value);
+   if(i >= SUBPROCSTATS_BUCKETS)
+      i = SUBPROCSTATS_BUCKETS - 1;
+
+   __atomic_fetch_add(&hist->count[i], 1, __ATOMIC_RELAXED);
+   __atomic_fetch_add(&hist->sum, value, __ATOMIC_RELAXED);
+}
+
+/* subprocstats_percentile: get upper bound in usec of bucket holding given percentile, 0 if empty */
+static inline uint64_t subprocstats_percentile(const SubProcStats_Histogram *hist, double percent)
+{
+   int i;
+   uint64_t total = 0, n = 0, rank;
+
+   for(i = 0; i < SUBPROCSTATS_BUCKETS; i++)
+      total += __atomic_load_n(&hist->count[i], __ATOMIC_RELAXED);
+   if(total == 0)
+      return 0;
+
+   rank = (uint64_t) (total * percent / 100.0);
+   if(rank >= total)
+      rank = total - 1;
+   for(i = 0; i < SUBPROCSTATS_BUCKETS; i++) {
+      n += __atomic_load_n(&hist->count[i], __ATOMIC_RELAXED);
+      if(n > rank)
+         break;
+   }
+
+   return (i == 0) ? 1 : ((uint64_t) 1 << i);
+}
+
+#ifdef __cplusplus
+
+/* SubProcess_Stats: owner of statistics segment */
+class SubProcess_Stats
+{
+private:
+
+   SubProcStats_Segment *m_segment;
+   char *m_name; /* name of shared memory, NULL if private */
+
+   /* initialize: initialize statistics */
+   void initialize();
+
+   /* create: create shared memory of name, replacing segment left by a dead process, -1 on error */
+   static int create(const char *name);
+
+public:
+
+   /* SubProcess_Stats: statistics constructor */
+   SubProcess_Stats();
+
+   /* ~SubProcess_Stats: statistics destructor */
+   ~SubProcess_Stats();
+
+   /* setup: create segment */
+   bool setup();
+
+   /* clear: remove segment */
+   void clear();
+
+   /* attach: assign a slot to subprocess, NULL if none is free */
+   SubProcStats_Proc *attach(const char *name, int pid);
+
+   /* detach: release slot of subprocess */
+   static void detach(SubProcStats_Proc *proc);
+
+   /* getSegment: get segment */
+   SubProcStats_Segment *getSegment();
+};
+
+#endif /* __cplusplus */
+
+#endif /* SUBPROCESS_STATS_H */
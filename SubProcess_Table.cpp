@@ -0,0 +1,389 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* headers */
+
+#include "MMDAgent.h"
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+
+#include "SubProcess_Stats.h"
+#include "SubProcess_Reactor.h"
+#include "SubProcess_Filter.h"
+#include "SubProcess_Option.h"
+#include "SubProcess_Slab.h"
+#include "SubProcess_Buffer.h"
+#include "SubProcess_Call.h"
+#include "SubProcess_Thread.h"
+#include "SubProcess_Table.h"
+
+/* SubProcess_Table::initialize: initialize table */
+void SubProcess_Table::initialize()
+{
+   m_mutex = NULL;
+
+   m_entries = NULL;
+   m_size = 0;
+   m_free = -1;
+}
+
+/* SubProcess_Table::lookup: get used slot of handle, NULL if stale (mutex must be held) */
+SubProcess_Table::Entry *SubProcess_Table::lookup(int handle)
+{
+   int index;
+   Entry *entry;
+
+   if(handle < 0)
+      return NULL;
+
+   index = handle & (SUBPROCESSTABLE_MAXSIZE - 1);
+   if(index >= m_size)
+      return NULL;
+
+   entry = &m_entries[index];
+   if(entry->state == SUBPROCESSTABLE_STATE_FREE || entry->generation != (handle >> SUBPROCESSTABLE_INDEXBITS))
+      return NULL;
+
+   return entry;
+}
+
+/* SubProcess_Table::SubProcess_Table: table constructor */
+SubProcess_Table::SubProcess_Table()
+{
+   initialize();
+}
+
+/* SubProcess_Table::~SubProcess_Table: table destructor */
+SubProcess_Table::~SubProcess_Table()
+{
+   clear();
+}
+
+/* SubProcess_Table::setup: allocate slots */
+bool SubProcess_Table::setup()
+{
+   int i;
+
+   clear();
+
+   m_mutex = glfwCreateMutex();
+   m_entries = (Entry *) malloc(sizeof(Entry) * SUBPROCESSTABLE_INITSIZE);
+   if(m_mutex == NULL || m_entries == NULL) {
+      clear();
+      return false;
+   }
+
+   m_size = SUBPROCESSTABLE_INITSIZE;
+   memset(m_entries, 0, sizeof(Entry) * m_size);
+   for(i = 0; i < m_size; i++)
+      m_entries[i].next = (i + 1 < m_size) ? i + 1 : -1;
+   m_free = 0;
+
+   return true;
+}
+
+/* SubProcess_Table::clear: stop remaining subprocesses and free slots */
+void SubProcess_Table::clear()
+{
+   int i;
+
+   /* owners have closed theirs, remaining ones are stopped here */
+   for(i = 0; i < m_size; i++) {
+      if(m_entries[i].state == SUBPROCESSTABLE_STATE_FREE)
+         continue;
+      if(m_entries[i].pidfd >= 0)
+         ::close(m_entries[i].pidfd);
+      kill(m_entries[i].pid, SIGHUP);
+      spclose(m_entries[i].stream, m_entries[i].pid);
+   }
+
+   if(m_mutex != NULL)
+      glfwDestroyMutex(m_mutex);
+   free(m_entries);
+
+   initialize();
+}
+
+/* SubProcess_Table::open: spawn subprocess as spopen does and register it in state, return handle or -1 on error */
+int SubProcess_Table::open(const char *command, int state, const char *const *envs, const int *fds, int numfds, const SubProcess_Limits *limits, const char *cgroup)
+{
+   int i, index, handle, pidfd;
+   pid_t pid;
+   FILE *stream;
+   Entry *entries, *entry;
+
+   if(m_mutex == NULL || state == SUBPROCESSTABLE_STATE_FREE)
+      return -1;
+
+   /* spawn without lock, it takes long */
+   stream = spopen(command, &pid, envs, fds, numfds, limits, cgroup);
+   if(stream == NULL)
+      return -1;
+
+   /* pidfd keeps referring to the subprocess, even after it exited and its PID was reused */
+   pidfd = (int) syscall(SYS_pidfd_open, pid, 0);
+   if(pidfd < 0)
+      pidfd = -1;
+
+   glfwLockMutex(m_mutex);
+
+   /* double slots when all are used, handles stay valid since they are indices */
+   if(m_free < 0 && m_size < SUBPROCESSTABLE_MAXSIZE) {
+      entries = (Entry *) realloc(m_entries, sizeof(Entry) * m_size * 2);
+      if(entries != NULL) {
+         memset(&entries[m_size], 0, sizeof(Entry) * m_size);
+         for(i = m_size; i < m_size * 2; i++)
+            entries[i].next = (i + 1 < m_size * 2) ? i + 1 : -1;
+         m_free = m_size;
+         m_entries = entries;
+         m_size *= 2;
+      }
+   }
+
+   if(m_free < 0) {
+      glfwUnlockMutex(m_mutex);
+      if(pidfd >= 0)
+         ::close(pidfd);
+      kill(pid, SIGHUP);
+      spclose(stream, pid);
+      errno = ENOMEM;
+      return -1;
+   }
+
+   index = m_free;
+   entry = &m_entries[index];
+   m_free = entry->next;
+
+   entry->stream = stream;
+   entry->pid = pid;
+   entry->pidfd = pidfd;
+   entry->start = glfwGetTime();
+   entry->state = state;
+   entry->status = 0;
+   entry->next = -1;
+   handle = (entry->generation << SUBPROCESSTABLE_INDEXBITS) | index;
+
+   glfwUnlockMutex(m_mutex);
+
+   return handle;
+}
+
+/* SubProcess_Table::close: unregister subprocess, close its stream and wait for it to stop, return its wait status or -1 */
+int SubProcess_Table::close(int handle)
+{
+   int pidfd;
+   pid_t pid;
+   FILE *stream;
+   Entry *entry;
+
+   if(m_mutex == NULL)
+      return -1;
+
+   /* free slot first, then stale handles never reach the PID being collected */
+   glfwLockMutex(m_mutex);
+   entry = lookup(handle);
+   if(entry == NULL) {
+      glfwUnlockMutex(m_mutex);
+      return -1;
+   }
+   stream = entry->stream;
+   pid = entry->pid;
+   pidfd = entry->pidfd;
+   entry->stream = NULL;
+   entry->pidfd = -1;
+   entry->state = SUBPROCESSTABLE_STATE_FREE;
+   entry->generation = (entry->generation + 1) & SUBPROCESSTABLE_MAXGEN;
+   entry->next = m_free;
+   m_free = entry - m_entries;
+   glfwUnlockMutex(m_mutex);
+
+   if(pidfd >= 0)
+      ::close(pidfd);
+
+   return spclose(stream, pid);
+}
+
+/* SubProcess_Table::signal: send signal to subprocess, through pidfd when supported so that reused PID is never hit */
+bool SubProcess_Table::signal(int handle, int sig)
+{
+   bool ret = false;
+   Entry *entry;
+
+   if(m_mutex == NULL)
+      return false;
+
+   /* PID is not reused while slot is held, since it is collected only after slot is freed */
+   glfwLockMutex(m_mutex);
+   entry = lookup(handle);
+   if(entry != NULL) {
+      if(entry->pidfd >= 0 && syscall(SYS_pidfd_send_signal, entry->pidfd, sig, NULL, 0) == 0)
+         ret = true;
+      else
+         ret = (kill(entry->pid, sig) == 0);
+   }
+   glfwUnlockMutex(m_mutex);
+
+   return ret;
+}
+
+/* SubProcess_Table::hasExited: check without collecting if subprocess has exited, keeping its exit code or negative signal in status */
+bool SubProcess_Table::hasExited(int handle, int *status)
+{
+   bool ret = false;
+   siginfo_t info;
+   Entry *entry;
+
+   if(m_mutex == NULL)
+      return true;
+
+   glfwLockMutex(m_mutex);
+   entry = lookup(handle);
+   if(entry == NULL) {
+      ret = true;
+   } else if(entry->state == SUBPROCESSTABLE_STATE_EXITED) {
+      ret = true;
+   } else {
+      /* zombie is left for close to collect */
+      memset(&info, 0, sizeof(siginfo_t));
+      if(waitid(P_PID, entry->pid, &info, WEXITED | WNOHANG | WNOWAIT) < 0) {
+         /* already collected elsewhere, such as by SIGCHLD ignored */
+         if(errno != EINTR) {
+            entry->state = SUBPROCESSTABLE_STATE_EXITED;
+            ret = true;
+         }
+      } else if(info.si_pid == entry->pid) {
+         entry->status = (info.si_code == CLD_EXITED) ? info.si_status : -info.si_status;
+         entry->state = SUBPROCESSTABLE_STATE_EXITED;
+         ret = true;
+      }
+   }
+   if(status != NULL)
+      *status = (entry != NULL) ? entry->status : 0;
+   glfwUnlockMutex(m_mutex);
+
+   return ret;
+}
+
+/* SubProcess_Table::setState: set state of subprocess */
+bool SubProcess_Table::setState(int handle, int state)
+{
+   Entry *entry;
+
+   if(m_mutex == NULL || state == SUBPROCESSTABLE_STATE_FREE)
+      return false;
+
+   glfwLockMutex(m_mutex);
+   entry = lookup(handle);
+   if(entry != NULL && entry->state != SUBPROCESSTABLE_STATE_EXITED)
+      entry->state = state;
+   glfwUnlockMutex(m_mutex);
+
+   return entry != NULL;
+}
+
+/* SubProcess_Table::getStream: get socketpair stream of subprocess, NULL if handle is stale */
+FILE *SubProcess_Table::getStream(int handle)
+{
+   FILE *stream = NULL;
+   Entry *entry;
+
+   if(m_mutex == NULL)
+      return NULL;
+
+   glfwLockMutex(m_mutex);
+   entry = lookup(handle);
+   if(entry != NULL)
+      stream = entry->stream;
+   glfwUnlockMutex(m_mutex);
+
+   return stream;
+}
+
+/* SubProcess_Table::getPid: get PID of subprocess, -1 if handle is stale */
+pid_t SubProcess_Table::getPid(int handle)
+{
+   pid_t pid = -1;
+   Entry *entry;
+
+   if(m_mutex == NULL)
+      return -1;
+
+   glfwLockMutex(m_mutex);
+   entry = lookup(handle);
+   if(entry != NULL)
+      pid = entry->pid;
+   glfwUnlockMutex(m_mutex);
+
+   return pid;
+}
+
+/* SubProcess_Table::getPidfd: get pidfd of subprocess, owned by table, -1 if not supported */
+int SubProcess_Table::getPidfd(int handle)
+{
+   int pidfd = -1;
+   Entry *entry;
+
+   if(m_mutex == NULL)
+      return -1;
+
+   glfwLockMutex(m_mutex);
+   entry = lookup(handle);
+   if(entry != NULL)
+      pidfd = entry->pidfd;
+   glfwUnlockMutex(m_mutex);
+
+   return pidfd;
+}
+
+/* SubProcess_Table::getStartTime: get time when subprocess was started, 0 if handle is stale */
+double SubProcess_Table::getStartTime(int handle)
+{
+   double start = 0.0;
+   Entry *entry;
+
+   if(m_mutex == NULL)
+      return 0.0;
+
+   glfwLockMutex(m_mutex);
+   entry = lookup(handle);
+   if(entry != NULL)
+      start = entry->start;
+   glfwUnlockMutex(m_mutex);
+
+   return start;
+}
@@ -0,0 +1,118 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* definitions */
+
+#define SUBPROCESSTABLE_INITSIZE  64    /* slots allocated first, doubled on demand */
+#define SUBPROCESSTABLE_INDEXBITS 16    /* low bits of handle are slot, the rest is generation of slot */
+#define SUBPROCESSTABLE_MAXSIZE   (1 << SUBPROCESSTABLE_INDEXBITS)
+#define SUBPROCESSTABLE_MAXGEN    0x7fff
+
+#define SUBPROCESSTABLE_STATE_FREE     0 /* slot is not used */
+#define SUBPROCESSTABLE_STATE_IDLE     1 /* launched in advance, not claimed yet */
+#define SUBPROCESSTABLE_STATE_RUNNING  2
+#define SUBPROCESSTABLE_STATE_STOPPING 3 /* being torn down */
+#define SUBPROCESSTABLE_STATE_EXITED   4 /* exited, not collected yet */
+
+/* SubProcess_Table: table of running subprocesses by handle, shared by all threads which start or stop them */
+class SubProcess_Table
+{
+private:
+
+   /* Entry: slot of subprocess */
+   typedef struct _Entry {
+      FILE *stream;   /* socketpair stream */
+      pid_t pid;
+      int pidfd;      /* -1 if not supported */
+      double start;   /* time when subprocess was started */
+      int state;
+      int status;     /* exit code or negative signal, when exited */
+      int generation; /* incremented when slot is freed, so that stale handles miss */
+      int next;       /* next free slot, -1 for none */
+   } Entry;
+
+   GLFWmutex m_mutex; /* mutual exclusion for slots, never held during spawn nor wait */
+
+   Entry *m_entries;
+   int m_size;
+   int m_free;        /* first free slot, -1 for none */
+
+   /* initialize: initialize table */
+   void initialize();
+
+   /* lookup: get used slot of handle, NULL if stale (mutex must be held) */
+   Entry *lookup(int handle);
+
+public:
+
+   /* SubProcess_Table: table constructor */
+   SubProcess_Table();
+
+   /* ~SubProcess_Table: table destructor */
+   ~SubProcess_Table();
+
+   /* setup: allocate slots */
+   bool setup();
+
+   /* clear: stop remaining subprocesses and free slots */
+   void clear();
+
+   /* open: spawn subprocess as spopen does and register it in state, return handle or -1 on error */
+   int open(const char *command, int state = SUBPROCESSTABLE_STATE_RUNNING, const char *const *envs = NULL, const int *fds = NULL, int numfds = 0, const SubProcess_Limits *limits = NULL, const char *cgroup = NULL);
+
+   /* close: unregister subprocess, close its stream and wait for it to stop, return its wait status or -1 */
+   int close(int handle);
+
+   /* signal: send signal to subprocess, through pidfd when supported so that reused PID is never hit */
+   bool signal(int handle, int sig);
+
+   /* hasExited: check without collecting if subprocess has exited, keeping its exit code or negative signal in status */
+   bool hasExited(int handle, int *status);
+
+   /* setState: set state of subprocess */
+   bool setState(int handle, int state);
+
+   /* getStream: get socketpair stream of subprocess, NULL if handle is stale */
+   FILE *getStream(int handle);
+
+   /* getPid: get PID of subprocess, -1 if handle is stale */
+   pid_t getPid(int handle);
+
+   /* getPidfd: get pidfd of subprocess, owned by table, -1 if not supported */
+   int getPidfd(int handle);
+
+   /* getStartTime: get time when subprocess was started, 0 if handle is stale */
+   double getStartTime(int handle);
+};
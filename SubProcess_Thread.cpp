@@ -47,45 +47,259 @@
 #include <unistd.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+#include <arpa/inet.h>
 #include <sys/wait.h>
 #include <errno.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include "SubProcess_Shm.h"
+#include "SubProcess_Stats.h"
+#include "SubProcess_Recorder.h"
+#include "SubProcess_Reactor.h"
+#include "SubProcess_Filter.h"
+#include "SubProcess_Option.h"
+#include "SubProcess_Slab.h"
+#include "SubProcess_Buffer.h"
+#include "SubProcess_Call.h"
 #include "SubProcess_Thread.h"
+#include "SubProcess_Table.h"
+#include "SubProcess_Pool.h"
 
-/* association list of PID */
-struct pid_assoc
+/* check if command line needs shell to be interpreted */
+static bool spneedshell(const char *command)
 {
-    FILE *stream;
-    pid_t pid;
-    struct pid_assoc *next;
-} *pids = NULL;
+    const char *p;
+
+    for(p = command; *p != '\0'; p++) {
+        if(strchr("|&;<>()$`\\\"'*?[]#~=%{}!\n", *p) != NULL)
+            return true;
+    }
 
-/* spawn subprocess with socketpair connected */
-FILE *spopen(const char *command)
+    return false;
+}
+
+/* split command line into argument vector at white spaces */
+static char **spsplit(const char *command)
 {
-    int sv[2], saved_errno;
-    pid_t pid;
+    int argc = 0, len = strlen(command);
+    char **argv, *buff, *p;
 
-    if(command == NULL) {
-        errno = EINVAL;
+    /* pointers and strings in one block */
+    argv = (char **) malloc(sizeof(char *) * (len / 2 + 2) + sizeof(char) * (len + 1));
+    if(argv == NULL)
         return NULL;
+    buff = (char *) &argv[len / 2 + 2];
+    strcpy(buff, command);
+
+    for(p = buff; *p != '\0';) {
+        while(*p == ' ' || *p == '\t')
+            *p++ = '\0';
+        if(*p == '\0')
+            break;
+        argv[argc++] = p;
+        while(*p != ' ' && *p != '\t' && *p != '\0')
+            p++;
     }
+    argv[argc] = NULL;
 
-    if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1)
+    if(argc == 0) {
+        free(argv);
         return NULL;
+    }
 
-    switch(pid = fork()) {
-    case -1: /* error */
-        saved_errno = errno;
-        close(sv[0]);
-        close(sv[1]);
-        errno = saved_errno;
+    return argv;
+}
+
+/* write string to file of cgroup */
+static bool spwrite(const char *path, const char *str)
+{
+    int fd;
+    bool ret;
+
+    fd = open(path, O_WRONLY | O_CLOEXEC);
+    if(fd < 0)
+        return false;
+    ret = write(fd, str, strlen(str)) == (ssize_t) strlen(str);
+    close(fd);
+
+    return ret;
+}
+
+/* make cgroup-v2 directory of subprocess with caps, NULL when cgroups are not writable */
+static char *spcgroup(const char *name, const SubProcess_Limits *limits)
+{
+    static unsigned long serial = 0;
+    char *base, *dir, path[MMDAGENT_MAXBUFLEN], value[64];
+
+    if(limits == NULL || limits->cgroup == NULL)
+        return NULL;
+
+    /* relative to mount point unless absolute */
+    base = (char *) malloc(sizeof(char) * (strlen(SUBPROCESSTHREAD_CGROUPROOT) + 1 + strlen(limits->cgroup) + 1));
+    if(limits->cgroup[0] == '/')
+        strcpy(base, limits->cgroup);
+    else
+        sprintf(base, "%s/%s", SUBPROCESSTHREAD_CGROUPROOT, limits->cgroup);
+    if(mkdir(base, 0755) < 0 && errno != EEXIST) {
+        free(base);
+        return NULL;
+    }
+
+    /* controllers of caps for children, already enabled ones are kept */
+    if(limits->cgroupCpu > 0 && snprintf(path, sizeof(path), "%s/cgroup.subtree_control", base) < (int) sizeof(path))
+        spwrite(path, "+cpu");
+    if(limits->cgroupMemory > 0 && snprintf(path, sizeof(path), "%s/cgroup.subtree_control", base) < (int) sizeof(path))
+        spwrite(path, "+memory");
+
+    /* each subprocess has its own directory, replicas and workers of an alias are capped one by one */
+    dir = (char *) malloc(sizeof(char) * (strlen(base) + 1 + strlen(name) + 32));
+    sprintf(dir, "%s/%s.%lu", base, name, __atomic_add_fetch(&serial, 1, __ATOMIC_RELAXED));
+    free(base);
+    if(mkdir(dir, 0755) < 0) {
+        free(dir);
+        return NULL;
+    }
+
+    if(limits->cgroupCpu > 0) {
+        sprintf(value, "%d %d", limits->cgroupCpu * (SUBPROCESSTHREAD_CGROUPPERIOD / 100), SUBPROCESSTHREAD_CGROUPPERIOD);
+        if(snprintf(path, sizeof(path), "%s/cpu.max", dir) >= (int) sizeof(path) || spwrite(path, value) == false) {
+            rmdir(dir);
+            free(dir);
+            return NULL;
+        }
+    }
+    if(limits->cgroupMemory > 0) {
+        sprintf(value, "%lld", limits->cgroupMemory);
+        if(snprintf(path, sizeof(path), "%s/memory.max", dir) >= (int) sizeof(path) || spwrite(path, value) == false) {
+            rmdir(dir);
+            free(dir);
+            return NULL;
+        }
+    }
 
+    /* child has to be able to join */
+    if(snprintf(path, sizeof(path), "%s/cgroup.procs", dir) >= (int) sizeof(path) || access(path, W_OK) < 0) {
+        rmdir(dir);
+        free(dir);
         return NULL;
+    }
+
+    return dir;
+}
+
+/* apply limits in child before exec, each of them is best effort */
+static void splimit(const SubProcess_Limits *limits, const cpu_set_t *cpus, const char *procs)
+{
+    struct sched_param param;
+    struct rlimit rl;
+
+    /* cgroup first, its caps cover the rest of setup, child stays in cgroup of plugin on failure */
+    if(procs != NULL)
+        spwrite(procs, "0");
+
+    if(limits == NULL)
+        return;
 
-    case 0: /* child */
-    {
+    if(cpus != NULL)
+        sched_setaffinity(0, sizeof(cpu_set_t), cpus);
+
+    if(limits->sched != SUBPROCESSOPTION_SCHED_INHERIT) {
+        memset(&param, 0, sizeof(param));
+        if(limits->sched == SUBPROCESSOPTION_SCHED_BATCH)
+            sched_setscheduler(0, SCHED_BATCH, &param);
+        else if(limits->sched == SUBPROCESSOPTION_SCHED_IDLE)
+            sched_setscheduler(0, SCHED_IDLE, &param);
+        else
+            sched_setscheduler(0, SCHED_OTHER, &param);
+    }
+
+    /* nice value is kept by SCHED_BATCH, and raising priority needs privilege */
+    if(limits->nice != SUBPROCESSOPTION_NICE_INHERIT)
+        setpriority(PRIO_PROCESS, 0, limits->nice);
+
+    /* ioprio_set(IOPRIO_WHO_PROCESS, self, class << 13 | level) has no wrapper in libc */
+    if(limits->ioClass != SUBPROCESSOPTION_IOCLASS_INHERIT)
+        syscall(SYS_ioprio_set, 1, 0, (limits->ioClass << 13) | limits->ioLevel);
+
+    /* soft limits, hard limits may only be lowered once */
+    if(limits->memory > 0 && getrlimit(RLIMIT_AS, &rl) == 0) {
+        rl.rlim_cur = (rl.rlim_max == RLIM_INFINITY || (rlim_t) limits->memory < rl.rlim_max) ? (rlim_t) limits->memory : rl.rlim_max;
+        setrlimit(RLIMIT_AS, &rl);
+    }
+    if(limits->cpuTime > 0 && getrlimit(RLIMIT_CPU, &rl) == 0) {
+        rl.rlim_cur = (rl.rlim_max == RLIM_INFINITY || (rlim_t) limits->cpuTime < rl.rlim_max) ? (rlim_t) limits->cpuTime : rl.rlim_max;
+        setrlimit(RLIMIT_CPU, &rl);
+    }
+}
+
+/* start subprocess by fork and shell, applying limits in child */
+static pid_t spfork(const char *command, int sv[2], const char *const *envs, const int *fds, int numfds, const SubProcess_Limits *limits, const char *cgroup)
+{
+    int i, n;
+    pid_t pid;
+    cpu_set_t cpus;
+    bool affinity = false;
+    char *procs = NULL, *buff, **envp = environ;
+    char *shargv[4];
+
+    /* prepared before fork, child only makes system calls */
+    if(limits != NULL) {
+        CPU_ZERO(&cpus);
+        for(i = 0; i < SUBPROCESSOPTION_MAXCPUS && i < CPU_SETSIZE; i++) {
+            if(limits->cpus[i / 64] & (1ULL << (i % 64))) {
+                CPU_SET(i, &cpus);
+                affinity = true;
+            }
+        }
+    }
+
+    buff = (char *) malloc(sizeof(char) * (strlen(command) + 5 + 1));
+    if(buff == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    strcpy(buff, "exec "); /* 5 characters */
+    strcat(buff, command);
+    shargv[0] = (char *) "sh";
+    shargv[1] = (char *) "-c";
+    shargv[2] = buff;
+    shargv[3] = NULL;
+
+    /* environment with additional variables, as putenv in child is not async-signal-safe */
+    if(envs != NULL && envs[0] != NULL) {
+        for(n = 0; environ[n] != NULL; n++);
+        for(i = 0; envs[i] != NULL; i++);
+        envp = (char **) malloc(sizeof(char *) * (n + i + 1));
+        if(envp == NULL) {
+            free(buff);
+            errno = ENOMEM;
+            return -1;
+        }
+        for(i = 0; envs[i] != NULL; i++)
+            envp[i] = (char *) envs[i];
+        memcpy(&envp[i], environ, sizeof(char *) * (n + 1));
+    }
+
+    if(cgroup != NULL) {
+        procs = (char *) malloc(sizeof(char) * (strlen(cgroup) + 13 + 1));
+        if(procs != NULL)
+            sprintf(procs, "%s/cgroup.procs", cgroup); /* 13 characters after directory */
+    }
+
+    if((pid = fork()) == 0) { /* child */
         int fd1, fd2;
-        char *buff = NULL;
+
+        splimit(limits, affinity ? &cpus : NULL, procs);
 
         close(sv[0]); /* unused */
 
@@ -94,66 +308,186 @@ FILE *spopen(const char *command)
 
         close(sv[1]);
 
-        if(fd1 >= 0 && fd2 >= 0) {
-            buff = (char *) malloc(sizeof(char) * (strlen(command) + 5 + 1));
+        /* additional descriptors, given ones are above targets */
+        for(i = 0; i < numfds; i++)
+            if(dup2(fds[i], SUBPROCESSTHREAD_FIRSTFD + i) < 0)
+                fd1 = -1;
 
-            if(buff != NULL) {
-                strcpy(buff, "exec "); /* 5 characters */
-                strcat(buff, command);
-                execl("/bin/sh", "sh", "-c", buff, (char *) NULL);
-            }
-        }
+        if(fd1 >= 0 && fd2 >= 0)
+            execve("/bin/sh", shargv, envp);
 
         /* error */
         _exit(1);
     }
-    default: /* parent */
-    {
-        struct pid_assoc *assoc;
 
-        close(sv[1]); /* unused */
+    if(envp != environ)
+        free(envp);
+    free(buff);
+    free(procs);
 
-        assoc = (struct pid_assoc *) malloc(sizeof(struct pid_assoc));
+    return pid;
+}
 
-        if(assoc != NULL) {
-            assoc->stream = fdopen(sv[0], "r+");
+/* start subprocess by posix_spawn, without shell if command line is simple */
+static pid_t spspawn(const char *command, int sv[2], const char *const *envs, const int *fds, int numfds)
+{
+    int i, n, err;
+    pid_t pid = -1;
+    char **argv, *buff = NULL, **envp = environ;
+    char *shargv[4];
+    posix_spawn_file_actions_t actions;
+
+    if(spneedshell(command) == false) {
+        argv = spsplit(command);
+        if(argv == NULL) {
+            errno = EINVAL;
+            return -1;
+        }
+    } else {
+        argv = NULL;
+        buff = (char *) malloc(sizeof(char) * (strlen(command) + 5 + 1));
+        if(buff == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        strcpy(buff, "exec "); /* 5 characters */
+        strcat(buff, command);
+        shargv[0] = (char *) "sh";
+        shargv[1] = (char *) "-c";
+        shargv[2] = buff;
+        shargv[3] = NULL;
+    }
 
-            if(assoc->stream != NULL) {
-                assoc->pid = pid;
+    /* environment with additional variables */
+    if(envs != NULL && envs[0] != NULL) {
+        for(n = 0; environ[n] != NULL; n++);
+        for(i = 0; envs[i] != NULL; i++);
+        envp = (char **) malloc(sizeof(char *) * (n + i + 1));
+        if(envp == NULL) {
+            free(argv);
+            free(buff);
+            errno = ENOMEM;
+            return -1;
+        }
+        for(i = 0; envs[i] != NULL; i++)
+            envp[i] = (char *) envs[i];
+        memcpy(&envp[i], environ, sizeof(char *) * (n + 1));
+    }
 
-                /* insert assoc to head of list */
-                if(pids == NULL)
-                    assoc->next = NULL;
-                else
-                    assoc->next = pids;
+    /* socketpair -> stdin and stdout, both ends are closed on exec */
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, sv[1], 0);
+    posix_spawn_file_actions_adddup2(&actions, sv[1], 1);
+    for(i = 0; i < numfds; i++)
+        posix_spawn_file_actions_adddup2(&actions, fds[i], SUBPROCESSTHREAD_FIRSTFD + i);
+
+    if(argv != NULL)
+        err = posix_spawnp(&pid, argv[0], &actions, NULL, argv, envp);
+    else
+        err = posix_spawn(&pid, "/bin/sh", &actions, NULL, shargv, envp);
+
+    posix_spawn_file_actions_destroy(&actions);
+    if(envp != environ)
+        free(envp);
+    free(argv);
+    free(buff);
+
+    if(err != 0) {
+        errno = err;
+        return -1;
+    }
 
-                pids = assoc;
+    return pid;
+}
 
-                return assoc->stream;
-            }
-            else
-                saved_errno = errno;
+/* spawn subprocess with socketpair connected and its PID stored in pidp, adding "NAME=value" strings to environment and passing fds as 3, 4, ...,
+   limits and joining cgroup directory are applied in child before exec */
+FILE *spopen(const char *command, pid_t *pidp, const char *const *envs, const int *fds, int numfds, const SubProcess_Limits *limits, const char *cgroup)
+{
+    int i, sv[2], saved_errno;
+    int *tmp = NULL;
+    pid_t pid;
+    FILE *stream;
+
+    if(command == NULL || pidp == NULL || numfds < 0 || (numfds > 0 && fds == NULL)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    /* close-on-exec keeps sockets of other subprocesses away from child */
+    if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1)
+        return NULL;
 
-            /* error */
-            free(assoc);
+    /* move additional descriptors above targets so that dup2 in child never overwrites them */
+    if(numfds > 0) {
+        tmp = (int *) malloc(sizeof(int) * numfds);
+        for(i = 0; tmp != NULL && i < numfds; i++) {
+            tmp[i] = fcntl(fds[i], F_DUPFD_CLOEXEC, SUBPROCESSTHREAD_FIRSTFD + numfds);
+            if(tmp[i] < 0) {
+                saved_errno = errno;
+                while(i-- > 0)
+                    close(tmp[i]);
+                free(tmp);
+                close(sv[0]);
+                close(sv[1]);
+                errno = saved_errno;
+                return NULL;
+            }
         }
-        else
-            saved_errno = ENOMEM;
+        if(tmp == NULL) {
+            close(sv[0]);
+            close(sv[1]);
+            errno = ENOMEM;
+            return NULL;
+        }
+    }
 
-        /* error */
+    /* posix_spawn can not set affinity, limits nor cgroup of child */
+    if(limits != NULL || cgroup != NULL || MMDAgent_strequal(getenv(SUBPROCESSTHREAD_ENVSPAWN), "fork"))
+        pid = spfork(command, sv, envs, tmp, numfds, limits, cgroup);
+    else
+        pid = spspawn(command, sv, envs, tmp, numfds);
+
+    if(tmp != NULL) {
+        saved_errno = errno;
+        for(i = 0; i < numfds; i++)
+            close(tmp[i]);
+        free(tmp);
+        errno = saved_errno;
+    }
+
+    switch(pid) {
+    case -1: /* error */
+        saved_errno = errno;
         close(sv[0]);
+        close(sv[1]);
         errno = saved_errno;
+
         return NULL;
-    }
+
+    default: /* parent */
+        close(sv[1]); /* unused */
+
+        stream = fdopen(sv[0], "r+");
+        if(stream == NULL) {
+            saved_errno = errno;
+            close(sv[0]);
+            kill(pid, SIGKILL);
+            while(waitpid(pid, NULL, 0) == -1 && errno == EINTR);
+            errno = saved_errno;
+            return NULL;
+        }
+
+        *pidp = pid;
+        return stream;
     }
 }
 
-/* close socketpair and wait for subprocess to stop */
-int spclose(FILE *stream)
+/* close socketpair and wait for subprocess of PID to stop */
+int spclose(FILE *stream, pid_t pid)
 {
-    pid_t pid;
     int status;
-    struct pid_assoc *assoc, *prev = NULL;
+    pid_t ret;
 
     if(stream == NULL)
         return -1;
@@ -161,42 +495,31 @@ int spclose(FILE *stream)
     /* close streams */
     fclose(stream);
 
-    /* remember PID */
-    for(assoc = pids; assoc != NULL; assoc = assoc->next) {
-        if(assoc->stream == stream) {
-            /* wait for child process to stop */
-            /* (ignore SIGCHLD when the other child process stops) */
-            while((pid = waitpid(assoc->pid, &status, 0)) == -1 && errno == EINTR);
-
-            /* remove assoc from list */
-            if(prev == NULL)
-                pids = assoc->next;
-            else
-                prev->next = assoc-> next;
-
-            free(assoc);
-
-            /* return exit status of child process */
-            return (pid == -1) ? -1 : status;
-        }
-
-        prev = assoc;
-    }
+    /* wait for child process to stop */
+    /* (ignore SIGCHLD when the other child process stops) */
+    while((ret = waitpid(pid, &status, 0)) == -1 && errno == EINTR);
 
-    return -1;
+    /* return exit status of child process */
+    return (ret == -1) ? -1 : status;
 }
 
-/* get PID of subprocess that socketpair stream is bound to */
-pid_t spgetpid(FILE *stream)
+/* pin calling thread to CPUs given by SUBPROC_CPUS, if any */
+void sppin()
 {
-    struct pid_assoc *assoc;
+    int i;
+    cpu_set_t cpus;
+    unsigned long long mask[SUBPROCESSOPTION_CPUWORDS];
 
-    for(assoc = pids; assoc != NULL; assoc = assoc->next) {
-        if(assoc->stream == stream)
-            return assoc->pid;
-    }
+    /* threads starting subprocesses are not pinned, children inherit affinity */
+    if(SubProcess_Option::parseCpus(getenv(SUBPROCESSTHREAD_ENVCPUS), mask) == false)
+        return;
+
+    CPU_ZERO(&cpus);
+    for(i = 0; i < SUBPROCESSOPTION_MAXCPUS && i < CPU_SETSIZE; i++)
+        if(mask[i / 64] & (1ULL << (i % 64)))
+            CPU_SET(i, &cpus);
 
-    return -1;
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
 }
 
 /* getArgFromString: get argument from string using separators */
@@ -240,6 +563,7 @@ static int getArgFromString(const char *str, int *index, char *buff)
 static void mainThread(void *param)
 {
    SubProcess_Thread *subprocess_thread = (SubProcess_Thread *) param;
+   sppin();
    subprocess_thread->run();
 }
 
@@ -249,30 +573,92 @@ void SubProcess_Thread::initialize()
    m_mmdagent = NULL;
 
    m_thread = -1;
+   m_reactor = NULL;
+   m_running = false;
 
    m_name = NULL;
    m_commandLine = NULL;
+   m_cgroup = NULL;
+   m_table = NULL;
+   m_handle = -1;
    m_stream = NULL;
+
+   m_flushTime = 0.0;
+
+   m_dropped = 0;
+   m_overflow = false;
+   m_coalesced = 0;
+   m_reported = 0;
+
+   m_inbuf = NULL;
+   m_insize = 0;
+   m_inlen = 0;
+
+   m_shm = NULL;
+   m_shmLength = 0;
+   m_shmSize = 0;
+   m_shmRingOut = NULL;
+   m_shmRingIn = NULL;
+   m_shmFd = -1;
+   m_shmInFd = -1;
+   m_shmOutFd = -1;
+   m_shmBuf = NULL;
+
+   m_stats = NULL;
+   m_recorder = NULL;
+   m_readTime = 0.0;
+
+   m_standby = false;
+   m_hangupFunc = NULL;
+   m_hangupParam = NULL;
+   m_stopping = false;
 }
 
 /* SubProcess_Thread::clear: free thread */
 void SubProcess_Thread::clear()
 {
+   /* hang-up on purpose is not handled */
+   __atomic_store_n(&m_hangupFunc, (SubProcess_HangupFunc) NULL, __ATOMIC_RELEASE);
+
+   /* stop watching socket */
+   if(m_reactor != NULL)
+      m_reactor->remove(this);
+
    /* stop subprocess */
-   if(m_stream != NULL) {
-      kill(spgetpid(m_stream), SIGHUP);
-      spclose(m_stream);
-   }
+   if(m_stream != NULL)
+      m_table->signal(m_handle, SIGHUP);
 
-   /* stop thread */
+   /* stop thread, waking it up before socket is closed since it may not have polled yet */
    if(m_thread >= 0) {
+      shutdown(fileno(m_stream), SHUT_RDWR);
       glfwWaitThread(m_thread, GLFW_WAIT);
       glfwDestroyThread(m_thread);
    }
 
+   if(m_stream != NULL)
+      m_table->close(m_handle);
+
+   /* cgroup can be removed once subprocess is gone */
+   if(m_cgroup != NULL) {
+      rmdir(m_cgroup);
+      free(m_cgroup);
+   }
+
+   /* no reply comes any more */
+   if(m_mmdagent != NULL)
+      expireCalls(-1.0);
+
    /* free */
    free(m_name);
    free(m_commandLine);
+   m_filter.clear();
+   m_coalesce.clear();
+   m_option.clear();
+   m_outbuf.clear();
+   m_calls.clear();
+   free(m_inbuf);
+   closeShm();
+   SubProcess_Stats::detach(m_stats);
 
    initialize();
 }
@@ -289,154 +675,1053 @@ SubProcess_Thread::~SubProcess_Thread()
    clear();
 }
 
-/* loadAndStart: load program and start thread */
-void SubProcess_Thread::loadAndStart(MMDAgent *mmdagent, const char *args)
+/* loadAndStart: load program registering it to table, and start thread, or register to reactor if given */
+void SubProcess_Thread::loadAndStart(MMDAgent *mmdagent, SubProcess_Table *table, const char *args, SubProcess_Reactor *reactor, SubProcess_Pool *pool, SubProcess_Stats *stats, SubProcess_Recorder *recorder, bool standby)
 {
-   int len, idx = 0;
+   int idx = 0, numenvs = 0;
    char *buff;
+   char shmenv[MMDAGENT_MAXBUFLEN];
+   const char *envs[3];
+   int fds[3];
+   const SubProcess_Limits *limits;
 
    clear();
 
-   if(mmdagent == NULL)
+   if(mmdagent == NULL || table == NULL)
       return;
 
    buff = (char *) malloc(sizeof(char) * (MMDAgent_strlen(args) + 1));
 
-   /* get alias */
-   if(getArgFromString(args, &idx, buff) == 0) {
+   /* get alias and options */
+   if(getArgFromString(args, &idx, buff) == 0 || m_option.parse(buff) == false) {
       free(buff);
+      m_option.clear();
       return;
    }
-   m_name = MMDAgent_strdup(buff);
+   m_name = MMDAgent_strdup(m_option.getName());
 
    m_mmdagent = mmdagent;
+   m_table = table;
+   m_recorder = recorder;
+   m_calls.setup();
+   m_standby = standby;
+
+   free(buff);
 
    /* get command */
-   len = getArgFromString(args, &idx, buff);
-   if(len == 0) {
-      free(buff);
+   m_commandLine = getCommandLine(&args[idx]);
+   if(m_commandLine == NULL) {
       clear();
       return;
    }
 
-   /* add an argument to command line if given */
-   if(args[idx] != '\0') {
-      buff[len] = ' ';
-      strcpy(&buff[len + 1], &args[idx]);
+   /* shared-memory rings, socket is kept for lifetime and for messages the subprocess prints */
+   if(m_option.getTransport() == SUBPROCESSOPTION_TRANSPORT_SHM && openShm() == true) {
+      fds[0] = m_shmFd;
+      fds[1] = m_shmOutFd;
+      fds[2] = m_shmInFd;
+      sprintf(shmenv, "%s=%d,%d,%d", SUBPROCSHM_ENV, SUBPROCESSTHREAD_FIRSTFD, SUBPROCESSTHREAD_FIRSTFD + 1, SUBPROCESSTHREAD_FIRSTFD + 2);
+      envs[numenvs++] = shmenv;
    }
-   m_commandLine = MMDAgent_strdup(buff);
-
-   free(buff);
-
-   /* start subprocess */
-   m_stream = spopen(m_commandLine);
+   if(m_option.getProtocol() == SUBPROCESSOPTION_PROTOCOL_FRAME)
+      envs[numenvs++] = SUBPROCESSTHREAD_FRAMEPROTOCOL;
+   envs[numenvs] = NULL;
+
+   /* start subprocess in its cgroup if given, or take an idle one launched in advance without limits */
+   limits = m_option.getLimits();
+   m_cgroup = spcgroup(m_name, limits);
+   if(numenvs > 0 || limits != NULL) {
+      m_handle = m_table->open(m_commandLine, SUBPROCESSTABLE_STATE_RUNNING, envs, fds, (m_shm != NULL) ? 3 : 0, limits, m_cgroup);
+   } else {
+      if(pool != NULL)
+         m_handle = pool->claim(m_commandLine);
+      if(m_handle < 0)
+         m_handle = m_table->open(m_commandLine);
+   }
+   m_stream = m_table->getStream(m_handle);
    if(m_stream == NULL){
       clear();
       return;
    }
 
-   /* start thread */
-   m_thread = glfwCreateThread(mainThread, this);
-   if(m_thread < 0) {
-      clear();
-      return;
+   if(stats != NULL)
+      m_stats = stats->attach(m_name, m_table->getPid(m_handle));
+   if(m_stats != NULL && m_standby == true)
+      __atomic_store_n(&m_stats->standby, 1, __ATOMIC_RELAXED);
+
+   /* buffer of received data */
+   m_insize = SUBPROCESSTHREAD_READSIZE;
+   m_inbuf = (char *) malloc(sizeof(char) * (m_insize + 1));
+
+   if(reactor != NULL) {
+      /* let reactor watch socket */
+      m_reactor = reactor;
+      m_running = true;
+      if(m_reactor->add(this, fileno(m_stream)) == false || (m_shm != NULL && m_reactor->add(this, m_shmInFd) == false)) {
+         clear();
+         return;
+      }
+   } else {
+      /* start thread */
+      m_thread = glfwCreateThread(mainThread, this);
+      if(m_thread < 0) {
+         clear();
+         return;
+      }
    }
 
-   m_mmdagent->sendMessage(SUBPROCESSTHREAD_EVENTSTART, "%s", m_name);
+   /* standby is reported by manager */
+   if(m_standby == false)
+      m_mmdagent->sendMessage(SUBPROCESSTHREAD_EVENTSTART, "%s", m_name);
 }
 
-/* SubProcess_Thread::stopAndRelease: stop thread and release */
-void SubProcess_Thread::stopAndRelease()
+/* SubProcess_Thread::getCommandLine: get command line from "command|argument" */
+char *SubProcess_Thread::getCommandLine(const char *str)
+{
+   int len, idx = 0;
+   char *buff, *commandLine;
+
+   buff = (char *) malloc(sizeof(char) * (MMDAgent_strlen(str) + 2));
+
+   /* get command */
+   len = getArgFromString(str, &idx, buff);
+   if(len == 0) {
+      free(buff);
+      return NULL;
+   }
+
+   /* add an argument to command line if given */
+   if(str[idx] != '\0') {
+      buff[len] = ' ';
+      strcpy(&buff[len + 1], &str[idx]);
+   }
+   commandLine = MMDAgent_strdup(buff);
+
+   free(buff);
+   return commandLine;
+}
+
+/* SubProcess_Thread::stopAndRelease: stop thread and release after subprocess exited, reporting exit status and msec of teardown */
+void SubProcess_Thread::stopAndRelease(int status, double msec)
 {
    MMDAgent *mmdagent = m_mmdagent;
    char *name = MMDAgent_strdup(m_name);
 
    clear();
-   mmdagent->sendMessage(SUBPROCESSTHREAD_EVENTSTOP, "%s", name);
+   if(mmdagent != NULL)
+      mmdagent->sendMessage(SUBPROCESSTHREAD_EVENTSTOP, "%s|%d|%.1f", name, status, msec);
 
    free(name);
 }
 
+/* SubProcess_Thread::exited: report exit of subprocess which hung up by itself, with msec from hang-up */
+void SubProcess_Thread::exited(int status, double msec)
+{
+   m_mmdagent->sendMessage(SUBPROCESSTHREAD_EVENTSTOP, "%s|%d|%.1f", m_name, status, msec);
+}
+
+/* SubProcess_Thread::stopping: mark that subprocess is being stopped on purpose, so that its hang-up is neither handled nor reported */
+void SubProcess_Thread::stopping()
+{
+   __atomic_store_n(&m_hangupFunc, (SubProcess_HangupFunc) NULL, __ATOMIC_RELEASE);
+   __atomic_store_n(&m_stopping, true, __ATOMIC_RELEASE);
+}
+
 /* SubProcess_Thread::run: main loop */
 void SubProcess_Thread::run()
 {
-   int pos, idx;
-   char c;
-   char buff[MMDAGENT_MAXBUFLEN];
-   char type[MMDAGENT_MAXBUFLEN];
-   pollfd pfd;
-
-   pfd.fd = fileno(m_stream);
-   pfd.events = POLLIN;
+   pollfd pfd[2];
+   int n = 1;
+
+   pfd[0].fd = fileno(m_stream);
+   pfd[0].events = POLLIN;
+   pfd[1].revents = 0;
+   if(m_shm != NULL) {
+      /* also wait for inbound ring */
+      pfd[1].fd = m_shmInFd;
+      pfd[1].events = POLLIN;
+      n = 2;
+   }
 
    /* main loop */
-   while(poll(&pfd, 1, SUBPROCESSTHREAD_TIMEOUT) >= 0) {
-      if(pfd.revents & (POLLHUP | POLLERR | POLLNVAL)) {
-         if(pfd.revents & (POLLHUP | POLLERR))
-            /* subprocess stopped */
-            m_mmdagent->sendMessage(SUBPROCESSTHREAD_EVENTSTOP, "%s", m_name);
+   while(poll(pfd, n, SUBPROCESSTHREAD_TIMEOUT) >= 0) {
+      if(pfd[0].revents & POLLNVAL)
+         break;
+      if(((pfd[0].revents | pfd[1].revents) & (POLLIN | POLLHUP | POLLERR)) == 0)
+         continue;
+
+      /* receive all available messages, until end of stream after subprocess stopped */
+      if(receive() == true)
+         continue;
+      stopped();
+      break;
+   }
+}
+
+/* SubProcess_Thread::stopped: handle end of stream, sending stop event unless handler takes it over */
+void SubProcess_Thread::stopped()
+{
+   SubProcess_HangupFunc func = __atomic_load_n(&m_hangupFunc, __ATOMIC_ACQUIRE);
+
+   if(__atomic_load_n(&m_stopping, __ATOMIC_ACQUIRE) == true)
+      return;
+   if(func != NULL && func(m_hangupParam) == true)
+      return;
+
+   /* standby without handler stops silently, others are not waited for here, as reader must not sleep */
+   if(isStandby() == false)
+      exited(SUBPROCESSTHREAD_STATUSUNKNOWN, -1.0);
+}
+
+/* SubProcess_Thread::forward: forward a received line without newline to main program, parsing it in place */
+bool SubProcess_Thread::forward(char *line, int len)
+{
+   char *type, *args, *end;
+
+   /* discard trailing newlines */
+   while(len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+      len--;
+   line[len] = '\0';
+
+   /* skip white spaces */
+   for(type = line; *type == ' ' || *type == '\t' || *type == '\r'; type++);
+
+   /* type is terminated at separator, trimming trailing white spaces */
+   end = (char *) memchr(type, SUBPROCESSTHREAD_SEPARATOR, line + len - type);
+   if(end != NULL) {
+      args = end + 1;
+   } else {
+      end = line + len;
+      args = end;
+   }
+   while(end > type && (end[-1] == ' ' || end[-1] == '\t'))
+      end--;
+   if(end == type)
+      return false;
+   *end = '\0';
+
+   if(m_recorder != NULL)
+      m_recorder->record(SUBPROCRECORD_READ, m_name, type, args, m_readTime);
+
+   if(isStandby() == true) {
+      if(m_stats != NULL)
+         subprocstats_add(&m_stats->suppressed, 1);
+   } else if(MMDAgent_strequal(type, SUBPROCESSTHREAD_REPLY)) {
+      reply(args);
+   } else {
+      /* main program enqueues it back, which is recorded as its echo */
+      if(m_recorder != NULL)
+         m_recorder->expect(m_name, type, args);
+      m_mmdagent->sendMessage(type, "%s", args);
+   }
+   return true;
+}
 
+/* SubProcess_Thread::reply: match "id|result" with request and report result */
+void SubProcess_Thread::reply(char *args)
+{
+   unsigned long id;
+   double start;
+   char *result, reqtype[MMDAGENT_MAXBUFLEN];
+
+   id = strtoul(args, &result, 10);
+   if(*result == SUBPROCESSTHREAD_SEPARATOR)
+      result++;
+
+   /* reply after timeout has already been reported */
+   if(m_calls.take(id, reqtype, &start) == false)
+      return;
+
+   m_mmdagent->sendMessage(SUBPROCESSTHREAD_EVENTRESULT, "%s|%lu|%s|%s", m_name, id, reqtype, result);
+   if(m_stats != NULL)
+      subprocstats_record(&m_stats->call, (glfwGetTime() - start) * 1000000.0);
+}
+
+/* SubProcess_Thread::countIn: count messages forwarded after a read */
+void SubProcess_Thread::countIn(int msgs, int bytes)
+{
+   if(m_stats == NULL || msgs == 0)
+      return;
+
+   subprocstats_add(&m_stats->msgsIn, msgs);
+   subprocstats_add(&m_stats->bytesIn, bytes);
+   subprocstats_record(&m_stats->forward, (glfwGetTime() - m_readTime) * 1000000.0);
+}
+
+/* SubProcess_Thread::getFrameInt: read big-endian integer of frame */
+unsigned int SubProcess_Thread::getFrameInt(const char *p)
+{
+   uint32_t value;
+
+   memcpy(&value, p, sizeof(value));
+   return ntohl(value);
+}
+
+/* SubProcess_Thread::putFrameHeader: write header of frame */
+void SubProcess_Thread::putFrameHeader(char *p, int typelen, int argslen)
+{
+   uint32_t value;
+
+   value = htonl(4 + typelen + argslen);
+   memcpy(p, &value, sizeof(value));
+   value = htonl(typelen);
+   memcpy(p + 4, &value, sizeof(value));
+}
+
+/* SubProcess_Thread::parseLines: forward complete lines in m_inbuf, return end of them */
+char *SubProcess_Thread::parseLines()
+{
+   int len, msgs = 0, bytes = 0;
+   char c, *p, *q, *end = m_inbuf + m_inlen;
+
+   for(p = m_inbuf; p < end; p += len) {
+      q = (char *) memchr(p, '\n', end - p);
+      if(q != NULL && q - p < MMDAGENT_MAXBUFLEN - 1) {
+         /* complete line */
+         len = (int) (q - p) + 1;
+         if(forward(p, len - 1) == true)
+            msgs++;
+      } else if(((q != NULL) ? q : end) - p >= MMDAGENT_MAXBUFLEN - 1) {
+         /* split line longer than buffer of main program as fgets does */
+         len = MMDAGENT_MAXBUFLEN - 1;
+         c = p[len];
+         if(forward(p, len) == true)
+            msgs++;
+         p[len] = c;
+      } else {
+         /* partial line */
          break;
-      } else if(pfd.revents & POLLIN) {
-         /* receive message from subprocess */
-         if(fgets(buff, MMDAGENT_MAXBUFLEN, m_stream) != NULL) {
-            /* discard trailing newlines */
-            for(pos = MMDAgent_strlen(buff) - 1; pos > 1; --pos) {
-               c = buff[pos];
-               if(c != '\n' && c != '\r') {
-                  /* forward the message to main program */
-				idx = 0;
-				if(getArgFromString(buff, &idx, type) > 0)
-                    m_mmdagent->sendMessage(type, "%s", &buff[idx]); 
-                break;
-               }
-            }
+      }
+      bytes += len;
+   }
+
+   countIn(msgs, bytes);
+
+   return p;
+}
+
+/* SubProcess_Thread::oversized: report frame whose args do not fit in message of main program, return true if so */
+bool SubProcess_Thread::oversized(const char *type, unsigned int len)
+{
+   if(len < MMDAGENT_MAXBUFLEN)
+      return false;
+
+   /* sendMessage of main program would truncate it */
+   m_mmdagent->sendMessage(SUBPROCESSTHREAD_EVENTOVERSIZE, "%s|%.64s|%u", m_name, type, len);
+   return true;
+}
+
+/* SubProcess_Thread::forwardFrame: forward a frame followed by a byte which may be overwritten, return false if broken */
+bool SubProcess_Thread::forwardFrame(char *frame)
+{
+   unsigned int total, typelen;
+   char c, type[MMDAGENT_MAXBUFLEN];
+
+   total = getFrameInt(frame);
+   typelen = getFrameInt(frame + 4);
+   if(total < 4 || typelen > total - 4 || typelen >= MMDAGENT_MAXBUFLEN)
+      return false;
+
+   memcpy(type, frame + SUBPROCESSTHREAD_FRAMEHEADER, typelen);
+   type[typelen] = '\0';
+
+   /* terminate args temporarily */
+   c = frame[4 + total];
+   frame[4 + total] = '\0';
+   if(typelen > 0) {
+      if(m_recorder != NULL)
+         m_recorder->record(SUBPROCRECORD_READ, m_name, type, frame + SUBPROCESSTHREAD_FRAMEHEADER + typelen, m_readTime);
+      if(isStandby() == true) {
+         if(m_stats != NULL)
+            subprocstats_add(&m_stats->suppressed, 1);
+      } else if(oversized(type, total - 4 - typelen) == false) {
+         if(MMDAgent_strequal(type, SUBPROCESSTHREAD_REPLY))
+            reply(frame + SUBPROCESSTHREAD_FRAMEHEADER + typelen);
+         else {
+            if(m_recorder != NULL)
+               m_recorder->expect(m_name, type, frame + SUBPROCESSTHREAD_FRAMEHEADER + typelen);
+            m_mmdagent->sendMessage(type, "%s", frame + SUBPROCESSTHREAD_FRAMEHEADER + typelen);
          }
       }
+      countIn(1, 4 + total);
+   }
+   frame[4 + total] = c;
+
+   return true;
+}
+
+/* SubProcess_Thread::parseFrames: forward complete frames in m_inbuf, return end of them or NULL on error */
+char *SubProcess_Thread::parseFrames()
+{
+   unsigned int total;
+   char *p, *end = m_inbuf + m_inlen;
+
+   for(p = m_inbuf; end - p >= SUBPROCESSTHREAD_FRAMEHEADER; p += 4 + total) {
+      total = getFrameInt(p);
+      if(total > (unsigned int) m_option.getMaxFrame())
+         return NULL;
+      if((unsigned int) (end - p) < 4 + total)
+         break;
+
+      /* m_inbuf has room for terminator */
+      if(forwardFrame(p) == false)
+         return NULL;
+   }
+
+   return p;
+}
+
+/* SubProcess_Thread::openShm: create shared-memory rings and eventfds */
+bool SubProcess_Thread::openShm()
+{
+   int size = m_option.getShmSize();
+
+   m_shmLength = subprocshm_length(size);
+   m_shmFd = memfd_create("subproc", MFD_CLOEXEC);
+   m_shmInFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+   m_shmOutFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+   if(m_shmFd < 0 || m_shmInFd < 0 || m_shmOutFd < 0 || ftruncate(m_shmFd, m_shmLength) < 0) {
+      closeShm();
+      return false;
+   }
+
+   m_shm = mmap(NULL, m_shmLength, PROT_READ | PROT_WRITE, MAP_SHARED, m_shmFd, 0);
+   if(m_shm == MAP_FAILED) {
+      m_shm = NULL;
+      closeShm();
+      return false;
+   }
+   subprocshm_init(m_shm, size);
+
+   /* size and rings are kept from option, never read back from segment which subprocess can write */
+   m_shmSize = (uint32_t) size;
+   m_shmRingOut = subprocshm_ringat(m_shm, m_shmSize, 0);
+   m_shmRingIn = subprocshm_ringat(m_shm, m_shmSize, 1);
+
+   /* plugin sleeps until subprocess writes */
+   m_shmRingIn->waiting = 1;
+
+   m_shmBuf = (char *) malloc(sizeof(char) * (size + 1));
+
+   return true;
+}
+
+/* SubProcess_Thread::closeShm: free shared-memory rings and eventfds */
+void SubProcess_Thread::closeShm()
+{
+   if(m_shm != NULL)
+      munmap(m_shm, m_shmLength);
+   if(m_shmFd >= 0)
+      close(m_shmFd);
+   if(m_shmInFd >= 0)
+      close(m_shmInFd);
+   if(m_shmOutFd >= 0)
+      close(m_shmOutFd);
+   free(m_shmBuf);
+
+   m_shm = NULL;
+   m_shmLength = 0;
+   m_shmSize = 0;
+   m_shmRingOut = NULL;
+   m_shmRingIn = NULL;
+   m_shmFd = -1;
+   m_shmInFd = -1;
+   m_shmOutFd = -1;
+   m_shmBuf = NULL;
+}
+
+/* SubProcess_Thread::receiveShm: forward frames in inbound ring, return false on error */
+bool SubProcess_Thread::receiveShm()
+{
+   int ret;
+   unsigned int len;
+   eventfd_t value;
+   SubProcShm_Ring *ring = m_shmRingIn;
+
+   eventfd_read(m_shmInFd, &value);
+   m_readTime = glfwGetTime();
+
+   /* drain ring until it stays empty after announcing sleep */
+   do {
+      while((ret = subprocshm_readat(ring, m_shmSize, m_shmBuf, m_shmSize, &len)) > 0)
+         if(forwardFrame(m_shmBuf) == false)
+            return false;
+      if(ret < 0)
+         return false;
+   } while(subprocshm_prepare(ring) == 0);
+
+   return true;
+}
+
+/* SubProcess_Thread::receive: read and forward available messages, return false on end of stream or error */
+bool SubProcess_Thread::receive()
+{
+   unsigned int total;
+   ssize_t len;
+   char *p;
+
+   /* frames in shared memory, then messages in socket */
+   if(m_shm != NULL && receiveShm() == false)
+      return false;
+
+   /* enlarge buffer for a frame longer than it */
+   if(m_option.getProtocol() == SUBPROCESSOPTION_PROTOCOL_FRAME && m_inlen >= 4) {
+      total = getFrameInt(m_inbuf);
+      if(total > (unsigned int) m_option.getMaxFrame())
+         return false;
+      if(4 + total > (unsigned int) m_insize) {
+         m_insize = 4 + total;
+         m_inbuf = (char *) realloc(m_inbuf, sizeof(char) * (m_insize + 1));
+      }
+   }
+
+   len = recv(fileno(m_stream), &m_inbuf[m_inlen], m_insize - m_inlen, MSG_DONTWAIT);
+   if(len < 0)
+      return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? true : false;
+   if(len == 0) {
+      /* forward last line without newline */
+      if(m_inlen > 0 && m_option.getProtocol() == SUBPROCESSOPTION_PROTOCOL_LINE) {
+         if(forward(m_inbuf, m_inlen) == true)
+            countIn(1, m_inlen);
+         m_inlen = 0;
+      }
+      return false;
    }
+   m_inlen += (int) len;
+   m_readTime = glfwGetTime();
+
+   if(m_option.getProtocol() == SUBPROCESSOPTION_PROTOCOL_FRAME)
+      p = parseFrames();
+   else
+      p = parseLines();
+   if(p == NULL)
+      return false;
+
+   /* keep partial message */
+   m_inlen -= (int) (p - m_inbuf);
+   memmove(m_inbuf, p, m_inlen);
+
+   return true;
+}
+
+/* SubProcess_Thread::hangup: handle end of stream (epoll mode) */
+void SubProcess_Thread::hangup()
+{
+   m_running = false;
+   stopped();
 }
 
 /* SubProcess_Thread::isRunning: check running */
 bool SubProcess_Thread::isRunning()
 {
-   if (m_stream == NULL || m_thread < 0
-       || glfwWaitThread(m_thread, GLFW_NOWAIT) == GL_TRUE)
+   if (m_stream == NULL)
+      return false;
+   else if (m_reactor != NULL)
+      return m_running;
+   else if (m_thread < 0 || glfwWaitThread(m_thread, GLFW_NOWAIT) == GL_TRUE)
       return false;
    else
       return true;
 }
 
-/* SubProcess_Thread::checkName: check thread name */
-bool SubProcess_Thread::checkName(const char *args)
+/* SubProcess_Thread::getAlias: get alias without options from "alias,options|..." into buff of MMDAGENT_MAXBUFLEN */
+void SubProcess_Thread::getAlias(const char *args, char *buff)
+{
+   int idx = 0;
+
+   if(MMDAgent_strlen(args) >= MMDAGENT_MAXBUFLEN) {
+      buff[0] = '\0';
+      return;
+   }
+
+   getArgFromString(args, &idx, buff);
+
+   /* ignore options */
+   for(idx = 0; buff[idx] != SUBPROCESSOPTION_SEPARATOR && buff[idx] != '\0'; idx++);
+   buff[idx] = '\0';
+}
+
+/* SubProcess_Thread::subscribe: set message types to be sent */
+void SubProcess_Thread::subscribe(const char *args)
 {
    int idx = 0;
    char *name = (char *) malloc(sizeof(char) * (MMDAgent_strlen(args) + 1));
-   bool retval;
 
+   /* skip alias */
    getArgFromString(args, &idx, name);
-   retval = MMDAgent_strequal(m_name, name);
-
    free(name);
-   return retval;
+
+   /* rest of arguments is list of patterns, empty list restores broadcast */
+   m_filter.clear();
+   m_filter.addList(&args[idx], 0);
+}
+
+/* SubProcess_Thread::coalesce: set message types of which only latest pending value is sent */
+void SubProcess_Thread::coalesce(const char *args)
+{
+   int idx = 0;
+   char *buff = (char *) malloc(sizeof(char) * (MMDAgent_strlen(args) + 1));
+
+   /* skip alias */
+   getArgFromString(args, &idx, buff);
+
+   /* "patterns|arg" keys messages by first argument too, empty list clears rules */
+   getArgFromString(args, &idx, buff);
+   if(buff[0] == '\0')
+      m_coalesce.clear();
+   else if(MMDAgent_strequal(&args[idx], "arg"))
+      m_coalesce.addList(buff, SUBPROCESSTHREAD_COALESCEARG);
+   else
+      m_coalesce.addList(buff, SUBPROCESSTHREAD_COALESCETYPE);
+
+   free(buff);
+}
+
+/* SubProcess_Thread::accepts: check if message type is to be sent */
+bool SubProcess_Thread::accepts(const char *type)
+{
+   if(m_filter.isEmpty() == true)
+      return true;
+
+   return (m_filter.match(type) >= 0) ? true : false;
 }
 
-/* SubProcess_Thread::puts: write a string and a trailing newline to subprocess */
-int SubProcess_Thread::puts(const char *str)
+/* SubProcess_Thread::hasRoom: check if outbound buffer has room for a message */
+bool SubProcess_Thread::hasRoom(int len)
 {
+   if(m_outbuf.getBytes() + len > m_option.getMaxBytes() || m_outbuf.getCount() >= m_option.getMaxMessages())
+      return false;
+   else
+      return true;
+}
+
+/* SubProcess_Thread::overflow: handle message which does not fit in outbound buffer */
+bool SubProcess_Thread::overflow(int len)
+{
+   unsigned long dropped = m_dropped;
+   double deadline;
+   bool discard;
    pollfd pfd;
 
+   if(hasRoom(len) == true)
+      return false;
+
+   switch(m_option.getPolicy()) {
+   case SUBPROCESSOPTION_POLICY_DROPOLDEST:
+      /* make room by discarding oldest messages */
+      while(hasRoom(len) == false && m_outbuf.dropOldest() == true)
+         m_dropped++;
+      break;
+   case SUBPROCESSOPTION_POLICY_BLOCK:
+      /* wait for subprocess to read until deadline */
+      deadline = glfwGetTime() + m_option.getDeadline() / 1000.0;
+      if(m_shm != NULL) {
+         /* ring has no readiness to wait for */
+         while(flushShm() == 0 && hasRoom(len) == false && glfwGetTime() < deadline)
+            glfwSleep(SUBPROCESSTHREAD_SHMRETRY);
+         break;
+      }
+      pfd.fd = fileno(m_stream);
+      pfd.events = POLLOUT;
+      while(hasRoom(len) == false && glfwGetTime() < deadline) {
+         if(poll(&pfd, 1, (int) ((deadline - glfwGetTime()) * 1000.0) + 1) < 1)
+            break;
+         if(m_outbuf.flush(pfd.fd) < 0)
+            break;
+      }
+      break;
+   case SUBPROCESSOPTION_POLICY_DISCONNECT:
+      /* stop slow subprocess, reader thread will report it */
+      shutdown(fileno(m_stream), SHUT_RDWR);
+      m_table->signal(m_handle, SIGHUP);
+      m_outbuf.clear();
+      m_flushTime = 0.0;
+      break;
+   }
+
+   /* discard new message if still no room */
+   discard = (hasRoom(len) == false || m_option.getPolicy() == SUBPROCESSOPTION_POLICY_DISCONNECT) ? true : false;
+   if(discard == true)
+      m_dropped++;
+
+   /* report once until buffer is drained */
+   if(m_dropped != dropped && m_overflow == false) {
+      m_overflow = true;
+      if(isStandby() == false)
+         m_mmdagent->sendMessage(SUBPROCESSTHREAD_EVENTOVERFLOW, "%s|%lu", m_name, m_dropped);
+   }
+
+   return discard;
+}
+
+/* SubProcess_Thread::append: keep line or frame of message in outbound buffer */
+void SubProcess_Thread::append(SubProcess_Message *msg, const char *data, int len, int written, int keylen)
+{
+   /* partially written line must be completed at once, others wait for flush window */
+   if(m_outbuf.isEmpty() == true)
+      m_flushTime = glfwGetTime() + ((written > 0) ? 0.0 : m_option.getFlushWindow() / 1000.0);
+
+   m_outbuf.append(msg, data, len, written, keylen);
+}
+
+/* SubProcess_Thread::getCoalesceKey: get bytes of line of message as key if its type is to be coalesced, 0 if not */
+int SubProcess_Thread::getCoalesceKey(SubProcess_Message *msg)
+{
+   int i, rule;
+
+   if(msg->typelen == 0)
+      return 0;
+
+   rule = m_coalesce.match(msg->type);
+   if(rule < 0)
+      return 0;
+   if(rule == SUBPROCESSTHREAD_COALESCETYPE)
+      return msg->typelen;
+
+   /* type, separator and first argument */
+   for(i = msg->typelen + 1; i < msg->len && msg->line[i] != SUBPROCESSTHREAD_SEPARATOR && msg->line[i] != '\n'; i++);
+
+   return (i < msg->len) ? i : msg->typelen;
+}
+
+/* SubProcess_Thread::keep: keep a message in outbound buffer, replacing pending one of the same key */
+void SubProcess_Thread::keep(SubProcess_Message *msg)
+{
+   int keylen = 0;
+   const char *data = (isFramed() == true) ? msg->frame : msg->line;
+   int len = (isFramed() == true) ? msg->flen : msg->len;
+
+   if(m_coalesce.isEmpty() == false)
+      keylen = getCoalesceKey(msg);
+
+   if(keylen > 0 && m_outbuf.replace(msg, data, len, keylen) == true) {
+      m_coalesced++;
+      return;
+   }
+   if(overflow(len) == false)
+      append(msg, data, len, 0, keylen);
+}
+
+/* SubProcess_Thread::drained: reset state after outbound buffer is drained */
+void SubProcess_Thread::drained()
+{
+   m_overflow = false;
+   m_flushTime = 0.0;
+
+   /* report once per backlog */
+   if(m_coalesced != m_reported) {
+      m_reported = m_coalesced;
+      if(isStandby() == false)
+         m_mmdagent->sendMessage(SUBPROCESSTHREAD_EVENTCOALESCE, "%s|%lu", m_name, m_coalesced);
+   }
+}
+
+/* SubProcess_Thread::setHangup: set handler called by reader when subprocess hangs up, until it is stopped */
+void SubProcess_Thread::setHangup(SubProcess_HangupFunc func, void *param)
+{
+   m_hangupParam = param;
+   __atomic_store_n(&m_hangupFunc, func, __ATOMIC_RELEASE);
+}
+
+/* SubProcess_Thread::isStandby: check if output is suppressed as hot-standby replica */
+bool SubProcess_Thread::isStandby()
+{
+   return __atomic_load_n(&m_standby, __ATOMIC_ACQUIRE);
+}
+
+/* SubProcess_Thread::getStandbys: get number of hot-standby replicas to be kept */
+int SubProcess_Thread::getStandbys()
+{
+   return m_option.getStandbys();
+}
+
+/* SubProcess_Thread::promote: forward output from now on, taking over requests in flight of failed primary */
+void SubProcess_Thread::promote(SubProcess_Thread *primary)
+{
+   /* replies to requests which standby also received are matched here */
+   if(primary != NULL)
+      primary->m_calls.moveTo(&m_calls);
+
+   if(m_stats != NULL)
+      __atomic_store_n(&m_stats->standby, 0, __ATOMIC_RELAXED);
+   __atomic_store_n(&m_standby, false, __ATOMIC_RELEASE);
+}
+
+/* SubProcess_Thread::isFramed: check if messages are written in frames */
+bool SubProcess_Thread::isFramed()
+{
+   return (m_shm != NULL || m_option.getProtocol() == SUBPROCESSOPTION_PROTOCOL_FRAME) ? true : false;
+}
+
+/* SubProcess_Thread::call: register request to be written as SUBPROC_REQUEST, return its correlation ID or 0 if not running */
+unsigned long SubProcess_Thread::call(const char *reqtype, double timeout)
+{
+   unsigned long id;
+
+   if(isRunning() == false)
+      return 0;
+
+   /* timeout of call, then that of subprocess, then default */
+   if(timeout <= 0.0)
+      timeout = m_option.getCallTimeout();
+   id = m_calls.add(reqtype, timeout);
+   if(id != 0 && m_stats != NULL)
+      subprocstats_add(&m_stats->calls, 1);
+
+   return id;
+}
+
+/* SubProcess_Thread::expireCalls: report requests past deadline at now (negative means all) as timed out */
+void SubProcess_Thread::expireCalls(double now)
+{
+   unsigned long id;
+   char reqtype[MMDAGENT_MAXBUFLEN];
+
+   while(m_calls.expire(now, &id, reqtype) == true) {
+      m_mmdagent->sendMessage(SUBPROCESSTHREAD_EVENTTIMEOUT, "%s|%lu|%s", m_name, id, reqtype);
+      if(m_stats != NULL)
+         subprocstats_add(&m_stats->callTimeouts, 1);
+   }
+}
+
+/* SubProcess_Thread::getCallDeadline: get earliest deadline of requests, 0 if none */
+double SubProcess_Thread::getCallDeadline()
+{
+   return m_calls.getDeadline();
+}
+
+/* SubProcess_Thread::putv: write messages, in lines or frames, to subprocess */
+int SubProcess_Thread::putv(SubProcess_Message **msgs, int num)
+{
+   int i, n, done = 0;
+   bool framed = isFramed();
+   ssize_t len;
+   struct iovec iov[SUBPROCESSBUFFER_MAXIOV];
+   struct msghdr msg;
+   SubProcShm_Ring *ring;
+
+   if(m_stream == NULL)
+      return EOF;
+
+   if(m_stats != NULL) {
+      for(i = 0, n = 0; i < num; i++)
+         n += (framed == true) ? msgs[i]->flen : msgs[i]->len;
+      subprocstats_add(&m_stats->msgsOut, num);
+      subprocstats_add(&m_stats->bytesOut, n);
+   }
+
+   if(m_shm != NULL) {
+      /* copy frames to outbound ring, wake subprocess only if it sleeps */
+      if(m_outbuf.isEmpty() == true && m_option.getFlushWindow() <= 0.0) {
+         ring = m_shmRingOut;
+         for(; done < num; done++)
+            if(subprocshm_writeraw(ring, m_shmSize, msgs[done]->frame, (uint32_t) msgs[done]->flen) == 0)
+               break;
+         if(done > 0)
+            subprocshm_notify(ring, m_shmOutFd);
+      }
+   } else if(m_outbuf.isEmpty() == true && m_option.getFlushWindow() <= 0.0) {
+      /* write directly from shared messages when nothing is pending and no flush window is set */
+      while(done < num) {
+         n = (num - done < SUBPROCESSBUFFER_MAXIOV) ? num - done : SUBPROCESSBUFFER_MAXIOV;
+         for(i = 0; i < n; i++) {
+            iov[i].iov_base = (framed == true) ? msgs[done + i]->frame : msgs[done + i]->line;
+            iov[i].iov_len = (framed == true) ? msgs[done + i]->flen : msgs[done + i]->len;
+         }
+         memset(&msg, 0, sizeof(msg));
+         msg.msg_iov = iov;
+         msg.msg_iovlen = n;
+
+         len = sendmsg(fileno(m_stream), &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+         if(len < 0) {
+            if(errno == EINTR)
+               continue;
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+               break;
+            /* subprocess closed its end, reader will report it */
+            if(m_stats != NULL)
+               subprocstats_add(&m_stats->writeErrors, 1);
+            return EOF;
+         }
+
+         for(i = 0; i < n && len >= (ssize_t) iov[i].iov_len; i++)
+            len -= iov[i].iov_len;
+         done += i;
+         if(len > 0) {
+            /* keep rest of partially written message */
+            append(msgs[done], (const char *) iov[i].iov_base, (int) iov[i].iov_len, (int) len);
+            done++;
+            break;
+         }
+         if(i < n)
+            break;
+      }
+   }
+
+   /* keep the rest */
+   for(i = done; i < num; i++)
+      keep(msgs[i]);
+
+   /* write pending messages when due */
+   if(m_flushTime > 0.0 && (m_flushTime <= glfwGetTime() || m_outbuf.getBytes() >= SUBPROCESSTHREAD_FLUSHBYTES))
+      return flush();
+
+   publish();
+   return 0;
+}
+
+/* SubProcess_Thread::flush: write pending messages without blocking */
+int SubProcess_Thread::flush()
+{
    if(m_stream == NULL)
       return EOF;
 
-   pfd.fd = fileno(m_stream);
-   pfd.events = POLLOUT;
+   if(m_shm != NULL)
+      return flushShm();
 
-   /* check if output buffer is ready or full */
-   if(poll(&pfd, 1, 0) < 1)
+   if(m_outbuf.flush(fileno(m_stream)) < 0) {
+      /* subprocess closed its end, reader thread will report it */
+      m_outbuf.clear();
+      m_flushTime = 0.0;
+      if(m_stats != NULL)
+         subprocstats_add(&m_stats->writeErrors, 1);
+      publish();
       return EOF;
+   }
+
+   if(m_outbuf.isEmpty() == true)
+      drained();
+
+   publish();
+   return 0;
+}
+
+/* SubProcess_Thread::flushShm: move pending frames to outbound ring */
+int SubProcess_Thread::flushShm()
+{
+   int len;
+   bool written = false;
+   const char *data;
+   SubProcShm_Ring *ring = m_shmRingOut;
+
+   while(m_outbuf.front(&data, &len) == true) {
+      if((uint32_t) len > m_shmSize) {
+         /* frame never fits in ring */
+         m_outbuf.pop();
+         m_dropped++;
+         continue;
+      }
+      if(subprocshm_writeraw(ring, m_shmSize, data, (uint32_t) len) == 0)
+         break;
+      m_outbuf.pop();
+      written = true;
+   }
+   if(written == true)
+      subprocshm_notify(ring, m_shmOutFd);
+
+   if(m_outbuf.isEmpty() == true) {
+      drained();
+   } else {
+      /* retry after subprocess consumes */
+      m_flushTime = glfwGetTime() + SUBPROCESSTHREAD_SHMRETRY;
+   }
+
+   publish();
+   return 0;
+}
+
+/* SubProcess_Thread::publish: update gauges of statistics */
+void SubProcess_Thread::publish()
+{
+   if(m_stats == NULL)
+      return;
+
+   subprocstats_set(&m_stats->dropped, m_dropped);
+   subprocstats_set(&m_stats->coalesced, m_coalesced);
+   subprocstats_set(&m_stats->pendingBytes, m_outbuf.getBytes());
+   subprocstats_set(&m_stats->pendingMsgs, m_outbuf.getCount());
+}
+
+/* SubProcess_Thread::getFlushTime: get time when pending messages are to be written, 0 if none */
+double SubProcess_Thread::getFlushTime()
+{
+   return m_flushTime;
+}
 
-   fputs(str, m_stream);
-   fputc('\n', m_stream);
+/* SubProcess_Thread::getFd: get file descriptor of socketpair */
+int SubProcess_Thread::getFd()
+{
+   return (m_stream != NULL) ? fileno(m_stream) : -1;
+}
+
+/* SubProcess_Thread::getHandle: get handle of subprocess in process table, -1 if not running */
+int SubProcess_Thread::getHandle()
+{
+   return (m_stream != NULL) ? m_handle : -1;
+}
 
-   return fflush(m_stream);
+/* SubProcess_Thread::hasPending: check if messages wait in outbound buffer */
+bool SubProcess_Thread::hasPending()
+{
+   return m_outbuf.isEmpty() == false;
+}
+
+/* SubProcess_Thread::getDrain: get msec to write pending messages when stopped */
+int SubProcess_Thread::getDrain()
+{
+   return m_option.getDrain();
+}
+
+/* SubProcess_Thread::getHupWait: get msec after SIGHUP before SIGTERM */
+int SubProcess_Thread::getHupWait()
+{
+   return m_option.getHupWait();
+}
+
+/* SubProcess_Thread::getTermWait: get msec after SIGTERM before SIGKILL */
+int SubProcess_Thread::getTermWait()
+{
+   return m_option.getTermWait();
+}
+
+/* SubProcess_Thread::getOutstanding: get bytes written or pending but not yet read by subprocess, with dispatcher */
+unsigned long SubProcess_Thread::getOutstanding()
+{
+   int queued = 0;
+   unsigned long bytes = m_outbuf.getBytes();
+   SubProcShm_Ring *ring;
+
+   if(m_shm != NULL) {
+      ring = m_shmRingOut;
+      bytes += (uint32_t) (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+   } else if(m_stream != NULL && ioctl(fileno(m_stream), SIOCOUTQ, &queued) == 0 && queued > 0) {
+      /* bytes in socket not yet received by subprocess */
+      bytes += queued;
+   }
+
+   return bytes;
+}
+
+/* SubProcess_Thread::getDropped: get number of discarded messages */
+unsigned long SubProcess_Thread::getDropped()
+{
+   return m_dropped;
+}
+
+/* SubProcess_Thread::getCoalesced: get number of pending messages replaced by newer ones */
+unsigned long SubProcess_Thread::getCoalesced()
+{
+   return m_coalesced;
+}
+
+/* SubProcess_Thread::getName: get alias */
+const char *SubProcess_Thread::getName()
+{
+   return m_name;
+}
+
+/* SubProcess_Thread::getStats: get published statistics, NULL if not tracked */
+SubProcStats_Proc *SubProcess_Thread::getStats()
+{
+   return m_stats;
 }
@@ -35,10 +35,57 @@
 
 /* definitions */
 
-#define SUBPROCESSTHREAD_TIMEOUT    10000
-#define SUBPROCESSTHREAD_EVENTSTART "SUBPROC_EVENT_START"
-#define SUBPROCESSTHREAD_EVENTSTOP  "SUBPROC_EVENT_STOP"
-#define SUBPROCESSTHREAD_SEPARATOR  '|'
+#define SUBPROCESSTHREAD_TIMEOUT       10000
+#define SUBPROCESSTHREAD_EVENTSTART    "SUBPROC_EVENT_START"
+#define SUBPROCESSTHREAD_EVENTSTOP     "SUBPROC_EVENT_STOP" /* "SUBPROC_EVENT_STOP|alias|status|msec" after SUBPROC_STOP or hang-up, status is exit code or negative signal, msec is from stop request or hang-up until exit, status SUBPROCESSTHREAD_STATUSUNKNOWN and msec -1 if it did not exit */
+#define SUBPROCESSTHREAD_EVENTOVERFLOW "SUBPROC_EVENT_OVERFLOW"
+#define SUBPROCESSTHREAD_EVENTOVERSIZE "SUBPROC_EVENT_OVERSIZE" /* "SUBPROC_EVENT_OVERSIZE|alias|type|bytes" for message from subprocess dropped as its args do not fit in MMDAGENT_MAXBUFLEN of main program */
+#define SUBPROCESSTHREAD_EVENTCOALESCE "SUBPROC_EVENT_COALESCE"
+#define SUBPROCESSTHREAD_EVENTRESULT   "SUBPROC_EVENT_RESULT"
+#define SUBPROCESSTHREAD_EVENTTIMEOUT  "SUBPROC_EVENT_TIMEOUT"
+#define SUBPROCESSTHREAD_REQUEST       "SUBPROC_REQUEST" /* "SUBPROC_REQUEST|id|reqtype|args" written to subprocess */
+#define SUBPROCESSTHREAD_REPLY         "SUBPROC_REPLY"   /* "SUBPROC_REPLY|id|result" answered by subprocess */
+#define SUBPROCESSTHREAD_SEPARATOR     '|'
+#define SUBPROCESSTHREAD_FLUSHBYTES    65536 /* pending bytes to be written regardless of flush window */
+#define SUBPROCESSTHREAD_ENVSPAWN      "SUBPROC_SPAWN" /* "fork" selects fork and shell instead of posix_spawn */
+#define SUBPROCESSTHREAD_ENVCPUS       "SUBPROC_CPUS"  /* CPUs such as "0-1" where dispatcher and reader threads run */
+#define SUBPROCESSTHREAD_CGROUPROOT    "/sys/fs/cgroup" /* mount point of cgroup v2, base of relative cgroup option */
+#define SUBPROCESSTHREAD_CGROUPPERIOD  100000 /* usec of period of cpu.max */
+#define SUBPROCESSTHREAD_FRAMEPROTOCOL "SUBPROC_PROTOCOL=frame" /* environment of subprocess using frames */
+#define SUBPROCESSTHREAD_FRAMEHEADER   8
+#define SUBPROCESSTHREAD_READSIZE      65536 /* bytes read from socket at once */
+#define SUBPROCESSTHREAD_FIRSTFD       3     /* first descriptor inherited by subprocess besides stdin and stdout */
+#define SUBPROCESSTHREAD_SHMRETRY      0.001 /* sec to retry writing pending messages to full ring */
+#define SUBPROCESSTHREAD_STATUSUNKNOWN 256   /* status in stop event of subprocess still running after hang-up */
+
+#define SUBPROCESSTHREAD_COALESCETYPE  0 /* latest value is kept per type */
+#define SUBPROCESSTHREAD_COALESCEARG   1 /* latest value is kept per type and first argument */
+
+class SubProcess_Pool;
+class SubProcess_Table;
+class SubProcess_Recorder;
+struct _SubProcShm_Ring;
+
+/* SubProcess_HangupFunc: handler called by reader when subprocess hangs up, return true if it takes over stop event */
+typedef bool (*SubProcess_HangupFunc)(void *param);
+
+/* spopen: spawn subprocess with socketpair connected and its PID stored in pidp, adding "NAME=value" strings to environment and passing fds as 3, 4, ...,
+   limits and joining cgroup directory are applied in child before exec (subprocesses are registered through SubProcess_Table::open) */
+FILE *spopen(const char *command, pid_t *pidp, const char *const *envs = NULL, const int *fds = NULL, int numfds = 0, const SubProcess_Limits *limits = NULL, const char *cgroup = NULL);
+
+/* spclose: close socketpair and wait for subprocess of PID to stop */
+int spclose(FILE *stream, pid_t pid);
+
+/* sppin: pin calling thread to CPUs given by SUBPROC_CPUS, if any */
+void sppin();
+
+/* frame of proto=frame option, in both directions (integers are big-endian):
+   uint32 length of the rest of frame
+   uint32 length of type
+   type
+   args
+   frames up to maxframe are read, but those from subprocess with args of MMDAGENT_MAXBUFLEN bytes or more are reported by
+   SUBPROC_EVENT_OVERSIZE and dropped, as main program passes no longer message */
 
 /* SubProcess_Thread: thread for popen() */
 class SubProcess_Thread
@@ -47,11 +94,108 @@ private:
 
    MMDAgent *m_mmdagent;
 
-   GLFWthread m_thread;
+   GLFWthread m_thread;            /* reader thread in thread mode */
+   SubProcess_Reactor *m_reactor;  /* reactor watching socket in epoll mode */
+   bool m_running;                 /* socket is open in epoll mode */
 
    char *m_name;        /* name of thread */
    char *m_commandLine; /* command line string to invoke subprocess */
-   FILE *m_stream;      /* I/O stream (NULL means not running) */
+   char *m_cgroup;      /* cgroup-v2 directory made for subprocess, NULL if none */
+   SubProcess_Table *m_table; /* process table where subprocess is registered */
+   int m_handle;        /* handle of subprocess in m_table, -1 if none */
+   FILE *m_stream;      /* I/O stream of m_handle (NULL means not running) */
+
+   SubProcess_Filter m_filter; /* message types to be sent (empty means all) */
+   SubProcess_Filter m_coalesce; /* message types of which only latest pending value is sent */
+   SubProcess_Option m_option; /* options given with alias */
+   SubProcess_Buffer m_outbuf; /* messages waiting to be written */
+   SubProcess_Call m_calls;    /* requests waiting for reply */
+   double m_flushTime;         /* time when pending messages are to be written (0 means none) */
+
+   unsigned long m_dropped; /* number of discarded messages */
+   bool m_overflow;         /* overflow has been reported and buffer not drained yet */
+   unsigned long m_coalesced; /* number of pending messages replaced by newer ones */
+   unsigned long m_reported;  /* m_coalesced at last report */
+
+   char *m_inbuf; /* partial line or frame received */
+   int m_insize;  /* size of m_inbuf, excluding room for terminator */
+   int m_inlen;
+
+   void *m_shm;         /* segment of shared-memory rings in transport=shm (see SubProcess_Shm.h) */
+   size_t m_shmLength;
+   uint32_t m_shmSize;  /* bytes of data of each ring, kept here as subprocess can write segment */
+   struct _SubProcShm_Ring *m_shmRingOut; /* ring to subprocess, at offset of m_shmSize */
+   struct _SubProcShm_Ring *m_shmRingIn;  /* ring from subprocess, at offset of m_shmSize */
+   int m_shmFd;         /* memfd of segment */
+   int m_shmInFd;       /* eventfd signaled by subprocess */
+   int m_shmOutFd;      /* eventfd signaled to subprocess */
+   char *m_shmBuf;      /* frame read from ring */
+
+   SubProcStats_Proc *m_stats; /* published statistics, NULL if not tracked */
+   SubProcess_Recorder *m_recorder; /* recorder of messages read, NULL if none */
+   double m_readTime;          /* time when received messages were read */
+
+   bool m_standby;                     /* hot-standby replica, output suppressed until promoted */
+   SubProcess_HangupFunc m_hangupFunc; /* handler of hang-up, NULL sends stop event */
+   void *m_hangupParam;
+   bool m_stopping;                    /* being stopped on purpose, hang-up is not reported */
+
+   /* stopped: handle end of stream, sending stop event unless handler takes it over */
+   void stopped();
+
+   /* forward: forward a received line without newline to main program, parsing it in place */
+   bool forward(char *line, int len);
+
+   /* reply: match "id|result" with request and report result */
+   void reply(char *args);
+
+   /* countIn: count messages forwarded after a read */
+   void countIn(int msgs, int bytes);
+
+   /* parseLines: forward complete lines in m_inbuf, return end of them */
+   char *parseLines();
+
+   /* oversized: report frame whose args do not fit in message of main program, return true if so */
+   bool oversized(const char *type, unsigned int len);
+
+   /* forwardFrame: forward a frame followed by a byte which may be overwritten, return false if broken */
+   bool forwardFrame(char *frame);
+
+   /* parseFrames: forward complete frames in m_inbuf, return end of them or NULL on error */
+   char *parseFrames();
+
+   /* openShm: create shared-memory rings and eventfds */
+   bool openShm();
+
+   /* closeShm: free shared-memory rings and eventfds */
+   void closeShm();
+
+   /* receiveShm: forward frames in inbound ring, return false on error */
+   bool receiveShm();
+
+   /* flushShm: move pending frames to outbound ring */
+   int flushShm();
+
+   /* hasRoom: check if outbound buffer has room for a message */
+   bool hasRoom(int len);
+
+   /* overflow: handle message which does not fit in outbound buffer */
+   bool overflow(int len);
+
+   /* append: keep line or frame of message in outbound buffer */
+   void append(SubProcess_Message *msg, const char *data, int len, int written, int keylen = 0);
+
+   /* getCoalesceKey: get bytes of line of message as key if its type is to be coalesced, 0 if not */
+   int getCoalesceKey(SubProcess_Message *msg);
+
+   /* keep: keep a message in outbound buffer, replacing pending one of the same key */
+   void keep(SubProcess_Message *msg);
+
+   /* drained: reset state after outbound buffer is drained */
+   void drained();
+
+   /* publish: update gauges of statistics */
+   void publish();
 
    /* initialize: initialize thread */
    void initialize();
@@ -67,21 +211,114 @@ public:
    /* ~SubProcess_Thread: thread destructor */
    ~SubProcess_Thread();
 
-   /* loadAndStart: load program and start thread */
-   void loadAndStart(MMDAgent *mmdagent, const char *args);
+   /* loadAndStart: load program registering it to table, and start thread, or register to reactor if given, as hot-standby replica if standby is true */
+   void loadAndStart(MMDAgent *mmdagent, SubProcess_Table *table, const char *args, SubProcess_Reactor *reactor = NULL, SubProcess_Pool *pool = NULL, SubProcess_Stats *stats = NULL, SubProcess_Recorder *recorder = NULL, bool standby = false);
 
-   /* stopAndRelease: stop thread and release */
-   void stopAndRelease();
+   /* getCommandLine: get command line from "command|argument" */
+   static char *getCommandLine(const char *str);
+
+   /* getFrameInt: read big-endian integer of frame */
+   static unsigned int getFrameInt(const char *p);
+
+   /* putFrameHeader: write header of frame */
+   static void putFrameHeader(char *p, int typelen, int argslen);
+
+   /* stopAndRelease: stop thread and release after subprocess exited, reporting exit status and msec of teardown */
+   void stopAndRelease(int status, double msec);
+
+   /* exited: report exit of subprocess which hung up by itself, with msec from hang-up */
+   void exited(int status, double msec);
+
+   /* stopping: mark that subprocess is being stopped on purpose, so that its hang-up is neither handled nor reported */
+   void stopping();
 
    /* run: main loop */
    void run();
 
+   /* receive: read and forward available messages, return false on end of stream or error */
+   bool receive();
+
+   /* hangup: handle end of stream (epoll mode) */
+   void hangup();
+
    /* isRunning: check running */
    bool isRunning();
 
-   /* checkName: check thread name */
-   bool checkName(const char *args);
+   /* getAlias: get alias without options from "alias,options|..." into buff of MMDAGENT_MAXBUFLEN */
+   static void getAlias(const char *args, char *buff);
+
+   /* subscribe: set message types to be sent */
+   void subscribe(const char *args);
+
+   /* coalesce: set message types of which only latest pending value is sent */
+   void coalesce(const char *args);
+
+   /* accepts: check if message type is to be sent */
+   bool accepts(const char *type);
+
+   /* setHangup: set handler called by reader when subprocess hangs up, until it is stopped */
+   void setHangup(SubProcess_HangupFunc func, void *param);
+
+   /* isStandby: check if output is suppressed as hot-standby replica */
+   bool isStandby();
+
+   /* getStandbys: get number of hot-standby replicas to be kept */
+   int getStandbys();
+
+   /* promote: forward output from now on, taking over requests in flight of failed primary */
+   void promote(SubProcess_Thread *primary);
+
+   /* isFramed: check if messages are written in frames */
+   bool isFramed();
+
+   /* call: register request to be written as SUBPROC_REQUEST, return its correlation ID or 0 if not running */
+   unsigned long call(const char *reqtype, double timeout);
+
+   /* expireCalls: report requests past deadline at now (negative means all) as timed out */
+   void expireCalls(double now);
+
+   /* getCallDeadline: get earliest deadline of requests, 0 if none */
+   double getCallDeadline();
+
+   /* putv: write messages, in lines or frames, to subprocess */
+   int putv(SubProcess_Message **msgs, int num);
+
+   /* flush: write pending messages without blocking */
+   int flush();
+
+   /* getFlushTime: get time when pending messages are to be written, 0 if none */
+   double getFlushTime();
+
+   /* getFd: get file descriptor of socketpair */
+   int getFd();
+
+   /* getHandle: get handle of subprocess in process table, -1 if not running */
+   int getHandle();
+
+   /* hasPending: check if messages wait in outbound buffer */
+   bool hasPending();
+
+   /* getDrain: get msec to write pending messages when stopped */
+   int getDrain();
+
+   /* getHupWait: get msec after SIGHUP before SIGTERM */
+   int getHupWait();
+
+   /* getTermWait: get msec after SIGTERM before SIGKILL */
+   int getTermWait();
+
+   /* getOutstanding: get bytes written or pending but not yet read by subprocess, with dispatcher */
+   unsigned long getOutstanding();
+
+   /* getDropped: get number of discarded messages */
+   unsigned long getDropped();
+
+   /* getCoalesced: get number of pending messages replaced by newer ones */
+   unsigned long getCoalesced();
+
+   /* getName: get alias */
+   const char *getName();
 
-   /* puts: write a string and a trailing newline to subprocess */
-   int puts(const char *str);
+   /* getStats: get published statistics, NULL if not tracked */
+   SubProcStats_Proc *getStats();
 };
@@ -0,0 +1,245 @@
+/* ----------------------------------------------------------------- */
+/*           SubProcess plugin for MMDAgent                          */
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2016-2016  Jianming Liu                            */
+/*  Copyright (c) 2011-2012  S. Irie                                 */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* 1. Redistributions of source code must retain the above copyright */
+/*    notice, this list of conditions and the following disclaimer.  */
+/* 2. Redistributions in binary form must reproduce the above        */
+/*    copyright notice, this list of conditions and the following    */
+/*    disclaimer in the documentation and/or other materials         */
+/*    provided with the distribution.                                */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR             */
+/* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,      */
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT  */
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF  */
+/* USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED   */
+/* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT       */
+/* LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/* ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE   */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+/* subproc_stat: print rates of statistics published by Plugin_SubProcess
+
+   usage: subproc_stat [-i sec] [-n count] [PID | NAME]
+     -i sec   : interval of samples (default 1)
+     -n count : number of reports (default 0, means forever)
+     PID      : process running the plugin, NAME : name of shared memory given by SUBPROC_STATS
+   Without PID or NAME, the first "/dev/shm/subproc-stats-*" is read. */
+
+/* headers */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+
+#include "../SubProcess_Stats.h"
+
+/* openSegment: map segment of statistics read-only */
+static const SubProcStats_Segment *openSegment(const char *arg)
+{
+   int fd;
+   char name[512];
+   DIR *dir;
+   struct dirent *ent;
+   void *p;
+
+   name[0] = '\0';
+   if(arg == NULL) {
+      /* first segment found */
+      dir = opendir("/dev/shm");
+      if(dir != NULL) {
+         while((ent = readdir(dir)) != NULL) {
+            if(strncmp(ent->d_name, SUBPROCSTATS_PREFIX + 1, strlen(SUBPROCSTATS_PREFIX) - 1) == 0) {
+               snprintf(name, sizeof(name), "/%s", ent->d_name);
+               break;
+            }
+         }
+         closedir(dir);
+      }
+   } else if(strspn(arg, "0123456789") == strlen(arg)) {
+      snprintf(name, sizeof(name), "%s%s", SUBPROCSTATS_PREFIX, arg);
+   } else {
+      snprintf(name, sizeof(name), "%s%s", (arg[0] == '/') ? "" : "/", arg);
+   }
+   if(name[0] == '\0') {
+      fprintf(stderr, "subproc_stat: no statistics found\n");
+      return NULL;
+   }
+
+   fd = shm_open(name, O_RDONLY, 0);
+   if(fd < 0) {
+      perror(name);
+      return NULL;
+   }
+   p = mmap(NULL, sizeof(SubProcStats_Segment), PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if(p == MAP_FAILED) {
+      perror(name);
+      return NULL;
+   }
+   if(((const SubProcStats_Segment *) p)->magic != SUBPROCSTATS_MAGIC || ((const SubProcStats_Segment *) p)->version != SUBPROCSTATS_VERSION) {
+      fprintf(stderr, "%s: unknown format\n", name);
+      return NULL;
+   }
+
+   return (const SubProcStats_Segment *) p;
+}
+
+/* isWorker: check if slot is a running worker "alias#N" of group whose alias is len bytes of name */
+static int isWorker(const SubProcStats_Proc *proc, const char *name, int len)
+{
+   return proc->used == 1 && proc->standby == 0 && strncmp(proc->name, name, len) == 0 && proc->name[len] == '#'
+          && proc->name[len + 1] != '\0' && strspn(proc->name + len + 1, "0123456789") == strlen(proc->name + len + 1);
+}
+
+/* reportGroups: print total rate and depth of workers of each group, where a busy worker shows hot keys */
+static void reportGroups(const SubProcStats_Segment *cur, const SubProcStats_Segment *prev, double sec)
+{
+   int i, j, len, workers;
+   const char *mark;
+   double rate, sum, max;
+   uint64_t pending;
+
+   for(i = 0; i < SUBPROCSTATS_MAXPROCS; i++) {
+      mark = strrchr(cur->procs[i].name, '#');
+      if(mark == NULL)
+         continue;
+      len = (int) (mark - cur->procs[i].name);
+      if(isWorker(&cur->procs[i], cur->procs[i].name, len) == 0)
+         continue;
+      /* first worker of group */
+      for(j = 0; j < i && isWorker(&cur->procs[j], cur->procs[i].name, len) == 0; j++);
+      if(j < i)
+         continue;
+      workers = 0;
+      sum = max = 0.0;
+      pending = 0;
+      for(j = i; j < SUBPROCSTATS_MAXPROCS; j++) {
+         if(isWorker(&cur->procs[j], cur->procs[i].name, len) == 0)
+            continue;
+         rate = (double) (cur->procs[j].msgsOut - ((prev->procs[j].generation == cur->procs[j].generation && prev->procs[j].used == 1) ? prev->procs[j].msgsOut : 0)) / sec;
+         workers++;
+         sum += rate;
+         if(rate > max)
+            max = rate;
+         pending += cur->procs[j].pendingMsgs;
+      }
+      printf("  group %.*s  workers %d  out %.0f/s  pending %llu  busiest %.0f%% of mean\n", len, cur->procs[i].name, workers, sum,
+             (unsigned long long) pending, (sum > 0.0) ? max * 100.0 * workers / sum : 0.0);
+   }
+}
+
+/* report: print rates between two samples */
+static void report(const SubProcStats_Segment *cur, const SubProcStats_Segment *prev, double sec)
+{
+   int i;
+   const SubProcStats_Proc *c, *p;
+   uint64_t depth;
+
+#define RATE(field) ((double) ((c)->field - (p)->field) / sec)
+
+   depth = (cur->enqueued > cur->dequeued) ? cur->enqueued - cur->dequeued : 0;
+   printf("pid %d  enqueue %.0f/s  queue %llu  batches %.0f/s  wakeups %.0f/s  allocs %.0f/s\n", cur->pid,
+          (double) (cur->enqueued - prev->enqueued) / sec, (unsigned long long) depth,
+          (double) (cur->batches - prev->batches) / sec, (double) (cur->wakeups - prev->wakeups) / sec,
+          (double) (cur->allocs - prev->allocs) / sec);
+   printf("  failovers %llu  failover99 %lluus  standbys launched %llu\n", (unsigned long long) cur->failovers,
+          (unsigned long long) subprocstats_percentile(&cur->failover, 99.0), (unsigned long long) cur->standbys);
+   for(i = 0; i < SUBPROCSTATS_LANES; i++) {
+      depth = (cur->laneEnqueued[i] > cur->laneDequeued[i]) ? cur->laneEnqueued[i] - cur->laneDequeued[i] : 0;
+      printf("  lane %d  enqueue %.0f/s  queue %llu  wait99 %lluus  dropped %llu\n", i, (double) (cur->laneEnqueued[i] - prev->laneEnqueued[i]) / sec,
+             (unsigned long long) depth, (unsigned long long) subprocstats_percentile(&cur->laneWait[i], 99.0), (unsigned long long) cur->laneOverflows[i]);
+   }
+   printf("%-16s %7s %-7s %9s %9s %9s %9s %8s %8s %8s %8s %8s %8s %8s %8s %8s\n", "name", "pid", "role", "out/s", "outKB/s", "in/s", "drop/s", "coal/s", "errors", "pending",
+          "disp50", "disp99", "fwd99", "call/s", "tmout/s", "call99");
+
+   for(i = 0; i < SUBPROCSTATS_MAXPROCS; i++) {
+      c = &cur->procs[i];
+      p = &prev->procs[i];
+      if(c->used != 1)
+         continue;
+      /* rates of a reused slot start from zero */
+      if(p->generation != c->generation || p->used != 1) {
+         static const SubProcStats_Proc zero;
+         p = &zero;
+      }
+      printf("%-16.16s %7d %-7s %9.0f %9.1f %9.0f %9.0f %8.0f %8llu %8llu %6lluus %6lluus %6lluus %8.0f %8.0f %6lluus\n", c->name, c->pid,
+             (c->standby != 0) ? "standby" : "primary", RATE(msgsOut), RATE(bytesOut) / 1024.0, RATE(msgsIn), RATE(dropped), RATE(coalesced),
+             (unsigned long long) c->writeErrors, (unsigned long long) c->pendingMsgs,
+             (unsigned long long) subprocstats_percentile(&c->dispatch, 50.0),
+             (unsigned long long) subprocstats_percentile(&c->dispatch, 99.0),
+             (unsigned long long) subprocstats_percentile(&c->forward, 99.0),
+             RATE(calls), RATE(callTimeouts), (unsigned long long) subprocstats_percentile(&c->call, 99.0));
+   }
+   reportGroups(cur, prev, sec);
+   printf("\n");
+   fflush(stdout);
+
+#undef RATE
+}
+
+/* main: main function */
+int main(int argc, char **argv)
+{
+   int opt, count = 0, n;
+   double interval = 1.0;
+   const SubProcStats_Segment *seg;
+   SubProcStats_Segment *cur, *prev, *tmp;
+
+   while((opt = getopt(argc, argv, "i:n:")) != -1) {
+      switch(opt) {
+      case 'i':
+         interval = atof(optarg);
+         break;
+      case 'n':
+         count = atoi(optarg);
+         break;
+      default:
+         fprintf(stderr, "usage: %s [-i sec] [-n count] [PID | NAME]\n", argv[0]);
+         return 1;
+      }
+   }
+   if(interval <= 0.0)
+      interval = 1.0;
+
+   seg = openSegment((optind < argc) ? argv[optind] : NULL);
+   if(seg == NULL)
+      return 1;
+
+   /* copy samples not to mix updates in a report */
+   cur = (SubProcStats_Segment *) malloc(sizeof(SubProcStats_Segment));
+   prev = (SubProcStats_Segment *) malloc(sizeof(SubProcStats_Segment));
+   memcpy(prev, seg, sizeof(SubProcStats_Segment));
+
+   for(n = 0; count <= 0 || n < count; n++) {
+      usleep((useconds_t) (interval * 1000000.0));
+      memcpy(cur, seg, sizeof(SubProcStats_Segment));
+      report(cur, prev, interval);
+      tmp = prev;
+      prev = cur;
+      cur = tmp;
+   }
+
+   free(cur);
+   free(prev);
+   return 0;
+}